@@ -0,0 +1,669 @@
+#include "archive.h"
+#include "chunk.h"
+#include "helpers.h"
+#include "io.h"
+#include "lz78.h"
+#include "pool.h"
+#include "trace.h"
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define PARTS_PER_THREAD 4 // Parts of a single extracted member decoded per thread between writes.
+
+//A file in the archive.
+typedef struct Member {
+    char *path; // Where it is read from, or extracted to.
+    const char *name; // Its name in the archive, a suffix of path.
+    uint64_t size;
+    uint64_t mtime; // Nanoseconds since the epoch.
+    uint32_t mode;
+    uint32_t first_part; // Index of its first part in Archive.parts, the others following it.
+} Member;
+
+//A part of a member, and where its payload is in the archive.
+typedef struct Part {
+    uint32_t member;
+    uint32_t length; // Compressed bytes.
+    uint64_t offset;
+} Part;
+
+//The members and parts of an archive, and what the threads coding the parts share.
+typedef struct Archive {
+    Member *members;
+    uint32_t count;
+    uint32_t capacity;
+    Part *parts;
+    uint32_t part_count;
+    uint32_t part_size;
+    bool blocks; // Decoder: the parts are blocks (CHUNK_BLOCKS).
+    uint64_t memory; // Decoder: most bytes the part buffers may take, or 0 for no limit.
+    uint32_t *order; // Parts, largest first: the pool's tasks.
+    LZ78Params params; // Raw stream parameters of every part.
+    uint32_t workers;
+    uint8_t **in; // Encoder: each worker's buffer for the part it reads.
+    uint8_t **out; // Each worker's buffer for the part it codes.
+    Writer *writer; // Encoder: the archive, written under lock.
+    uint64_t offset; // Encoder: archive offset of the next part, under lock.
+    pthread_mutex_t lock;
+    const uint8_t *map; // Decoder: the whole archive.
+    atomic_uint *remaining; // Decoder: parts of each member not yet written.
+    uint8_t *batch; // Decoder, single member: its parts first to first + n, decoded in order.
+    uint32_t first;
+    atomic_bool failed;
+} Archive;
+
+/*
+    Little-endian helpers for the directory fields.
+*/
+static void store_le(uint8_t *buf, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        buf[i] = (uint8_t) (value >> (BYTE * i));
+    }
+}
+
+static uint64_t load_le(const uint8_t *buf, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t) buf[i] << (BYTE * i);
+    }
+    return value;
+}
+
+/*
+    malloc() that exits when out of memory.
+*/
+static void *allocate(size_t size) {
+    void *block = malloc(size != 0 ? size : 1);
+    if (block == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    return block;
+}
+
+/*
+    Parts of a member of size bytes, and the uncompressed length of its part index.
+*/
+static uint64_t part_count(const Archive *a, uint64_t size) {
+    return size / a->part_size + (size % a->part_size != 0);
+}
+
+static uint32_t part_length(const Archive *a, const Member *member, uint32_t index) {
+    uint64_t left = member->size - (uint64_t) (index - member->first_part) * a->part_size;
+    return left < a->part_size ? (uint32_t) left : a->part_size;
+}
+
+/*
+    Whether the len bytes of name are a relative path without empty, "." or ".." components, and
+    so stay under the directory they are extracted to.
+*/
+static bool name_safe(const char *name, size_t len) {
+    size_t start = 0;
+    for (size_t i = 0; i <= len; i++) {
+        if (i < len && name[i] == '\0') {
+            return false;
+        }
+        if (i == len || name[i] == '/') {
+            size_t part = i - start;
+            if (part == 0 || (part <= 2 && memcmp(name + start, "..", part) == 0)) {
+                return false;
+            }
+            start = i + 1;
+        }
+    }
+    return true;
+}
+
+/*
+    Name of the file at path in the archive: path without leading "/", "./" and "../".
+*/
+static const char *member_name(const char *path) {
+    for (;;) {
+        if (path[0] == '/') {
+            path++;
+        } else if (strncmp(path, "./", 2) == 0) {
+            path += 2;
+        } else if (strncmp(path, "../", 3) == 0) {
+            path += 3;
+        } else {
+            return path;
+        }
+    }
+}
+
+static bool add_path(Archive *a, const char *path);
+
+/*
+    Adds the files under the directory at path, recursively.
+*/
+static bool add_directory(Archive *a, const char *path) {
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        perror(path);
+        return false;
+    }
+    size_t len = strlen(path);
+    bool valid = true;
+    struct dirent *entry;
+    while (valid && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        char *child = (char *) allocate(len + strlen(entry->d_name) + 2);
+        strcpy(child, path);
+        if (len == 0 || path[len - 1] != '/') {
+            strcat(child, "/");
+        }
+        strcat(child, entry->d_name);
+        valid = add_path(a, child);
+        free(child);
+    }
+    closedir(dir);
+    return valid;
+}
+
+/*
+    Adds the file at path as a member, or the files under it if it is a directory. Anything else,
+    symbolic links included, is skipped with a warning.
+*/
+static bool add_path(Archive *a, const char *path) {
+    struct stat st;
+    if (lstat(path, &st) < 0) {
+        perror(path);
+        return false;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        return add_directory(a, path);
+    }
+    if (!S_ISREG(st.st_mode)) {
+        fprintf(stderr, "Skipping %s: not a regular file\n", path);
+        return true;
+    }
+    const char *name = member_name(path);
+    if (!name_safe(name, strlen(name))) {
+        fprintf(stderr, "Cannot archive %s: the name has \".\" or \"..\" in it\n", path);
+        return false;
+    }
+    if (a->count == a->capacity) {
+        a->capacity = a->capacity == 0 ? 256 : 2 * a->capacity;
+        a->members = (Member *) realloc(a->members, a->capacity * sizeof(Member));
+        if (a->members == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    char *copy = (char *) allocate(strlen(path) + 1);
+    strcpy(copy, path);
+    a->members[a->count++] = (Member) {
+        .path = copy,
+        .name = copy + (name - path),
+        .size = (uint64_t) st.st_size,
+        .mtime = (uint64_t) st.st_mtim.tv_sec * 1000000000 + (uint64_t) st.st_mtim.tv_nsec,
+        .mode = st.st_mode & 07777,
+    };
+    return true;
+}
+
+/*
+    qsort() comparator for uint64_t keys, largest first.
+*/
+static int descending(const void *x, const void *y) {
+    uint64_t first = *(const uint64_t *) x;
+    uint64_t second = *(const uint64_t *) y;
+    return (first < second) - (first > second);
+}
+
+/*
+    Orders the parts largest first, ties in archive order, for the pool to deal out.
+    Each sort key is a part's length above the complement of its index.
+*/
+static void sort_parts(Archive *a) {
+    uint64_t *keys = (uint64_t *) allocate(a->part_count * sizeof(uint64_t));
+    for (uint32_t i = 0; i < a->part_count; i++) {
+        const Member *member = &a->members[a->parts[i].member];
+        keys[i] = (uint64_t) part_length(a, member, i) << 32 | (UINT32_MAX - i);
+    }
+    qsort(keys, a->part_count, sizeof(uint64_t), descending);
+    a->order = (uint32_t *) allocate(a->part_count * sizeof(uint32_t));
+    for (uint32_t i = 0; i < a->part_count; i++) {
+        a->order[i] = UINT32_MAX - (uint32_t) keys[i];
+    }
+    free(keys);
+}
+
+/*
+    Cuts every member into parts. Returns false if there are more than fit in the directory.
+*/
+static bool plan_parts(Archive *a) {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < a->count; i++) {
+        a->members[i].first_part = (uint32_t) total;
+        total += part_count(a, a->members[i].size);
+        if (total > UINT32_MAX) {
+            fprintf(stderr, "Too many parts for one archive, use a larger -c\n");
+            return false;
+        }
+    }
+    a->part_count = (uint32_t) total;
+    a->parts = (Part *) allocate(total * sizeof(Part));
+    for (uint32_t i = 0; i < a->count; i++) {
+        for (uint32_t j = 0; j < part_count(a, a->members[i].size); j++) {
+            a->parts[a->members[i].first_part + j].member = i;
+        }
+    }
+    sort_parts(a);
+    return true;
+}
+
+/*
+    Gives each of threads workers its own buffers, allocated when it first needs them.
+*/
+static void alloc_workers(Archive *a, uint32_t threads) {
+    a->workers = threads;
+    a->in = (uint8_t **) calloc(threads, sizeof(uint8_t *));
+    a->out = (uint8_t **) calloc(threads, sizeof(uint8_t *));
+    if (a->in == NULL || a->out == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+}
+
+static void archive_free(Archive *a) {
+    for (uint32_t i = 0; i < a->count; i++) {
+        free(a->members[i].path);
+    }
+    for (uint32_t i = 0; i < a->workers; i++) {
+        free(a->in[i]);
+        free(a->out[i]);
+    }
+    free(a->in);
+    free(a->out);
+    free(a->members);
+    free(a->parts);
+    free(a->order);
+    free(a->remaining);
+    free(a->batch);
+}
+
+/*
+    Pool task: reads a part of a member and encodes it, then appends it to the archive under the
+    lock, recording where it went. Each part is a span of the trace.
+*/
+static void encode_part(void *context, uint32_t worker, uint32_t task) {
+    Archive *a = (Archive *) context;
+    uint32_t index = a->order[task];
+    Part *part = &a->parts[index];
+    const Member *member = &a->members[part->member];
+    uint32_t len = part_length(a, member, index);
+    if (a->in[worker] == NULL) {
+        a->in[worker] = (uint8_t *) allocate(a->part_size);
+        //The part is coded into the first half, and LZ78 tried in the second.
+        a->out[worker] = (uint8_t *) allocate(2 * chunk_bound(a->part_size, true, NULL));
+    }
+    trace_mark();
+    uint64_t start = trace_now();
+
+    int fd = open(member->path, O_RDONLY);
+    off_t position = (off_t) (index - member->first_part) * a->part_size;
+    if (fd < 0 || lseek(fd, position, SEEK_SET) < 0 || read_bytes(fd, a->in[worker], (int) len) != (int) len) {
+        fprintf(stderr, "Cannot read %s, or it changed while being archived\n", member->path);
+        exit(1);
+    }
+    close(fd);
+    uint8_t *scratch = a->out[worker] + chunk_bound(a->part_size, true, NULL);
+    uint32_t out_len = encode_chunk(a->in[worker], len, a->out[worker], scratch, &a->params);
+
+    pthread_mutex_lock(&a->lock);
+    part->offset = a->offset;
+    part->length = out_len;
+    a->offset += out_len;
+    writer_write(a->writer, a->out[worker], out_len);
+    total_syms += len;
+    total_bits += (uint64_t) out_len * BYTE;
+    pthread_mutex_unlock(&a->lock);
+    trace_span("encode part", start, trace_now(), "bytes", len);
+}
+
+/*
+    Writes the central directory and the trailer after the last part.
+*/
+static void write_directory(Archive *a) {
+    uint64_t directory = a->offset;
+    uint8_t field[ARCHIVE_ENTRY_SIZE];
+    for (uint32_t i = 0; i < a->count; i++) {
+        const Member *member = &a->members[i];
+        size_t name_len = strlen(member->name);
+        store_le(field, member->size, 8);
+        store_le(field + 8, member->mtime, 8);
+        store_le(field + 16, member->mode, 4);
+        store_le(field + 20, name_len, 4);
+        writer_write(a->writer, field, ARCHIVE_ENTRY_SIZE);
+        writer_write(a->writer, (const uint8_t *) member->name, name_len);
+        a->offset += ARCHIVE_ENTRY_SIZE + name_len;
+        for (uint32_t j = 0; j < part_count(a, member->size); j++) {
+            const Part *part = &a->parts[member->first_part + j];
+            store_le(field, part->offset, 8);
+            store_le(field + 8, part->length, 4);
+            writer_write(a->writer, field, ARCHIVE_PART_SIZE);
+            a->offset += ARCHIVE_PART_SIZE;
+        }
+    }
+    uint8_t trailer[ARCHIVE_TRAILER_SIZE];
+    store_le(trailer, directory, 8);
+    store_le(trailer + 8, a->part_size | CHUNK_BLOCKS, 4);
+    store_le(trailer + 12, a->count, 4);
+    store_le(trailer + 16, ARCHIVE_MAGIC, 4);
+    writer_write(a->writer, trailer, ARCHIVE_TRAILER_SIZE);
+    total_bits += (a->offset - directory + ARCHIVE_TRAILER_SIZE) * BYTE;
+}
+
+/*
+    Collects the members, then encodes their parts on a work-stealing pool, largest first, so one
+    large file does not leave the other threads idle at the end. Parts go into the archive as they
+    finish, and the directory, written last, records where.
+*/
+bool encode_archive(char **paths, uint32_t count, Writer *writer, uint64_t offset, uint32_t part_size,
+    uint32_t threads, const LZ78Params *params) {
+    Archive a = { .part_size = part_size, .params = *params, .writer = writer, .offset = offset };
+    a.params.raw = true;
+    bool valid = true;
+    for (uint32_t i = 0; i < count && valid; i++) {
+        valid = add_path(&a, paths[i]);
+    }
+    valid = valid && plan_parts(&a);
+    if (valid) {
+        alloc_workers(&a, threads);
+        pthread_mutex_init(&a.lock, NULL);
+        pool_run(threads, a.part_count, encode_part, &a);
+        pthread_mutex_destroy(&a.lock);
+        write_directory(&a);
+    }
+    archive_free(&a);
+    return valid;
+}
+
+/*
+    Reads the directory of the size byte archive at map. Members get the path dir/name, or their
+    name alone if dir is NULL. Returns false if the directory is malformed or a part lies outside
+    the payloads.
+*/
+static bool read_directory(Archive *a, const uint8_t *map, uint64_t size, const char *dir) {
+    if (size < LZ78_HEADER_SIZE + ARCHIVE_TRAILER_SIZE) {
+        return false;
+    }
+    uint64_t end = size - ARCHIVE_TRAILER_SIZE;
+    uint64_t directory = load_le(map + end, 8);
+    uint32_t count = (uint32_t) load_le(map + end + 12, 4);
+    a->part_size = (uint32_t) load_le(map + end + 8, 4) & ~CHUNK_BLOCKS;
+    a->blocks = (load_le(map + end + 8, 4) & CHUNK_BLOCKS) != 0;
+    if (load_le(map + end + 16, 4) != ARCHIVE_MAGIC || a->part_size == 0 || a->part_size > (1 << 30)
+        || directory < LZ78_HEADER_SIZE || directory > end || count > (end - directory) / ARCHIVE_ENTRY_SIZE) {
+        return false;
+    }
+    total_syms += size - directory;
+
+    a->members = (Member *) allocate(count * sizeof(Member));
+    a->parts = (Part *) allocate((end - directory) / ARCHIVE_PART_SIZE * sizeof(Part));
+    size_t dir_len = dir != NULL ? strlen(dir) + 1 : 0;
+    const uint8_t *cursor = map + directory;
+    const uint8_t *limit = map + end;
+    for (uint32_t i = 0; i < count; i++) {
+        if (limit - cursor < ARCHIVE_ENTRY_SIZE) {
+            return false;
+        }
+        Member *member = &a->members[i];
+        member->size = load_le(cursor, 8);
+        member->mtime = load_le(cursor + 8, 8);
+        member->mode = (uint32_t) load_le(cursor + 16, 4) & 07777;
+        uint32_t name_len = (uint32_t) load_le(cursor + 20, 4);
+        cursor += ARCHIVE_ENTRY_SIZE;
+        if ((uint64_t) (limit - cursor) < name_len || !name_safe((const char *) cursor, name_len)) {
+            return false;
+        }
+        member->path = (char *) allocate(dir_len + name_len + 1);
+        if (dir != NULL) {
+            strcpy(member->path, dir);
+            member->path[dir_len - 1] = '/';
+        }
+        memcpy(member->path + dir_len, cursor, name_len);
+        member->path[dir_len + name_len] = '\0';
+        member->name = member->path + dir_len;
+        a->count = i + 1;
+        cursor += name_len;
+
+        uint64_t parts = part_count(a, member->size);
+        if (parts > (uint64_t) (limit - cursor) / ARCHIVE_PART_SIZE) {
+            return false;
+        }
+        member->first_part = a->part_count;
+        for (uint32_t j = 0; j < parts; j++, cursor += ARCHIVE_PART_SIZE) {
+            Part *part = &a->parts[a->part_count++];
+            part->member = i;
+            part->offset = load_le(cursor, 8);
+            part->length = (uint32_t) load_le(cursor + 8, 4);
+            if (part->offset < LZ78_HEADER_SIZE || part->offset > directory
+                || part->length > directory - part->offset
+                || part->length > chunk_bound(a->part_size, a->blocks, &a->params)) {
+                return false;
+            }
+        }
+    }
+    return cursor == limit;
+}
+
+/*
+    Creates (or truncates) the file at path, and its missing parent directories.
+    Returns its fd, or -1 with errno set.
+*/
+static int create_file(char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd >= 0 || errno != ENOENT) {
+        return fd;
+    }
+    for (char *slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        mkdir(path, S_IRWXU | S_IRWXG | S_IRWXO);
+        *slash = '/';
+    }
+    return open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+}
+
+/*
+    Gives an extracted member, fully written to fd, its mode and mtime.
+*/
+static void finish_file(int fd, const Member *member) {
+    struct timespec times[2] = {
+        { .tv_sec = 0, .tv_nsec = UTIME_OMIT },
+        { .tv_sec = (time_t) (member->mtime / 1000000000), .tv_nsec = (long) (member->mtime % 1000000000) },
+    };
+    fchmod(fd, (mode_t) member->mode);
+    futimens(fd, times);
+}
+
+/*
+    Pool task: decodes a part and writes it into its member's file, which it creates if the part is
+    the member's only one. Whichever part of a member is written last finishes the file.
+    Each part is a span of the trace.
+*/
+static void extract_part(void *context, uint32_t worker, uint32_t task) {
+    Archive *a = (Archive *) context;
+    uint32_t index = a->order[task];
+    const Part *part = &a->parts[index];
+    Member *member = &a->members[part->member];
+    uint32_t len = part_length(a, member, index);
+    if (a->out[worker] == NULL) {
+        a->out[worker] = (uint8_t *) allocate(a->part_size);
+    }
+    trace_mark();
+    uint64_t start = trace_now();
+
+    if (!decode_chunk(a->map + part->offset, part->length, a->out[worker], len, a->blocks, &a->params)) {
+        atomic_store(&a->failed, true);
+        return;
+    }
+    int fd = member->size <= a->part_size ? create_file(member->path) : open(member->path, O_WRONLY);
+    off_t position = (off_t) (index - member->first_part) * a->part_size;
+    if (fd < 0 || lseek(fd, position, SEEK_SET) < 0 || write_bytes(fd, a->out[worker], (int) len) != (int) len) {
+        perror(member->path);
+        exit(1);
+    }
+    if (atomic_fetch_sub(&a->remaining[part->member], 1) == 1) {
+        finish_file(fd, member);
+    }
+    close(fd);
+    __atomic_fetch_add(&total_syms, part->length, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&total_bits, (uint64_t) len * BYTE, __ATOMIC_RELAXED);
+    trace_span("decode part", start, trace_now(), "bytes", len);
+}
+
+/*
+    Extracts every member. Members of more than one part are created up front, as any of their
+    parts may be written first; the others, and their directories, are created by the threads.
+*/
+static bool extract_all(Archive *a, uint32_t threads) {
+    a->remaining = (atomic_uint *) allocate(a->count * sizeof(atomic_uint));
+    for (uint32_t i = 0; i < a->count; i++) {
+        Member *member = &a->members[i];
+        uint32_t parts = (uint32_t) part_count(a, member->size);
+        atomic_init(&a->remaining[i], parts);
+        if (parts != 1) {
+            int fd = create_file(member->path);
+            if (fd < 0) {
+                perror(member->path);
+                exit(1);
+            }
+            if (parts == 0) {
+                finish_file(fd, member);
+            }
+            close(fd);
+        }
+    }
+    sort_parts(a);
+    alloc_workers(a, threads);
+    pool_run(threads, a->part_count, extract_part, a);
+    return !atomic_load(&a->failed);
+}
+
+/*
+    Pool task: checks a part, decoding it with the output discarded, and reports the member of a
+    damaged one.
+*/
+static void verify_part(void *context, uint32_t worker, uint32_t task) {
+    Archive *a = (Archive *) context;
+    (void) worker;
+    const Part *part = &a->parts[a->order[task]];
+    const Member *member = &a->members[part->member];
+    uint32_t len = part_length(a, member, a->order[task]);
+    trace_mark();
+    uint64_t start = trace_now();
+    if (!decode_chunk(a->map + part->offset, part->length, NULL, len, a->blocks, &a->params)) {
+        fprintf(stderr, "%s: corrupt part at offset %" PRIu64 "\n", member->name,
+            (uint64_t) (a->order[task] - member->first_part) * a->part_size);
+        atomic_store(&a->failed, true);
+    }
+    __atomic_fetch_add(&total_syms, part->length, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&total_bits, (uint64_t) len * BYTE, __ATOMIC_RELAXED);
+    trace_span("verify part", start, trace_now(), "bytes", len);
+}
+
+/*
+    Pool task: decodes part first + task of a single member into its place in the batch.
+*/
+static void extract_batch_part(void *context, uint32_t worker, uint32_t task) {
+    Archive *a = (Archive *) context;
+    (void) worker;
+    uint32_t index = a->first + task;
+    const Part *part = &a->parts[index];
+    uint32_t len = part_length(a, &a->members[part->member], index);
+    trace_mark();
+    uint64_t start = trace_now();
+    uint8_t *out = a->batch + (size_t) task * a->part_size;
+    if (!decode_chunk(a->map + part->offset, part->length, out, len, a->blocks, &a->params)) {
+        atomic_store(&a->failed, true);
+    }
+    __atomic_fetch_add(&total_syms, part->length, __ATOMIC_RELAXED);
+    trace_span("decode part", start, trace_now(), "bytes", len);
+}
+
+/*
+    Extracts the member named name into the writer, decoding PARTS_PER_THREAD parts per thread at a
+    time (fewer if they do not fit in a->memory) and writing them in order. Exits if there is no
+    such member.
+*/
+static bool extract_member(Archive *a, const char *name, Writer *writer, uint32_t threads) {
+    const Member *member = NULL;
+    for (uint32_t i = 0; i < a->count && member == NULL; i++) {
+        if (strcmp(a->members[i].name, name) == 0) {
+            member = &a->members[i];
+        }
+    }
+    if (member == NULL) {
+        fprintf(stderr, "No member %s in the archive\n", name);
+        exit(1);
+    }
+    uint32_t parts = (uint32_t) part_count(a, member->size);
+    uint32_t batch = threads * PARTS_PER_THREAD < parts ? threads * PARTS_PER_THREAD : parts;
+    if (a->memory != 0 && (uint64_t) batch * a->part_size > a->memory) {
+        batch = (uint32_t) (a->memory / a->part_size);
+    }
+    a->batch = (uint8_t *) allocate((size_t) batch * a->part_size);
+    for (uint32_t done = 0; done < parts && !atomic_load(&a->failed); done += batch) {
+        uint32_t n = parts - done < batch ? parts - done : batch;
+        a->first = member->first_part + done;
+        pool_run(threads, n, extract_batch_part, a);
+        for (uint32_t i = 0; i < n && !atomic_load(&a->failed); i++) {
+            uint32_t len = part_length(a, member, a->first + i);
+            writer_write(writer, a->batch + (size_t) i * a->part_size, len);
+            total_bits += (uint64_t) len * BYTE;
+        }
+    }
+    fchmod(writer->fd, (mode_t) member->mode);
+    return !atomic_load(&a->failed);
+}
+
+/*
+    Maps the whole archive, reads its directory and extracts from it, or only checks every part
+    when params->discard is set.
+*/
+bool decode_archive(int infile, Writer *writer, const char *member, const char *dir, uint32_t threads,
+    const Options *options, const LZ78Params *params) {
+    struct stat st;
+    if (fstat(infile, &st) < 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "Input is not seekable\n");
+        exit(1);
+    }
+    uint8_t *map = (uint8_t *) mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, infile, 0);
+    if (map == MAP_FAILED) {
+        perror(NULL);
+        exit(1);
+    }
+    Archive a = { .params = *params, .map = map };
+    a.params.raw = true;
+    atomic_init(&a.failed, false);
+    bool valid = read_directory(&a, map, (uint64_t) st.st_size, member == NULL && !params->discard ? dir : NULL);
+    //Each thread decodes a part at a time into a buffer (or, checking a CRC, a scratch block) of its own.
+    uint64_t buffers = (uint64_t) threads * a.part_size;
+    if (valid && options->chunk_memory != 0 && buffers > options->chunk_memory) {
+        fprintf(stderr, "Memory budget too small: %" PRIu64 " bytes needed\n",
+            memory_needed(options, params, false, true, buffers));
+        exit(1);
+    }
+    a.memory = options->chunk_memory;
+    if (valid && params->discard) {
+        sort_parts(&a);
+        pool_run(threads, a.part_count, verify_part, &a);
+        valid = !atomic_load(&a.failed);
+    } else if (valid) {
+        valid = member == NULL ? extract_all(&a, threads) : extract_member(&a, member, writer, threads);
+    }
+    archive_free(&a);
+    munmap(map, (size_t) st.st_size);
+    return valid;
+}
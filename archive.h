@@ -0,0 +1,63 @@
+#ifndef __ARCHIVE_H__
+#define __ARCHIVE_H__
+
+#include "helpers.h"
+#include "io.h"
+#include "lz78.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ARCHIVE_MAGIC        0xBAADBAAF
+#define ARCHIVE_TRAILER_SIZE 20 // Bytes of the directory offset, part size, count and ARCHIVE_MAGIC.
+#define ARCHIVE_ENTRY_SIZE   24 // Bytes of a directory entry before its name.
+#define ARCHIVE_PART_SIZE    12 // Bytes of a part's offset and length in a directory entry.
+
+//
+// Archive container, used when FileHeader.flags has FLAG_ARCHIVE set: many files (members) in one
+// file, each of them extractable on its own.
+//
+// After the FileHeader (and the dictionary ID, with FLAG_DICT) come the parts of the members, then
+// the central directory, one entry per member, and the trailer:
+//
+// +------+-----+------+---------+-----+---------+------------------+-----------+-------+---------------+
+// | part | ... | part | entry 0 | ... | entry n | directory offset | part size | count | ARCHIVE_MAGIC |
+// +------+-----+------+---------+-----+---------+------------------+-----------+-------+---------------+
+//
+// A member is cut into parts of part size bytes (the last one shorter), each an independent pair
+// stream like a chunk of chunk.h (or, with CHUNK_BLOCKS set in the part size, a block like such a
+// chunk's), coded with the parameters in the FileHeader. Parts are written in the order they
+// finish coding, so each entry records where its member's parts are:
+//
+// +------+-------+------+-------------+------+--------------------------+
+// | size | mtime | mode | name length | name | parts x (offset, length) |
+// +------+-------+------+-------------+------+--------------------------+
+//
+// size is the member's length in bytes, mtime its modification time in nanoseconds since the
+// epoch and mode its permission bits. name is its relative path, '/' separated, without "." or
+// ".." components. A member has size / part size parts, rounded up, each length compressed bytes
+// at offset from the start of the file. size, mtime, the offsets and the directory offset are
+// little-endian uint64_t, the other fields little-endian uint32_t.
+//
+
+//
+// Compresses the regular files among paths, and every regular file under the directories among
+// them, into an archive. The FileHeader (and dictionary ID) take the first offset bytes of the
+// output, which the writer continues. Members are cut into parts of part_size bytes, coded on up
+// to threads threads, largest first. Returns false if a path cannot be read.
+//
+bool encode_archive(char **paths, uint32_t count, Writer *writer, uint64_t offset, uint32_t part_size,
+    uint32_t threads, const LZ78Params *params);
+
+//
+// Extracts the archive infile (a regular file, read after its FileHeader and dictionary ID) on up
+// to threads threads: with member NULL, every member, under directory dir, with its mode and
+// mtime; otherwise only the member named member, into writer. With params->discard every part is
+// checked instead, and nothing written. The part buffers may take at most options->chunk_memory
+// bytes (if not 0), or the run exits, reporting the -m it needs. Returns false if the archive is
+// malformed or a member cannot be written.
+//
+bool decode_archive(int infile, Writer *writer, const char *member, const char *dir, uint32_t threads,
+    const Options *options, const LZ78Params *params);
+
+#endif
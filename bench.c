@@ -0,0 +1,574 @@
+#include "bitio.h"
+#include "code.h"
+#include "crc32c.h"
+#include "helpers.h"
+#include "lz78.h"
+#include "trie.h"
+#include "word.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_OPTIONS "s:r:d:o:h"
+#define BENCH_SIZE    (8 << 20) // Default bytes per corpus.
+#define BENCH_RUNS    3 // Default timed runs per measurement; the fastest is reported.
+#define MICRO_OPS     (1 << 24) // Operations per microbenchmark run.
+
+typedef void generator_t(uint8_t *buf, size_t len, uint64_t *seed);
+
+typedef struct Corpus {
+    const char *name;
+    generator_t *generate;
+} Corpus;
+
+//Result of running one of the executables on one corpus.
+typedef struct RunStats {
+    double seconds;
+    long peak_rss_kb;
+    bool ok;
+} RunStats;
+
+//Keeps the compiler from discarding the work of a microbenchmark.
+static volatile uint64_t sink;
+
+/*
+    xorshift64* generator: every corpus comes from a fixed seed, so each run benchmarks the same bytes.
+*/
+static uint64_t next_random(uint64_t *seed) {
+    *seed ^= *seed >> 12;
+    *seed ^= *seed << 25;
+    *seed ^= *seed >> 27;
+    return *seed * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+static uint32_t random_below(uint64_t *seed, uint32_t bound) {
+    return (uint32_t) ((next_random(seed) >> 32) % bound);
+}
+
+/*
+    Copies str into buf at *pos, truncating at len.
+*/
+static void append(uint8_t *buf, size_t len, size_t *pos, const char *str) {
+    while (*str != '\0' && *pos < len) {
+        buf[(*pos)++] = (uint8_t) *str++;
+    }
+}
+
+/*
+    English-like prose: words drawn with a skewed distribution, with punctuation and line breaks.
+*/
+static void generate_text(uint8_t *buf, size_t len, uint64_t *seed) {
+    static const char *words[] = { "the", "of", "and", "to", "a", "in", "is", "that", "for", "it",
+        "as", "was", "with", "be", "by", "on", "not", "he", "this", "are", "or", "his", "from", "at",
+        "which", "but", "have", "an", "had", "they", "you", "were", "their", "one", "all", "we",
+        "can", "her", "has", "there", "been", "if", "more", "when", "will", "would", "who", "so",
+        "compression", "dictionary", "algorithm", "symbol", "message", "sequence", "repeated",
+        "information", "encoder", "decoder", "stream", "pattern", "language", "different" };
+    const uint32_t count = sizeof(words) / sizeof(words[0]);
+    size_t pos = 0;
+    uint32_t line = 0;
+    while (pos < len) {
+        //Squaring a uniform index favours the common words at the front of the list.
+        uint32_t r = random_below(seed, count);
+        const char *word = words[r * r / count];
+        append(buf, len, &pos, word);
+        line += strlen(word) + 1;
+        uint32_t p = random_below(seed, 16);
+        append(buf, len, &pos, p == 0 ? ". " : p == 1 ? ", " : " ");
+        if (line > 72) {
+            append(buf, len, &pos, "\n");
+            line = 0;
+        }
+    }
+}
+
+/*
+    Server log lines: fixed layout with timestamps, levels, ids and request paths.
+*/
+static void generate_logs(uint8_t *buf, size_t len, uint64_t *seed) {
+    static const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+    static const char *paths[] = { "/api/v1/users", "/api/v1/orders", "/static/app.js",
+        "/healthz", "/api/v1/search", "/login" };
+    static const int statuses[] = { 200, 200, 200, 204, 301, 404, 500 };
+    char line[256];
+    size_t pos = 0;
+    uint64_t millis = 1700000000000ULL;
+    while (pos < len) {
+        millis += random_below(seed, 2000);
+        snprintf(line, sizeof(line),
+            "%llu.%03u %s [worker-%u] request_id=%08x method=GET path=%s status=%d latency_ms=%u\n",
+            (unsigned long long) (millis / 1000), (unsigned) (millis % 1000),
+            levels[random_below(seed, 6)], random_below(seed, 16), (unsigned) next_random(seed),
+            paths[random_below(seed, 6)], statuses[random_below(seed, 7)], random_below(seed, 900));
+        append(buf, len, &pos, line);
+    }
+}
+
+/*
+    Uniformly random bytes: incompressible.
+*/
+static void generate_random(uint8_t *buf, size_t len, uint64_t *seed) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t) (next_random(seed) >> 56);
+    }
+}
+
+/*
+    Long runs of one byte value, up to 64K bytes each.
+*/
+static void generate_runs(uint8_t *buf, size_t len, uint64_t *seed) {
+    size_t pos = 0;
+    while (pos < len) {
+        uint8_t sym = (uint8_t) random_below(seed, 256);
+        size_t run = 1 + random_below(seed, 1 << 16);
+        for (size_t i = 0; i < run && pos < len; i++) {
+            buf[pos++] = sym;
+        }
+    }
+}
+
+/*
+    Random symbols from a four letter alphabet, like DNA.
+*/
+static void generate_small_alphabet(uint8_t *buf, size_t len, uint64_t *seed) {
+    static const uint8_t alphabet[] = { 'A', 'C', 'G', 'T' };
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = alphabet[random_below(seed, 4)];
+    }
+}
+
+/*
+    Table of fixed-size little-endian records: counters, small integers, floats and zero padding.
+*/
+static void generate_binary(uint8_t *buf, size_t len, uint64_t *seed) {
+    uint8_t record[32];
+    size_t pos = 0;
+    uint32_t id = 0;
+    while (pos < len) {
+        memset(record, 0, sizeof(record));
+        uint32_t small = random_below(seed, 100);
+        float value = (float) random_below(seed, 1 << 20) / 1024.0f;
+        uint64_t stamp = 1700000000ULL + id * 3ULL;
+        id++;
+        for (int i = 0; i < 4; i++) {
+            record[i] = (uint8_t) (id >> (BYTE * i));
+            record[4 + i] = (uint8_t) (small >> (BYTE * i));
+        }
+        memcpy(record + 8, &value, sizeof(value));
+        for (int i = 0; i < 8; i++) {
+            record[12 + i] = (uint8_t) (stamp >> (BYTE * i));
+        }
+        for (size_t i = 0; i < sizeof(record) && pos < len; i++) {
+            buf[pos++] = record[i];
+        }
+    }
+}
+
+static const Corpus corpora[] = {
+    { "text", generate_text },
+    { "logs", generate_logs },
+    { "random", generate_random },
+    { "runs", generate_runs },
+    { "small_alphabet", generate_small_alphabet },
+    { "binary", generate_binary },
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+/*
+    Runs program with -i input -o output, timing it and collecting its peak resident set size.
+*/
+static RunStats run_program(const char *program, const char *input, const char *output) {
+    RunStats stats = { 0, 0, false };
+    double start = now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return stats;
+    }
+    if (pid == 0) {
+        execl(program, program, "-i", input, "-o", output, (char *) NULL);
+        perror(program);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        perror("wait4");
+        return stats;
+    }
+    stats.seconds = now() - start;
+    stats.peak_rss_kb = usage.ru_maxrss;
+    stats.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    return stats;
+}
+
+/*
+    Best of runs invocations: the fastest time and the largest peak RSS.
+*/
+static RunStats best_of(const char *program, const char *input, const char *output, uint32_t runs) {
+    RunStats best = { 0, 0, true };
+    for (uint32_t i = 0; i < runs && best.ok; i++) {
+        RunStats stats = run_program(program, input, output);
+        best.ok = stats.ok;
+        if (i == 0 || stats.seconds < best.seconds) {
+            best.seconds = stats.seconds;
+        }
+        if (stats.peak_rss_kb > best.peak_rss_kb) {
+            best.peak_rss_kb = stats.peak_rss_kb;
+        }
+    }
+    return best;
+}
+
+static bool write_file(const char *path, const uint8_t *buf, size_t len) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(buf, 1, len, file) == len;
+    return fclose(file) == 0 && ok;
+}
+
+/*
+    Checks that the file at path holds exactly buf.
+*/
+static bool same_contents(const char *path, const uint8_t *buf, size_t len) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+    uint8_t block[1 << 16];
+    size_t pos = 0;
+    size_t n;
+    bool same = true;
+    while (same && (n = fread(block, 1, sizeof(block), file)) > 0) {
+        same = pos + n <= len && memcmp(block, buf + pos, n) == 0;
+        pos += n;
+    }
+    fclose(file);
+    return same && pos == len;
+}
+
+static uint64_t file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t) st.st_size : 0;
+}
+
+/*
+    Encodes and decodes one corpus with the executables in dir and prints its JSON object.
+    Returns false if the round trip failed.
+*/
+static bool bench_corpus(FILE *out, const Corpus *corpus, uint8_t *buf, size_t len, const char *dir,
+    const char *tmp, uint32_t runs) {
+    char encoder[4096], decoder[4096], plain[4096], packed[4096], unpacked[4096];
+    snprintf(encoder, sizeof(encoder), "%s/encode", dir);
+    snprintf(decoder, sizeof(decoder), "%s/decode", dir);
+    snprintf(plain, sizeof(plain), "%s/%s", tmp, corpus->name);
+    snprintf(packed, sizeof(packed), "%s/%s.lz78", tmp, corpus->name);
+    snprintf(unpacked, sizeof(unpacked), "%s/%s.out", tmp, corpus->name);
+
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    corpus->generate(buf, len, &seed);
+    if (!write_file(plain, buf, len)) {
+        perror(plain);
+        return false;
+    }
+
+    RunStats enc = best_of(encoder, plain, packed, runs);
+    RunStats dec = enc.ok ? best_of(decoder, packed, unpacked, runs) : enc;
+    bool ok = enc.ok && dec.ok && same_contents(unpacked, buf, len);
+    uint64_t compressed = file_size(packed);
+    double mb = (double) len / (1 << 20);
+
+    fprintf(out,
+        "    { \"name\": \"%s\", \"bytes\": %zu, \"compressed_bytes\": %llu, \"ratio\": %.4f, "
+        "\"encode_mb_s\": %.2f, \"decode_mb_s\": %.2f, \"encode_peak_rss_kb\": %ld, "
+        "\"decode_peak_rss_kb\": %ld, \"ok\": %s }",
+        corpus->name, len, (unsigned long long) compressed, (double) compressed / (double) len,
+        enc.seconds > 0 ? mb / enc.seconds : 0.0, dec.seconds > 0 ? mb / dec.seconds : 0.0,
+        enc.peak_rss_kb, dec.peak_rss_kb, ok ? "true" : "false");
+
+    unlink(plain);
+    unlink(packed);
+    unlink(unpacked);
+    return ok;
+}
+
+/*
+    Packs pairs with growing code widths, as the encoder does, into a 1MB buffer that wraps around.
+    Each microbenchmark returns the seconds taken by its timed part.
+*/
+static double micro_pair_write(uint8_t *buf, const uint8_t *syms) {
+    BitAccumulator acc = { 0, 0 };
+    uint32_t pos = 0;
+    double start = now();
+    for (uint32_t i = 0; i < MICRO_OPS; i++) {
+        uint32_t code = i & max_code(LZ78_DEFAULT_BITS);
+        int bitlen = get_bitlength(code);
+        bits_put(&acc, buf, &pos, (uint32_t) code | ((uint32_t) syms[i & 0xFFFF] << bitlen), bitlen + BYTE);
+        if (pos > (1 << 20) - 8) {
+            pos = 0;
+        }
+    }
+    sink += pos;
+    return now() - start;
+}
+
+/*
+    Unpacks the pairs written by micro_pair_write.
+*/
+static double micro_pair_read(uint8_t *buf, const uint8_t *syms) {
+    (void) syms;
+    BitAccumulator acc = { 0, 0 };
+    uint32_t pos = 0;
+    uint64_t sum = 0;
+    double start = now();
+    for (uint32_t i = 0; i < MICRO_OPS; i++) {
+        int bitlen = get_bitlength(i & max_code(LZ78_DEFAULT_BITS));
+        bits_refill(&acc, buf, &pos, 1 << 20);
+        sum += bits_take(&acc, bitlen);
+        sum += bits_take(&acc, BYTE);
+        if (pos > (1 << 20) - 8) {
+            pos = 0;
+        }
+    }
+    sink += sum;
+    return now() - start;
+}
+
+/*
+    Walks the text corpus through a trie built from it, restarting at the root whenever a child is
+    missing. Only lookups are timed: the trie is filled beforehand.
+*/
+static double micro_trie_step(uint8_t *buf, const uint8_t *text) {
+    (void) buf;
+    Trie *trie = trie_create(LZ78_DEFAULT_BITS);
+    if (trie == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    TrieNode *node = trie->root;
+    uint32_t code = START_CODE;
+    for (uint32_t i = 0; code < max_code(LZ78_DEFAULT_BITS); i = (i + 1) & 0xFFFFF) {
+        TrieNode *next = trie_step(trie, node, text[i]);
+        if (next == NULL) {
+            trie_insert(trie, node, text[i], code++);
+            next = trie->root;
+        }
+        node = next;
+    }
+    double start = now();
+    uint64_t hits = 0;
+    node = trie->root;
+    for (uint32_t i = 0; i < MICRO_OPS; i++) {
+        TrieNode *next = trie_step(trie, node, text[i & 0xFFFFF]);
+        hits += next != NULL;
+        node = next != NULL ? next : trie->root;
+    }
+    double elapsed = now() - start;
+    sink += hits;
+    trie_delete(trie);
+    return elapsed;
+}
+
+/*
+    Extends random words of a 4096 entry table by one symbol, as the decoder does for each pair.
+    Freeing the replaced words is included.
+*/
+static double micro_word_append_sym(uint8_t *buf, const uint8_t *syms) {
+    (void) buf;
+    enum { TABLE = 4096 };
+    Word *table[TABLE];
+    uint8_t empty = 0;
+    uint64_t seed = 1;
+    uint64_t total = 0;
+    table[0] = word_create(&empty, 0);
+    for (uint32_t i = 1; i < TABLE; i++) {
+        table[i] = word_append_sym(table[random_below(&seed, i)], syms[i]);
+    }
+    double start = now();
+    for (uint32_t i = 0; i < MICRO_OPS / 16; i++) {
+        uint32_t slot = 1 + random_below(&seed, TABLE - 1);
+        Word *word = word_append_sym(table[random_below(&seed, TABLE)], syms[i & 0xFFFF]);
+        if (word->len > 256) {
+            word_delete(word);
+            word = word_append_sym(table[0], syms[i & 0xFFFF]);
+        }
+        total += word->len;
+        word_delete(table[slot]);
+        table[slot] = word;
+    }
+    double elapsed = now() - start;
+    for (uint32_t i = 0; i < TABLE; i++) {
+        word_delete(table[i]);
+    }
+    sink += total;
+    return elapsed;
+}
+
+/*
+    Computes the bit length of every code in turn.
+*/
+static double micro_get_bitlength(uint8_t *buf, const uint8_t *syms) {
+    (void) buf;
+    (void) syms;
+    uint64_t sum = 0;
+    double start = now();
+    for (uint32_t i = 0; i < MICRO_OPS; i++) {
+        sum += get_bitlength(i & max_code(LZ78_MAX_BITS));
+    }
+    sink += sum;
+    return now() - start;
+}
+
+/*
+    Checksums the 1MB text corpus 16 times over, one op per byte.
+*/
+static double micro_crc32c(uint8_t *buf, const uint8_t *text) {
+    (void) buf;
+    uint32_t crc = 0;
+    double start = now();
+    for (uint32_t i = 0; i < MICRO_OPS >> 20; i++) {
+        crc = crc32c(crc, text, 1 << 20);
+    }
+    sink += crc;
+    return now() - start;
+}
+
+typedef double micro_t(uint8_t *buf, const uint8_t *input);
+
+typedef struct Micro {
+    const char *name;
+    micro_t *run;
+    uint32_t ops;
+} Micro;
+
+static const Micro micros[] = {
+    { "pair_write", micro_pair_write, MICRO_OPS },
+    { "pair_read", micro_pair_read, MICRO_OPS },
+    { "trie_step", micro_trie_step, MICRO_OPS },
+    { "word_append_sym", micro_word_append_sym, MICRO_OPS / 16 },
+    { "get_bitlength", micro_get_bitlength, MICRO_OPS },
+    { "crc32c", micro_crc32c, MICRO_OPS },
+};
+
+/*
+    Runs every microbenchmark runs times over the text corpus and prints the best ns/op of each.
+*/
+static void bench_micros(FILE *out, uint32_t runs) {
+    uint8_t *pairs = (uint8_t *) calloc(1, 1 << 20);
+    uint8_t *text = (uint8_t *) malloc(1 << 20);
+    if (pairs == NULL || text == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    generate_text(text, 1 << 20, &seed);
+
+    const uint32_t count = sizeof(micros) / sizeof(micros[0]);
+    for (uint32_t m = 0; m < count; m++) {
+        double best = 0;
+        for (uint32_t r = 0; r < runs; r++) {
+            double elapsed = micros[m].run(pairs, text);
+            if (r == 0 || elapsed < best) {
+                best = elapsed;
+            }
+        }
+        fprintf(out, "    { \"name\": \"%s\", \"ops\": %u, \"ns_per_op\": %.3f }%s\n", micros[m].name,
+            micros[m].ops, best * 1e9 / micros[m].ops, m + 1 < count ? "," : "");
+    }
+    free(text);
+    free(pairs);
+}
+
+static void print_help(void) {
+    printf("SYNOPSIS\n"
+           "   Benchmarks the LZ78 encoder and decoder on generated corpora, and times the\n"
+           "   codec's inner routines. Results are written as JSON.\n\n"
+
+           "USAGE\n"
+           "   ./benchmark [-h] [-s size] [-r runs] [-d dir] [-o output]\n\n"
+
+           "OPTIONS\n"
+           "   -s size     Bytes per corpus, K/M/G suffixes allowed (8M by default)\n"
+           "   -r runs     Timed runs per measurement, the best is reported (3 by default)\n"
+           "   -d dir      Directory holding the encode and decode executables (. by default)\n"
+           "   -o output   Specify output of the JSON results (stdout by default)\n"
+           "   -h          Display program help and usage\n");
+}
+
+int main(int argc, char **argv) {
+    uint64_t size = BENCH_SIZE;
+    uint64_t runs = BENCH_RUNS;
+    const char *dir = ".";
+    FILE *out = stdout;
+    int opt;
+    while ((opt = getopt(argc, argv, BENCH_OPTIONS)) != -1) {
+        switch (opt) {
+        case 's':
+            if (!parse_size(optarg, &size) || size == 0 || size > (1ULL << 32)) {
+                fprintf(stderr, "Invalid corpus size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'r':
+            if (!parse_size(optarg, &runs) || runs == 0 || runs > 1000) {
+                fprintf(stderr, "Invalid run count: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'd': dir = optarg; break;
+        case 'o':
+            out = fopen(optarg, "w");
+            if (out == NULL) {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        case 'h': print_help(); return 0;
+        default: print_help(); return 1;
+        }
+    }
+
+    const char *tmpdir = getenv("TMPDIR");
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s/lz78bench.XXXXXX", tmpdir != NULL ? tmpdir : "/tmp");
+    uint8_t *buf = (uint8_t *) malloc(size);
+    if (buf == NULL || mkdtemp(tmp) == NULL) {
+        perror(NULL);
+        return 1;
+    }
+
+    bool ok = true;
+    const uint32_t count = sizeof(corpora) / sizeof(corpora[0]);
+    fprintf(out, "{\n  \"corpus_bytes\": %llu,\n  \"runs\": %llu,\n  \"corpora\": [\n",
+        (unsigned long long) size, (unsigned long long) runs);
+    for (uint32_t i = 0; i < count; i++) {
+        ok &= bench_corpus(out, &corpora[i], buf, size, dir, tmp, (uint32_t) runs);
+        fprintf(out, "%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ],\n  \"micro\": [\n");
+    bench_micros(out, (uint32_t) runs);
+    fprintf(out, "  ]\n}\n");
+
+    rmdir(tmp);
+    free(buf);
+    if (out != stdout) {
+        fclose(out);
+    }
+    if (!ok) {
+        fprintf(stderr, "Round trip failed\n");
+    }
+    return ok ? 0 : 1;
+}
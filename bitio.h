@@ -0,0 +1,137 @@
+#ifndef __BITIO_H__
+#define __BITIO_H__
+
+#include "endian.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+//
+// 64-bit bit accumulator shared by every pair reader and writer.
+//
+// Fields are packed LSB first: the first bit of a field is the least significant bit of the next
+// free position, and bytes fill from their least significant bit. Writers store the accumulator 32
+// bits at a time into a byte buffer; readers load it 32 bits at a time while the buffer allows.
+// The caller owns the byte buffer and its position, so the same routines serve file-backed
+// buffers that get flushed or refilled, and plain memory.
+//
+typedef struct BitAccumulator {
+    uint64_t acc;
+    uint32_t bits;
+} BitAccumulator;
+
+//
+// Adds the low bitlen (at most 32) bits of value. Stores a 32-bit word at buf + *pos and advances
+// *pos by 4 once 32 bits are held, so the caller must leave 4 bytes of room at *pos.
+//
+static inline void bits_put(BitAccumulator *a, uint8_t *buf, uint32_t *pos, uint32_t value, int bitlen) {
+    a->acc |= (uint64_t) value << a->bits;
+    a->bits += bitlen;
+    if (a->bits >= 32) {
+        uint32_t word = (uint32_t) a->acc;
+        if (big_endian()) {
+            word = swap32(word);
+        }
+        memcpy(buf + *pos, &word, sizeof(uint32_t));
+        *pos += 4;
+        a->acc >>= 32;
+        a->bits -= 32;
+    }
+}
+
+//
+// Stores every whole byte still held at buf + *pos. Fewer than 8 bits may remain afterwards.
+//
+static inline void bits_drain(BitAccumulator *a, uint8_t *buf, uint32_t *pos) {
+    while (a->bits >= 8) {
+        buf[(*pos)++] = (uint8_t) a->acc;
+        a->acc >>= 8;
+        a->bits -= 8;
+    }
+}
+
+//
+// Stores every bit still held at buf + *pos, padding the last byte with zero bits.
+//
+static inline void bits_flush(BitAccumulator *a, uint8_t *buf, uint32_t *pos) {
+    bits_drain(a, buf, pos);
+    if (a->bits > 0) {
+        buf[(*pos)++] = (uint8_t) a->acc;
+        a->acc = 0;
+        a->bits = 0;
+    }
+}
+
+//
+// Loads bytes from buf[*pos .. len) until at least 32 bits are held or the buffer runs out.
+//
+static inline void bits_refill(BitAccumulator *a, const uint8_t *buf, uint32_t *pos, uint32_t len) {
+    if (a->bits <= 32 && *pos + 4 <= len) {
+        uint32_t word;
+        memcpy(&word, buf + *pos, sizeof(uint32_t));
+        if (big_endian()) {
+            word = swap32(word);
+        }
+        a->acc |= (uint64_t) word << a->bits;
+        a->bits += 32;
+        *pos += 4;
+        return;
+    }
+    while (a->bits <= 56 && *pos < len) {
+        a->acc |= (uint64_t) buf[(*pos)++] << a->bits;
+        a->bits += 8;
+    }
+}
+
+//
+// Marks the input as exhausted: every further bit reads as zero. At least 56 bits are then held,
+// and bits stays a multiple of 8 away from the real bits' byte boundary.
+//
+static inline void bits_pad(BitAccumulator *a) {
+    a->bits = 56 + a->bits % 8;
+}
+
+//
+// Removes and returns the next bitlen bits. The caller must have refilled enough bits.
+//
+static inline uint32_t bits_take(BitAccumulator *a, int bitlen) {
+    uint32_t value = (uint32_t) (a->acc & ((UINT64_C(1) << bitlen) - 1));
+    a->acc >>= bitlen;
+    a->bits -= bitlen;
+    return value;
+}
+
+//
+// Truncated binary (phased-in) code of value, one of the n >= 1 values below n: with
+// k = floor(log2(n)), the first 2^(k+1) - n values take k bits and the rest k + 1 bits. The k low
+// bits come first, so the reader knows from them whether the extra bit follows.
+// Adds the code through bits_put() and returns its length.
+//
+static inline int bits_put_phased(BitAccumulator *a, uint8_t *buf, uint32_t *pos, uint32_t value, uint32_t n) {
+    int k = 31 - __builtin_clz(n);
+    uint32_t short_codes = (uint32_t) (UINT64_C(2) << k) - n;
+    if (value < short_codes) {
+        bits_put(a, buf, pos, value, k);
+        return k;
+    }
+    value += short_codes;
+    bits_put(a, buf, pos, (value >> 1) | (value & 1) << k, k + 1);
+    return k + 1;
+}
+
+//
+// Removes and returns a value coded by bits_put_phased(). The caller must have refilled
+// floor(log2(n)) + 1 bits.
+//
+static inline uint32_t bits_take_phased(BitAccumulator *a, uint32_t n) {
+    int k = 31 - __builtin_clz(n);
+    uint32_t short_codes = (uint32_t) (UINT64_C(2) << k) - n;
+    uint32_t value = bits_take(a, k);
+    if (value < short_codes) {
+        return value;
+    }
+    return ((value << 1) | bits_take(a, 1)) - short_codes;
+}
+
+#endif
@@ -0,0 +1,276 @@
+#!/bin/sh
+#
+# Round trips generated corpora through encode and decode with each format option and I/O backend,
+# checks search, --estimate, --stats=json and --trace against what they describe, runs libcheck on
+# the library's calls, checks that files written by earlier versions (in testdata/) still decode,
+# and that decode -t rejects truncated and corrupted files. Run from the build directory by make
+# check; prints each failure and exits 1 if there was any, keeping its files for a look.
+#
+
+dir=$(mktemp -d "${TMPDIR:-/tmp}/lz78check.XXXXXX") || exit 1
+failures=0
+checks=0
+
+fail() {
+    echo "FAIL: $*" >&2
+    failures=$((failures + 1))
+}
+
+# The lines that the files in testdata/ were made from.
+lines() {
+    seq 1 40000 | sed 's/$/ the quick brown fox jumps over the lazy dog/' | head -c 200000
+}
+
+# Words drawn with a 32-bit LCG, so every awk makes the same text.
+words() {
+    awk 'BEGIN {
+        n = split("the of and to a in is that for it as was with be by on not this are or from at " \
+                  "compression dictionary algorithm symbol message sequence encoder decoder stream", w, " ")
+        x = 1
+        for (i = 0; i < 60000; i++) {
+            x = (x * 69069 + 1) % 4294967296
+            printf "%s%s", w[int(x / 65536) % n + 1], (x % 13 == 0) ? "\n" : " "
+        }
+    }'
+}
+
+# Writes the corpora: empty, a byte, lines, words, near random bytes (words coded by encode -l 2),
+# zeros, and a mix of them that makes stored, run-length and LZ78 chunks.
+: >"$dir/empty"
+printf 'a' >"$dir/byte"
+lines >"$dir/lines"
+words >"$dir/words"
+./encode -l 2 -i "$dir/words" -o "$dir/random" || fail "encode -l 2 words"
+head -c 300000 /dev/zero >"$dir/zeros"
+cat "$dir/random" "$dir/zeros" "$dir/words" "$dir/random" >"$dir/mixed"
+corpora="empty byte lines words random zeros mixed"
+
+./train -i "$dir/words" -o "$dir/dict" || fail "train"
+./train --lzw -b 12 -i "$dir/words" -o "$dir/lzw.dict" || fail "train --lzw"
+
+#
+# Encodes input with the encode options, checks the result with decode -t, and decodes it with
+# the decode options, which must give the input back.
+#
+roundtrip() {
+    input=$1
+    encode_options=$2
+    decode_options=$3
+    checks=$((checks + 1))
+    rm -f "$dir/packed" "$dir/unpacked"
+    if ! ./encode $encode_options -i "$dir/$input" -o "$dir/packed"; then
+        fail "$input: encode $encode_options"
+    elif ! ./decode -t $decode_options -i "$dir/packed"; then
+        fail "$input: encode $encode_options, decode -t $decode_options"
+    elif ! ./decode $decode_options -i "$dir/packed" -o "$dir/unpacked" || ! cmp -s "$dir/$input" "$dir/unpacked"; then
+        fail "$input: encode $encode_options, decode $decode_options"
+    fi
+}
+
+for corpus in $corpora; do
+    roundtrip "$corpus" "" ""
+    for level in 0 1 2; do
+        roundtrip "$corpus" "-l $level" ""
+        roundtrip "$corpus" "--lzw -l $level" ""
+    done
+    for bits in 9 12 24; do
+        roundtrip "$corpus" "-b $bits" ""
+        roundtrip "$corpus" "--lzw -b $bits" ""
+    done
+    for reset in fixed adaptive never; do
+        roundtrip "$corpus" "-b 9 --reset=$reset" ""
+    done
+    roundtrip "$corpus" "--crc" ""
+    roundtrip "$corpus" "--crc -l 2" ""
+    roundtrip "$corpus" "--index" ""
+    roundtrip "$corpus" "--index=64K --crc" ""
+    roundtrip "$corpus" "-D $dir/dict" "-D $dir/dict"
+    roundtrip "$corpus" "-D $dir/lzw.dict --lzw -b 12" "-D $dir/lzw.dict"
+    roundtrip "$corpus" "--flush-lines" ""
+    roundtrip "$corpus" "-j 1" ""
+    roundtrip "$corpus" "-j 4 -c 64K" "-j 4"
+    roundtrip "$corpus" "-j 3 -c 64K --crc -l 1" "-j 2"
+    roundtrip "$corpus" "-j 2 -c 64K -b 9 --lzw" ""
+    roundtrip "$corpus" "-j 2 -c 64K -D $dir/dict" "-j 2 -D $dir/dict"
+    roundtrip "$corpus" "-m 1M" "-m 1M"
+    roundtrip "$corpus" "-j 2 -m 4M" "-j 2 -m 4M"
+done
+
+# Chunked output is the same for any thread count.
+for threads in 1 2 4; do
+    ./encode -j "$threads" -c 64K -i "$dir/mixed" -o "$dir/chunked.$threads" || fail "mixed: encode -j $threads"
+done
+cmp -s "$dir/chunked.1" "$dir/chunked.2" && cmp -s "$dir/chunked.1" "$dir/chunked.4" \
+    || fail "mixed: encode -j 1, 2 and 4 differ"
+
+# --range decodes the slice of an indexed file, whatever the slice.
+./encode --index=64K --crc -i "$dir/mixed" -o "$dir/indexed" || fail "mixed: encode --index=64K"
+size=$(wc -c <"$dir/mixed")
+for range in 0:1 0:100000 70000:5000 300000:400000 $((size - 10)):10 $((size - 10)):100 $size:1; do
+    checks=$((checks + 1))
+    start=${range%:*}
+    len=${range#*:}
+    tail -c +$((start + 1)) "$dir/mixed" | head -c "$len" >"$dir/slice"
+    ./decode --range="$range" -i "$dir/indexed" -o "$dir/unpacked" && cmp -s "$dir/slice" "$dir/unpacked" \
+        || fail "mixed: decode --range=$range"
+done
+
+# Pieces given to --append decode as one stream, and a stream started with -m keeps to it.
+for options in "" "--crc -l 2" "-D $dir/dict" "-m 1M"; do
+    checks=$((checks + 1))
+    rm -f "$dir/appended" "$dir/whole"
+    for corpus in lines empty words random; do
+        ./encode --append $options -i "$dir/$corpus" -o "$dir/appended" || fail "encode --append $options"
+        cat "$dir/$corpus" >>"$dir/whole"
+    done
+    decode_options=$(echo "$options" | sed 's/--crc -l 2//')
+    ./decode $decode_options -i "$dir/appended" -o "$dir/unpacked" && cmp -s "$dir/whole" "$dir/unpacked" \
+        || fail "encode --append $options"
+done
+checks=$((checks + 1))
+./encode --append -b 20 -i "$dir/lines" -o "$dir/wide" || fail "encode --append -b 20"
+./encode --append -m 64K -i "$dir/lines" -o "$dir/wide" 2>/dev/null && fail "encode --append -m 64K on -b 20"
+
+# Archives extract whole and a member at a time.
+mkdir -p "$dir/tree/sub/deeper" "$dir/out"
+for corpus in $corpora; do
+    cp "$dir/$corpus" "$dir/tree/$corpus"
+done
+cp "$dir/mixed" "$dir/tree/sub/deeper/mixed"
+for options in "" "-j 2 -c 64K" "-j 3 -c 64K --crc -l 2"; do
+    checks=$((checks + 1))
+    rm -rf "$dir/out" "$dir/archive"
+    mkdir "$dir/out"
+    (cd "$dir" && "$OLDPWD/encode" --archive $options -o archive tree) || fail "encode --archive $options"
+    ./decode -t -i "$dir/archive" || fail "encode --archive $options, decode -t"
+    ./decode -j 2 -i "$dir/archive" -C "$dir/out" && diff -r "$dir/tree" "$dir/out/tree" >/dev/null \
+        || fail "encode --archive $options, decode -C"
+    ./decode --member=tree/sub/deeper/mixed -i "$dir/archive" -o "$dir/unpacked" \
+        && cmp -s "$dir/mixed" "$dir/unpacked" || fail "encode --archive $options, decode --member"
+done
+
+# Every I/O backend round trips, through the page cache or around it, chunked or not.
+for io in auto sync mmap uring thread; do
+    for direct in "" "--direct"; do
+        roundtrip mixed "--io=$io $direct" "--io=$io $direct"
+        roundtrip mixed "-j 2 -c 64K --io=$io $direct" "-j 2 --io=$io $direct"
+        roundtrip lines "--flush-lines --io=$io $direct" "--io=$io $direct"
+    done
+done
+
+# search finds what grep finds: the offset of each match, the lines with one, and their counts,
+# exiting with 1 when there are none. The patterns cannot overlap themselves, as grep's matches
+# cannot.
+for options in "" "-l 1" "-l 2" "--lzw" "--lzw -l 2" "-b 9" "--crc --index" "--append" "-D $dir/dict"; do
+    for corpus in lines words mixed; do
+        rm -f "$dir/packed"
+        ./encode $options -i "$dir/$corpus" -o "$dir/packed" || fail "$corpus: encode $options"
+        search_options=$(echo "$options" | grep -o -- "-D .*")
+        for pattern in "fox jumps" "the " "dictionary a" "9 t" "zzzz"; do
+            checks=$((checks + 1))
+            grep -boaF "$pattern" "$dir/$corpus" | cut -d: -f1 >"$dir/offsets"
+            grep -naF "$pattern" "$dir/$corpus" | cut -d: -f1 >"$dir/numbers"
+            ./search $search_options -i "$dir/packed" "$pattern" >"$dir/found"
+            status=$?
+            [ -s "$dir/offsets" ] && expected=0 || expected=1
+            if [ "$status" -ne "$expected" ] || ! cmp -s "$dir/offsets" "$dir/found"; then
+                fail "$corpus: encode $options, search '$pattern'"
+            fi
+            count=$(./search $search_options --count -i "$dir/packed" "$pattern")
+            [ "$count" -eq "$(wc -l <"$dir/offsets")" ] \
+                || fail "$corpus: encode $options, search --count '$pattern'"
+            ./search $search_options --lines -i "$dir/packed" "$pattern" | cmp -s - "$dir/numbers" \
+                || fail "$corpus: encode $options, search --lines '$pattern'"
+            count=$(./search $search_options --lines --count -i "$dir/packed" "$pattern")
+            [ "$count" -eq "$(wc -l <"$dir/numbers")" ] \
+                || fail "$corpus: encode $options, search --lines --count '$pattern'"
+        done
+    done
+done
+
+# --estimate prints the size encode writes.
+for corpus in $corpora; do
+    for options in "" "-l 2" "--lzw -b 9" "--crc --index=64K" "--reset=adaptive -l 1" "-D $dir/dict"; do
+        checks=$((checks + 1))
+        ./encode $options -i "$dir/$corpus" -o "$dir/packed" || fail "$corpus: encode $options"
+        [ "$(./encode --estimate $options -i "$dir/$corpus")" -eq "$(wc -c <"$dir/packed")" ] \
+            || fail "$corpus: encode --estimate $options"
+    done
+done
+
+# --stats=json prints one JSON object, and --trace writes a JSON trace, for each tool and format.
+if command -v python3 >/dev/null; then
+    for options in "" "-j 2 -c 64K" "-l 2 --crc"; do
+        checks=$((checks + 1))
+        ./encode $options --stats=json --trace="$dir/encode.trace" -i "$dir/mixed" -o "$dir/packed" \
+            2>"$dir/encode.json" || fail "encode $options --stats=json --trace"
+        ./decode --stats=json --trace="$dir/decode.trace" -i "$dir/packed" -o "$dir/unpacked" \
+            2>"$dir/decode.json" || fail "encode $options, decode --stats=json --trace"
+        for json in encode.json encode.trace decode.json decode.trace; do
+            python3 -m json.tool "$dir/$json" >/dev/null || fail "encode $options: $json is not JSON"
+        done
+    done
+    checks=$((checks + 1))
+    ./encode -i "$dir/lines" -o "$dir/packed"
+    ./search --stats=json -i "$dir/packed" fox >/dev/null 2>"$dir/search.json"
+    python3 -m json.tool "$dir/search.json" >/dev/null || fail "search --stats=json is not JSON"
+else
+    echo "python3 not found: --stats=json and --trace not checked" >&2
+fi
+
+# The library's one-shot, streaming, range, dictionary and search calls.
+checks=$((checks + 1))
+./libcheck "$dir/empty" "$dir/byte" "$dir/lines" "$dir/words" "$dir/random" "$dir/mixed" || fail "libcheck"
+
+# Files from earlier versions: the original single stream, and the chunked format and archive from
+# before chunks could be stored or run-length coded.
+lines >"$dir/fixture"
+printf 'hello\n' >"$dir/small"
+for fixture in baseline chunked; do
+    checks=$((checks + 1))
+    ./decode -t -i "testdata/$fixture.lz78" || fail "decode -t testdata/$fixture.lz78"
+    ./decode -j 2 -i "testdata/$fixture.lz78" -o "$dir/unpacked" && cmp -s "$dir/fixture" "$dir/unpacked" \
+        || fail "decode testdata/$fixture.lz78"
+done
+checks=$((checks + 1))
+rm -rf "$dir/out" && mkdir "$dir/out"
+./decode -t -i testdata/archive.lz78 || fail "decode -t testdata/archive.lz78"
+./decode -i testdata/archive.lz78 -C "$dir/out" && cmp -s "$dir/fixture" "$dir/out/seq.txt" \
+    && cmp -s "$dir/small" "$dir/out/small" || fail "decode testdata/archive.lz78"
+
+#
+# Writes file with its byte at offset changed.
+#
+corrupt() {
+    byte=$(od -An -tu1 -j "$2" -N1 "$1" | tr -d ' ')
+    printf "\\$(printf %o $(((byte + 1) % 256)))" | dd of="$1" bs=1 seek="$2" conv=notrunc 2>/dev/null
+}
+
+# decode -t fails on a file cut short, and with a CRC, on a file with a byte changed.
+for options in "" "-l 2" "--lzw" "--index" "--append" "-j 2 -c 64K" "--crc" "--crc -l 1" "--crc --index" \
+    "-j 2 -c 64K --crc" "--archive"; do
+    checks=$((checks + 1))
+    rm -f "$dir/packed"
+    if [ "$options" = "--archive" ]; then
+        (cd "$dir" && "$OLDPWD/encode" --archive -o packed tree)
+    else
+        ./encode $options -i "$dir/mixed" -o "$dir/packed"
+    fi
+    size=$(wc -c <"$dir/packed")
+    head -c $((size / 4)) "$dir/packed" >"$dir/damaged"
+    ./decode -t -i "$dir/damaged" 2>/dev/null && fail "decode -t of a truncated encode $options"
+    case "$options" in
+    *--crc*)
+        cp "$dir/packed" "$dir/damaged"
+        corrupt "$dir/damaged" $((size / 2))
+        ./decode -t -i "$dir/damaged" 2>/dev/null && fail "decode -t of a corrupted encode $options"
+        ;;
+    esac
+done
+
+if [ "$failures" -ne 0 ]; then
+    echo "$failures of $checks checks failed; their files are in $dir" >&2
+    exit 1
+fi
+rm -rf "$dir"
+echo "All $checks checks passed"
@@ -0,0 +1,441 @@
+#include "chunk.h"
+#include "crc32c.h"
+#include "helpers.h"
+#include "io.h"
+#include "lz78.h"
+#include "rle.h"
+#include "trace.h"
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SAMPLE_SIZE (1 << 14) // Bytes of an evenly spread chunk that LZ78 is tried on before it is stored.
+
+//One chunk table's worth of work, shared by the threads coding it.
+//Threads claim chunks through next until all count chunks are taken.
+typedef struct Batch {
+    uint32_t count;
+    const uint8_t *in[CHUNK_BATCH];
+    uint32_t in_len[CHUNK_BATCH];
+    uint8_t *out[CHUNK_BATCH];
+    uint32_t out_len[CHUNK_BATCH];
+    bool encoding;
+    uint32_t chunk_size; // Encoding: the largest chunk, for each thread's scratch buffer.
+    bool blocks; // Decoding: the payloads are blocks (CHUNK_BLOCKS).
+    LZ78Params params; // Raw stream parameters of every chunk.
+    atomic_uint next;
+    atomic_bool failed;
+} Batch;
+
+/*
+    Upper bound on the encoded size of a len byte chunk.
+*/
+uint64_t chunk_bound(uint32_t len, bool blocks, const LZ78Params *params) {
+    if (blocks) {
+        return 1 + (uint64_t) len + 4;
+    }
+    LZ78Params raw = *params;
+    raw.raw = true;
+    return lz78_compress_bound(len, &raw);
+}
+
+/*
+    Little-endian uint32_t helpers for the container fields.
+*/
+static void put_u32(uint8_t *buf, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (uint8_t) (value >> (BYTE * i));
+    }
+}
+
+static uint32_t get_u32(const uint8_t *buf) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= (uint32_t) buf[i] << (BYTE * i);
+    }
+    return value;
+}
+
+/*
+    Whether LZ78 would only expand the chunk. Its bytes must be spread as evenly as those of
+    compressed or encrypted data, with a collision entropy (-log2 of the sum of each byte's
+    frequency squared) of at least 7 bits, at which LZ78 expands even independent random bytes at
+    every level. A sample must expand too, which keeps data such as counters, whose bytes are even
+    but repeat, from being stored.
+*/
+static bool incompressible(const uint8_t *in, uint32_t len, const LZ78Params *params) {
+    uint64_t counts[256] = { 0 };
+    for (uint32_t i = 0; i < len; i++) {
+        counts[in[i]]++;
+    }
+    uint64_t collisions = 0;
+    for (int i = 0; i < 256; i++) {
+        collisions += counts[i] * counts[i];
+    }
+    if (collisions > (uint64_t) len * len / 128) {
+        return false;
+    }
+    uint8_t sample[SAMPLE_SIZE];
+    size_t sample_len = len < SAMPLE_SIZE ? len : SAMPLE_SIZE;
+    return lz78_compress(sample, &sample_len, in, sample_len, params) == LZ78_BUF_ERROR;
+}
+
+/*
+    Fewest pairs LZ78 codes len bytes in: each phrase is at most a byte longer than the one before
+    it (preset dictionaries aside), so the first n pairs cover at most n (n + 1) / 2 bytes.
+*/
+static uint64_t least_pairs(uint32_t len) {
+    uint64_t pairs = 0;
+    while (pairs * (pairs + 1) / 2 < len) {
+        pairs++;
+    }
+    return pairs;
+}
+
+/*
+    Compresses one chunk from memory into memory as the smallest of the three blocks: the chunk
+    stored, run-length coded, or a raw liblz78 stream with its own dictionary. Each is coded only
+    while it is smaller than the best so far. LZ78, the slowest, is not tried on a chunk that looks
+    incompressible, which is copied at memory speed, or on runs coded in fewer bytes than it would
+    take at a bit per pair.
+*/
+uint32_t encode_chunk(const uint8_t *in, uint32_t len, uint8_t *out, uint8_t *scratch, const LZ78Params *params) {
+    uint8_t *block = out + 1;
+    uint32_t check = params->checksum ? 4 : 0;
+    size_t best = len;
+    out[0] = BLOCK_STORED;
+
+    size_t rle_len = len > 0 ? rle_encode(in, len, block, len - 1) : 0;
+    if (rle_len > 0) {
+        out[0] = BLOCK_RLE;
+        best = rle_len;
+    }
+    bool lz78 = out[0] == BLOCK_RLE ? best * BYTE > least_pairs(len) : !incompressible(in, len, params);
+    if (best + check > 0 && lz78) {
+        //A pair stream carries its own CRC, so it must beat the others with theirs.
+        size_t stream_len = best + check - 1;
+        int response = lz78_compress(scratch, &stream_len, in, len, params);
+        if (response == LZ78_OK) {
+            out[0] = BLOCK_LZ78;
+            memcpy(block, scratch, stream_len);
+            return (uint32_t) (1 + stream_len);
+        }
+        if (response != LZ78_BUF_ERROR) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+
+    if (out[0] == BLOCK_STORED) {
+        memcpy(block, in, len);
+    }
+    if (params->checksum) {
+        put_u32(block + best, crc32c(0, in, len));
+    }
+    return (uint32_t) (1 + best + check);
+}
+
+/*
+    Decodes a stored or run-length block, checking its CRC with params->checksum (against the
+    output, which is decoded into a buffer of its own for that without out).
+*/
+static bool decode_block(
+    uint8_t type, const uint8_t *in, uint32_t len, uint8_t *out, uint32_t out_len, const LZ78Params *params) {
+    uint32_t check = params->checksum ? 4 : 0;
+    if (len < check) {
+        return false;
+    }
+    len -= check;
+
+    bool valid = false;
+    uint8_t *scratch = NULL;
+    const uint8_t *data = out;
+    if (type == BLOCK_STORED) {
+        valid = len == out_len;
+        if (valid && out != NULL) {
+            memcpy(out, in, len);
+        }
+        data = in;
+    } else if (type == BLOCK_RLE) {
+        if (out == NULL && check > 0) {
+            scratch = (uint8_t *) malloc(out_len);
+            if (scratch == NULL) {
+                fprintf(stderr, "Out of memory\n");
+                exit(1);
+            }
+            out = scratch;
+            data = scratch;
+        }
+        valid = rle_decode(in, len, out, out_len);
+    }
+    valid = valid && (check == 0 || get_u32(in + len) == crc32c(0, data, out_len));
+    free(scratch);
+    return valid;
+}
+
+/*
+    Decompresses one chunk from memory into memory, dispatching on the block type if it has one.
+    The output must come to exactly out_len bytes.
+*/
+bool decode_chunk(
+    const uint8_t *in, uint32_t len, uint8_t *out, uint32_t out_len, bool blocks, const LZ78Params *params) {
+    if (blocks) {
+        if (len == 0) {
+            return false;
+        }
+        if (in[0] != BLOCK_LZ78) {
+            return decode_block(in[0], in + 1, len - 1, out, out_len, params);
+        }
+        in++;
+        len--;
+    }
+    size_t written = out_len;
+    return lz78_decompress(out, &written, in, len, params) == LZ78_OK && written == out_len;
+}
+
+/*
+    Thread body: codes chunks of the batch until none are left. Each chunk is a span of the trace.
+    An encoding thread tries LZ78 in a scratch buffer of its own.
+*/
+static void *batch_worker(void *arg) {
+    Batch *batch = (Batch *) arg;
+    uint8_t *scratch = NULL;
+    if (batch->encoding) {
+        scratch = (uint8_t *) malloc(chunk_bound(batch->chunk_size, true, NULL));
+        if (scratch == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(1);
+        }
+    }
+    uint32_t i;
+    while ((i = atomic_fetch_add(&batch->next, 1)) < batch->count) {
+        trace_mark();
+        uint64_t start = trace_now();
+        if (batch->encoding) {
+            batch->out_len[i]
+                = encode_chunk(batch->in[i], batch->in_len[i], batch->out[i], scratch, &batch->params);
+        } else if (!decode_chunk(batch->in[i], batch->in_len[i], batch->out[i], batch->out_len[i],
+                       batch->blocks, &batch->params)) {
+            atomic_store(&batch->failed, true);
+        }
+        trace_span(batch->encoding ? "encode chunk" : "decode chunk", start, trace_now(), "bytes",
+            batch->encoding ? batch->in_len[i] : batch->out_len[i]);
+    }
+    free(scratch);
+    return NULL;
+}
+
+/*
+    Codes every chunk of the batch on up to threads threads, the calling thread included.
+    Returns false if any chunk failed to decode.
+*/
+static bool run_batch(Batch *batch, uint32_t threads) {
+    pthread_t workers[CHUNK_BATCH];
+    uint32_t spawned = 0;
+
+    atomic_store(&batch->next, 0);
+    atomic_store(&batch->failed, false);
+    if (threads > batch->count) {
+        threads = batch->count;
+    }
+    for (uint32_t i = 1; i < threads; i++) {
+        if (pthread_create(&workers[spawned], NULL, batch_worker, batch) == 0) {
+            spawned++;
+        }
+    }
+    batch_worker(batch);
+    for (uint32_t i = 0; i < spawned; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    return !atomic_load(&batch->failed);
+}
+
+/*
+    Writes buf to the output, counting it towards total_bits.
+*/
+static void write_counted(Writer *writer, const uint8_t *buf, uint32_t len) {
+    writer_write(writer, buf, len);
+    total_bits += (uint64_t) len * BYTE;
+}
+
+/*
+    Reads exactly len bytes of input into buf, counting them towards total_syms.
+    Returns false on a short read.
+*/
+static bool read_counted(Reader *reader, uint8_t *buf, uint32_t len) {
+    size_t response = reader_read(reader, buf, len);
+    total_syms += response;
+    return response == len;
+}
+
+/*
+    Reads the input batch chunks at a time, encodes each batch in parallel and writes its chunk
+    table and payloads in order. The whole input's CRC is taken as each chunk is read.
+*/
+void encode_chunked(Reader *reader, Writer *writer, uint32_t chunk_size, uint32_t batch_size, uint32_t threads,
+    const LZ78Params *params) {
+    uint8_t field[4];
+    uint8_t table[4 + CHUNK_BATCH * 8];
+    uint8_t *input = (uint8_t *) malloc((size_t) batch_size * chunk_size);
+    Batch *batch = (Batch *) calloc(1, sizeof(Batch));
+    if (input == NULL || batch == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    batch->encoding = true;
+    batch->chunk_size = chunk_size;
+    batch->params = *params;
+    batch->params.raw = true;
+
+    put_u32(field, chunk_size | CHUNK_BLOCKS);
+    write_counted(writer, field, sizeof(field));
+
+    uint32_t crc = 0;
+    bool eof = false;
+    while (!eof) {
+        batch->count = 0;
+        while (batch->count < batch_size && !eof) {
+            uint8_t *chunk = input + (size_t) batch->count * chunk_size;
+            size_t response = reader_read(reader, chunk, chunk_size);
+            total_syms += response;
+            eof = response < chunk_size;
+            if (response == 0) {
+                break;
+            }
+            if (params->checksum) {
+                crc = crc32c(crc, chunk, response);
+            }
+            if (batch->out[batch->count] == NULL) {
+                batch->out[batch->count] = (uint8_t *) malloc(chunk_bound(chunk_size, true, NULL));
+                if (batch->out[batch->count] == NULL) {
+                    fprintf(stderr, "Out of memory\n");
+                    exit(1);
+                }
+            }
+            batch->in[batch->count] = chunk;
+            batch->in_len[batch->count] = (uint32_t) response;
+            batch->count++;
+        }
+        if (batch->count == 0) {
+            break;
+        }
+
+        run_batch(batch, threads);
+
+        put_u32(table, batch->count);
+        for (uint32_t i = 0; i < batch->count; i++) {
+            put_u32(table + 4 + 8 * i, batch->out_len[i]);
+            put_u32(table + 8 + 8 * i, batch->in_len[i]);
+        }
+        write_counted(writer, table, 4 + 8 * batch->count);
+        for (uint32_t i = 0; i < batch->count; i++) {
+            write_counted(writer, batch->out[i], batch->out_len[i]);
+        }
+    }
+    put_u32(field, 0);
+    write_counted(writer, field, sizeof(field));
+    if (params->checksum) {
+        put_u32(field, crc);
+        write_counted(writer, field, sizeof(field));
+    }
+
+    for (uint32_t i = 0; i < CHUNK_BATCH; i++) {
+        free(batch->out[i]);
+    }
+    free(batch);
+    free(input);
+}
+
+/*
+    Reads each chunk table and its payloads, decodes the chunks in parallel and writes their
+    output in order, unless params->discard is set. The whole output's CRC is checked after the
+    last table. The buffers grow to hold the largest table so far, within memory.
+*/
+bool decode_chunked(Reader *reader, Writer *writer, uint32_t threads, const Options *options,
+    const LZ78Params *params) {
+    uint8_t field[4];
+    uint8_t table[CHUNK_BATCH * 8];
+    uint8_t *input = NULL;
+    uint8_t *output = NULL;
+    uint32_t room = 0; // Chunks the buffers hold.
+    uint32_t crc = 0;
+    Batch *batch = (Batch *) calloc(1, sizeof(Batch));
+    bool valid = batch != NULL && read_counted(reader, field, sizeof(field));
+    uint32_t chunk_size = valid ? get_u32(field) & ~CHUNK_BLOCKS : 0;
+    valid = valid && chunk_size != 0;
+    if (batch != NULL) {
+        batch->blocks = valid && (get_u32(field) & CHUNK_BLOCKS);
+        batch->params = *params;
+        batch->params.raw = true;
+        //The file's CRC needs the output: only without one can the chunks discard it.
+        batch->params.discard = params->discard && !params->checksum;
+    }
+
+    uint64_t bound = valid ? chunk_bound(chunk_size, batch->blocks, params) : 0;
+
+    while (valid) {
+        if (!read_counted(reader, field, sizeof(field))) {
+            valid = false;
+            break;
+        }
+        batch->count = get_u32(field);
+        if (batch->count == 0) {
+            valid = !params->checksum || (read_counted(reader, field, sizeof(field)) && get_u32(field) == crc);
+            break;
+        }
+        if (batch->count > CHUNK_BATCH || !read_counted(reader, table, 8 * batch->count)) {
+            valid = false;
+            break;
+        }
+        if (batch->count > room) {
+            uint64_t needed = batch->count * (chunk_size + bound);
+            if (options->chunk_memory != 0 && needed > options->chunk_memory) {
+                fprintf(stderr, "Memory budget too small: %" PRIu64 " bytes needed\n",
+                    memory_needed(options, params, false, true, needed));
+                exit(1);
+            }
+            free(input);
+            free(output);
+            input = (uint8_t *) malloc(batch->count * bound);
+            output = (uint8_t *) malloc((size_t) batch->count * chunk_size);
+            room = batch->count;
+            if (input == NULL || output == NULL) {
+                valid = false;
+                break;
+            }
+        }
+
+        uint8_t *payload = input;
+        for (uint32_t i = 0; i < batch->count && valid; i++) {
+            batch->in_len[i] = get_u32(table + 8 * i);
+            batch->out_len[i] = get_u32(table + 4 + 8 * i);
+            valid = batch->in_len[i] <= bound && batch->out_len[i] <= chunk_size
+                    && read_counted(reader, payload, batch->in_len[i]);
+            batch->in[i] = payload;
+            batch->out[i] = output + (size_t) i * chunk_size;
+            payload += batch->in_len[i];
+        }
+
+        valid = valid && run_batch(batch, threads);
+
+        for (uint32_t i = 0; i < batch->count && valid; i++) {
+            if (params->checksum) {
+                crc = crc32c(crc, batch->out[i], batch->out_len[i]);
+            }
+            if (params->discard) {
+                total_bits += (uint64_t) batch->out_len[i] * BYTE;
+            } else {
+                write_counted(writer, batch->out[i], batch->out_len[i]);
+            }
+        }
+    }
+
+    free(output);
+    free(input);
+    free(batch);
+    return valid;
+}
@@ -0,0 +1,83 @@
+#ifndef __CHUNK_H__
+#define __CHUNK_H__
+
+#include "helpers.h"
+#include "io.h"
+#include "lz78.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define CHUNK_SIZE  (1 << 20) // Default uncompressed bytes per chunk.
+#define MIN_CHUNK   (1 << 16) // Smallest chunk -m shrinks chunks to.
+#define CHUNK_BATCH 64 // Chunks described by one chunk table.
+#define CHUNK_BLOCKS 0x80000000u // Set in the chunk (or part) size of a file whose payloads are blocks.
+
+// Block types, the first byte of a block.
+#define BLOCK_LZ78   0 // A pair stream.
+#define BLOCK_STORED 1 // The chunk's bytes as they are.
+#define BLOCK_RLE    2 // The chunk's bytes run-length coded (see rle.h).
+
+//
+// Chunked container, used when FileHeader.flags has FLAG_CHUNKED set.
+//
+// After the FileHeader (and the dictionary ID, with FLAG_DICT) comes the uint32_t chunk size, then
+// a sequence of chunk tables, each followed by the payloads it describes:
+//
+// +-------+---------------------------------------------+-----------+-----+-----------+
+// | count | count x (compressed size, uncompressed size) | payload 0 | ... | payload n |
+// +-------+---------------------------------------------+-----------+-----+-----------+
+//
+// A table with count == 0 ends the file, followed with FLAG_CRC by the CRC32C of the whole input.
+// Every field is a little-endian uint32_t. Each payload is
+// an independent pair stream (its own dictionary, ending with STOP_CODE), so chunks can be coded
+// on separate threads. Only the last chunk may be shorter than the chunk size. Tables describe a
+// fixed CHUNK_BATCH chunks, which keeps the output identical for any thread count. Every chunk uses
+// the code width, reset policy, mode and dictionary recorded in the FileHeader; with FLAG_CRC each payload
+// carries the CRC32C of its own chunk, so a damaged chunk is reported when it is decoded.
+//
+// With CHUNK_BLOCKS set in the chunk size, each payload is a block: a block type, then the chunk
+// coded that way, and with FLAG_CRC a stored or run-length block ends with the chunk's CRC32C, as
+// a pair stream does. The encoder picks the smallest type, so incompressible chunks grow by only
+// a byte and are copied rather than coded. Files written before blocks have only pair streams.
+//
+
+//
+// Upper bound on the encoded size of a chunk of len bytes: a stored block, with its type and CRC,
+// or without blocks a raw pair stream with params (lz78_compress_bound()), which may be NULL with
+// blocks.
+//
+uint64_t chunk_bound(uint32_t len, bool blocks, const LZ78Params *params);
+
+//
+// Encodes len bytes from in into out as a block, its pair stream raw (params->raw must be set). out
+// and scratch, where LZ78 is tried, must each hold chunk_bound(len, true, NULL) bytes. Returns the
+// number of bytes written.
+//
+uint32_t encode_chunk(const uint8_t *in, uint32_t len, uint8_t *out, uint8_t *scratch, const LZ78Params *params);
+
+//
+// Decodes a len byte block (with blocks, or else raw stream) encoded with params from in into
+// exactly out_len bytes at out, or only checks it with params->discard and out NULL.
+// Returns false if it is malformed or does not decode to out_len bytes.
+//
+bool decode_chunk(
+    const uint8_t *in, uint32_t len, uint8_t *out, uint32_t out_len, bool blocks, const LZ78Params *params);
+
+//
+// Compresses the reader's input into a chunk container (after the FileHeader), batch chunks (at
+// most CHUNK_BATCH) to a table, coding the chunks of each table on up to threads threads.
+//
+void encode_chunked(Reader *reader, Writer *writer, uint32_t chunk_size, uint32_t batch, uint32_t threads,
+    const LZ78Params *params);
+
+//
+// Decompresses a chunk container (after the FileHeader) from the reader into the writer, decoding
+// the chunks of each table on up to threads threads, or only checks it with params->discard. The
+// buffers of a table may take at most options->chunk_memory bytes (if not 0), or the run exits,
+// reporting the -m it needs. Returns false if the container is malformed.
+//
+bool decode_chunked(Reader *reader, Writer *writer, uint32_t threads, const Options *options,
+    const LZ78Params *params);
+
+#endif
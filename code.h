@@ -6,6 +6,33 @@
 #define STOP_CODE  0
 #define EMPTY_CODE 1
 #define START_CODE 2
-#define MAX_CODE   UINT16_MAX
+
+#define RESET_SYM 1 // Symbol of a STOP_CODE pair that resets the dictionary instead of ending the stream.
+
+//Counts for LZ78Stats, compiled in only with LZ78_STATS.
+#ifdef LZ78_STATS
+#define STAT(statement) statement
+#else
+#define STAT(statement)
+#endif
+
+//LZW mode codes. The root phrase is never emitted there, so its code signals a reset, and the
+//codes after it are seeded with every single symbol.
+#define LZW_RESET_CODE EMPTY_CODE
+#define LZW_START_CODE (START_CODE + 256)
+
+/*
+    Largest code of a dictionary with codes up to bits wide. The dictionary resets when next_code reaches it.
+*/
+static inline uint32_t max_code(uint8_t bits) {
+    return ((uint32_t) 1 << bits) - 1;
+}
+
+/*
+    Gets bit length of code (1 for code 0)
+*/
+static inline uint8_t get_bitlength(uint32_t code) {
+    return (uint8_t) (32 - __builtin_clz(code | 1));
+}
 
 #endif
@@ -0,0 +1,98 @@
+#include "crc32c.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+#define POLY 0x82F63B78 // Reflected Castagnoli polynomial.
+
+typedef uint32_t crc_t(uint32_t crc, const uint8_t *buf, size_t len);
+
+//Slice-by-8 tables: table[k][b] is the CRC of byte b followed by k zero bytes.
+static uint32_t table[8][256];
+
+/*
+    Table driven CRC, 8 bytes per step. Bytes are combined explicitly, so the result does not
+    depend on the host's byte order.
+*/
+static uint32_t crc_slice8(uint32_t crc, const uint8_t *buf, size_t len) {
+    while (len >= 8) {
+        uint32_t low = crc ^ ((uint32_t) buf[0] | (uint32_t) buf[1] << 8 | (uint32_t) buf[2] << 16
+                                 | (uint32_t) buf[3] << 24);
+        uint32_t high = (uint32_t) buf[4] | (uint32_t) buf[5] << 8 | (uint32_t) buf[6] << 16
+                        | (uint32_t) buf[7] << 24;
+        crc = table[7][low & 0xFF] ^ table[6][(low >> 8) & 0xFF] ^ table[5][(low >> 16) & 0xFF]
+              ^ table[4][low >> 24] ^ table[3][high & 0xFF] ^ table[2][(high >> 8) & 0xFF]
+              ^ table[1][(high >> 16) & 0xFF] ^ table[0][high >> 24];
+        buf += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = table[0][(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+/*
+    The SSE4.2 crc32 instruction computes CRC32C, 8 bytes at a time.
+*/
+__attribute__((target("sse4.2"))) static uint32_t crc_sse42(uint32_t crc, const uint8_t *buf, size_t len) {
+    uint64_t wide = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, buf, sizeof(uint64_t));
+        wide = _mm_crc32_u64(wide, word);
+        buf += 8;
+        len -= 8;
+    }
+    crc = (uint32_t) wide;
+    while (len-- > 0) {
+        crc = _mm_crc32_u8(crc, *buf++);
+    }
+    return crc;
+}
+#endif
+
+static crc_t *crc_run = crc_slice8;
+
+/*
+    Fills the tables and picks the implementation before main() runs, so that crc32c() needs no
+    locking in threaded programs.
+*/
+__attribute__((constructor)) static void crc_init(void) {
+    for (uint32_t b = 0; b < 256; b++) {
+        uint32_t crc = b;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (POLY & (0 - (crc & 1)));
+        }
+        table[0][b] = crc;
+    }
+    for (uint32_t b = 0; b < 256; b++) {
+        for (int k = 1; k < 8; k++) {
+            table[k][b] = (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xFF];
+        }
+    }
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        crc_run = crc_sse42;
+    }
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const uint8_t *buf, size_t len) {
+    return ~crc_run(~crc, buf, len);
+}
+
+const char *crc32c_impl(void) {
+#if defined(__x86_64__)
+    if (crc_run == crc_sse42) {
+        return "sse4.2";
+    }
+#endif
+    return "slice8";
+}
@@ -0,0 +1,25 @@
+#ifndef __CRC32C_H__
+#define __CRC32C_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// CRC32C (Castagnoli, reflected polynomial 0x82F63B78), the checksum of FLAG_CRC streams.
+//
+// On x86-64 CPUs with SSE4.2 it runs on the crc32 instruction, and elsewhere on slice-by-8
+// tables; the choice is made once, when the program starts.
+//
+
+//
+// Returns the CRC32C of crc's data followed by len bytes of buf. Start with crc = 0, as with zlib's
+// crc32(): the result of one call is the crc of the next.
+//
+uint32_t crc32c(uint32_t crc, const uint8_t *buf, size_t len);
+
+//
+// Name of the implementation crc32c() runs on ("sse4.2" or "slice8").
+//
+const char *crc32c_impl(void);
+
+#endif
@@ -1,26 +1,28 @@
-#include "code.h"
+#include "archive.h"
+#include "chunk.h"
 #include "helpers.h"
-#include "endian.h"
 #include "io.h"
-#include "word.h"
+#include "lz78.h"
+#include "trace.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
-bool read_decode_header(int infile, int outfile);
-void decode(int infile, int outfile);
-void print_verbose(void);
+bool decode(Reader *reader, Writer *writer, const LZ78Params *params);
+bool verify(Reader *reader, const LZ78Params *params);
+bool decode_range(int infile, Writer *writer, const LZ78Params *params, uint64_t start, uint64_t len);
 void print_help(void);
 
+static size_t codec_peak; // Peak bytes of the single stream's dictionary and window, for -v and --stats.
+
 int main(int argc, char **argv) {
-    bool help = false;
-    bool verbose = false;
-    int input_file = 0;
-    int output_file = 1;
+    uint64_t started = trace_now();
+    Options options = { .input_file = 0, .output_file = 1, .chunk_size = CHUNK_SIZE, .batch = CHUNK_BATCH };
 
-    int response = argparser(argc, argv, &input_file, &output_file, &verbose, &help);
+    int response = argparser(argc, argv, &options);
 
     if (response == 4) {
         print_help();
@@ -28,73 +30,239 @@ int main(int argc, char **argv) {
     }
 
     if (response != 0) {
-        check_null_and_close(input_file);
-        check_null_and_close(output_file);
-        if (help) {
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        if (options.help) {
             print_help();
         }
         return -1;
     }
 
-    bool valid_header = read_decode_header(input_file, output_file);
+    if (options.test && (options.range || options.member != NULL)) {
+        fprintf(stderr, "-t checks whole files\n");
+        return 1;
+    }
+    FileHeader fileheader;
+    bool valid_header = read_decode_header(options.input_file, options.test ? -1 : options.output_file, &fileheader);
     if (!valid_header) {
         fprintf(stderr, "Bad Magic Number\n");
         return 1;
     }
-    decode(input_file, output_file);
+    LZ78Params params;
+    if (!lz78_header_params(&fileheader, &params)) {
+        fprintf(stderr, "Corrupt file\n");
+        return 1;
+    }
+    LZ78Dict *dict = NULL;
+    if (fileheader.flags & FLAG_DICT) {
+        dict = read_dict_id(options.input_file, options.dict_file);
+        params.dict = dict;
+    }
+    if (options.range && (!params.index || (fileheader.flags & (FLAG_CHUNKED | FLAG_ARCHIVE)))) {
+        fprintf(stderr, "File has no index\n");
+        return 1;
+    }
+    if ((options.member != NULL || options.dir != NULL) && !(fileheader.flags & FLAG_ARCHIVE)) {
+        fprintf(stderr, "File is not an archive\n");
+        return 1;
+    }
+    params.discard = options.test;
+    LZ78Stats stats = { 0 };
+    if (options.stats) {
+        params.stats = &stats;
+    }
+    if (options.trace_file != NULL) {
+        if (!trace_open(options.trace_file)) {
+            perror(options.trace_file);
+            return 1;
+        }
+        params.epoch = trace_epoch;
+    }
+    //A stream with sync points is read as it comes, to be decoded as it comes.
+    options.io.stream = params.sync;
+    bool parallel = (fileheader.flags & (FLAG_CHUNKED | FLAG_ARCHIVE)) != 0;
+    if (!fit_memory(&options, &params, false, parallel)) {
+        return 1;
+    }
+    Reader reader;
+    Writer writer;
+    if (!reader_open(&reader, options.input_file, &options.io)
+        || !writer_open(&writer, options.output_file, &options.io)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    bool valid;
+    uint32_t threads = options.threads > 0 ? options.threads : 1;
+    if (options.range) {
+        valid = decode_range(options.input_file, &writer, &params, options.range_start, options.range_len);
+    } else if (fileheader.flags & FLAG_ARCHIVE) {
+        const char *dir = options.dir != NULL ? options.dir : ".";
+        valid = decode_archive(
+            options.input_file, &writer, options.member, dir, threads, &options, &params);
+    } else if (fileheader.flags & FLAG_CHUNKED) {
+        valid = decode_chunked(&reader, &writer, threads, &options, &params);
+    } else if (options.test) {
+        valid = verify(&reader, &params);
+    } else {
+        valid = decode(&reader, &writer, &params);
+    }
+    writer_close(&writer);
+    reader_close(&reader);
+    lz78_dict_free(dict);
+    trace_close();
+    if (!valid) {
+        fprintf(stderr, "Corrupt file\n");
+        return 1;
+    }
 
-    if (verbose) {
-        print_verbose();
+    //Threads each take up to the bound at once; only a single stream's peak is known.
+    uint64_t codec_memory = codec_peak;
+    if (parallel) {
+        codec_memory = threads * lz78_memory_bound(&params, false);
+    }
+    if (options.verbose) {
+        print_verbose(total_syms, total_bits / BYTE);
+        print_memory(codec_memory, parallel, io_memory(&options.io));
+    }
+    if (options.stats) {
+        print_stats("decode", total_syms, total_bits / BYTE, trace_now() - started, &stats, codec_memory,
+            io_memory(&options.io));
     }
 
-    check_null_and_close(input_file);
-    check_null_and_close(output_file);
+    check_null_and_close(options.input_file);
+    check_null_and_close(options.output_file);
 
     return 0;
 }
 
 /*
-    Decodes header from infile, verifies Magic number, sets permissions for outfile.
+    Decodes information from infile to outfile.
+    Streams the reader's buffers through a raw liblz78 decoder straight into the writer's buffers,
+    the header having been read already, with the params recorded in it. Each call into the
+    decoder is a span of the trace. More input is only read once the decoder has emitted all it
+    can of the last, and with sync points that output is written out first.
+    Returns false if the pairs are malformed.
 */
-bool read_decode_header(int infile, int outfile) {
-    FileHeader fileheader;
-    memset((void *) &fileheader, 0, sizeof(FileHeader)); //Clears padding to avoid valgrind errors
-    read_header(infile, &fileheader);
-    if (fileheader.magic != MAGIC) {
-        return false;
+bool decode(Reader *reader, Writer *writer, const LZ78Params *params) {
+    LZ78Params raw = *params;
+    raw.raw = true;
+    LZ78Stream stream;
+    if (lz78_decode_init(&stream, &raw) != LZ78_OK) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
     }
-    fchmod(outfile, (mode_t) fileheader.protection);
-    return true;
+    trace_mark();
+
+    int flush = LZ78_RUN;
+    int response;
+    do {
+        if (stream.avail_in == 0 && stream.avail_out > 0 && flush == LZ78_RUN) {
+            if (params->sync) {
+                writer_flush(writer);
+            }
+            stream.avail_in = reader_next(reader, &stream.next_in);
+            total_syms += stream.avail_in;
+            if (stream.avail_in == 0) {
+                flush = LZ78_FINISH;
+            }
+        }
+        size_t room;
+        stream.next_out = writer_reserve(writer, &room);
+        stream.avail_out = room;
+        uint64_t start = trace_now();
+        response = lz78_decode(&stream, flush);
+        trace_span("decode", start, trace_now(), "bytes", room - stream.avail_out);
+        writer_commit(writer, room - stream.avail_out);
+        total_bits += BYTE * (room - stream.avail_out);
+    } while (response == LZ78_OK);
+    codec_peak = lz78_memory_peak(&stream);
+    lz78_decode_end(&stream);
+    return response == LZ78_STREAM_END;
 }
 
 /*
-    Decodes information from infile to outfile.
+    Checks the input like decode(), with the decoder discarding the output instead of writing it.
+    Returns false if the stream is malformed or its CRC does not match.
 */
-void decode(int infile, int outfile) {
-    WordTable *table = wt_create();
-    uint8_t current_sym = 0;
-    uint16_t current_code = 0;
-    uint16_t next_code = START_CODE;
-    while (read_pair(infile, &current_code, &current_sym, get_bitlength(next_code))) {
-        table[next_code] = word_append_sym(table[current_code], current_sym);
-        write_word(outfile, table[next_code]);
-        next_code++;
-        if (next_code == MAX_CODE) {
-            wt_reset(table);
-            next_code = START_CODE;
-        }
+bool verify(Reader *reader, const LZ78Params *params) {
+    LZ78Params raw = *params;
+    raw.raw = true;
+    LZ78Stream stream;
+    if (lz78_decode_init(&stream, &raw) != LZ78_OK) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
     }
-    flush_words(outfile);
-    wt_delete(table);
-    table = NULL;
+    trace_mark();
+
+    int flush = LZ78_RUN;
+    int response;
+    do {
+        if (stream.avail_in == 0 && flush == LZ78_RUN) {
+            stream.avail_in = reader_next(reader, &stream.next_in);
+            total_syms += stream.avail_in;
+            flush = stream.avail_in == 0 ? LZ78_FINISH : LZ78_RUN;
+        }
+        uint64_t start = trace_now();
+        uint64_t before = stream.total_out;
+        response = lz78_decode(&stream, flush);
+        trace_span("verify", start, trace_now(), "bytes", stream.total_out - before);
+    } while (response == LZ78_OK);
+    total_bits += BYTE * stream.total_out;
+    codec_peak = lz78_memory_peak(&stream);
+    lz78_decode_end(&stream);
+    return response == LZ78_STREAM_END;
 }
 
-void print_verbose(void) {
-    uint64_t total_bytes = (total_bits / BYTE);
-    fprintf(stderr, "Compresssed file size: %lu bytes\n", total_syms);
-    fprintf(stderr, "Uncompressed file size: %lu bytes\n", total_bytes);
-    fprintf(stderr, "Compresssion ratio: %02.02f%%\n",
-        100 * (1 - ((float) total_syms / (float) total_bytes)));
+/*
+    Decodes len bytes from uncompressed offset start of an indexed file, mapping the whole file so
+    the decoder can seek to the nearest boundary in its index. Stops early at the end of the file.
+    Returns false if the file is malformed.
+*/
+bool decode_range(int infile, Writer *writer, const LZ78Params *params, uint64_t start, uint64_t len) {
+    struct stat st;
+    size_t header_len = LZ78_HEADER_SIZE + (params->dict != NULL ? DICT_ID_SIZE : 0);
+    if (fstat(infile, &st) < 0 || !S_ISREG(st.st_mode) || (size_t) st.st_size < header_len) {
+        fprintf(stderr, "Input is not seekable\n");
+        exit(1);
+    }
+    uint8_t *map = (uint8_t *) mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, infile, 0);
+    if (map == MAP_FAILED) {
+        perror(NULL);
+        exit(1);
+    }
+
+    LZ78Params raw = *params;
+    raw.raw = true;
+    LZ78Stream stream;
+    if (lz78_decode_init(&stream, &raw) != LZ78_OK) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    int response = lz78_decode_seek(&stream, map + header_len, (size_t) st.st_size - header_len, start);
+    trace_mark();
+    if (response == LZ78_PARAM_ERROR) {
+        response = LZ78_STREAM_END; // start lies past the end: the range is empty.
+    }
+    uint64_t skipped = stream.total_in;
+    while (response == LZ78_OK && stream.total_out < start + len) {
+        //Decoded bytes before start go to the writer's buffer without being committed.
+        bool skipping = stream.total_out < start;
+        uint64_t want = skipping ? start - stream.total_out : start + len - stream.total_out;
+        size_t room;
+        stream.next_out = writer_reserve(writer, &room);
+        stream.avail_out = want < room ? (size_t) want : room;
+        size_t before = stream.avail_out;
+        response = lz78_decode(&stream, LZ78_FINISH);
+        if (!skipping) {
+            writer_commit(writer, before - stream.avail_out);
+            total_bits += BYTE * (before - stream.avail_out);
+        }
+    }
+    total_syms += stream.total_in - skipped;
+    codec_peak = lz78_memory_peak(&stream);
+    lz78_decode_end(&stream);
+    munmap(map, (size_t) st.st_size);
+    return response == LZ78_OK || response == LZ78_STREAM_END;
 }
 
 void print_help(void) {
@@ -103,11 +271,27 @@ void print_help(void) {
            "   Used with files compressed with the corresponding encoder.\n\n"
 
            "USAGE\n"
-           "   ./decode [-vh] [-i input] [-o output]\n\n"
+           "   ./decode [-vh] [-D dict] [-j threads] [-B size] [-m size] [--io=backend] [--direct]\n"
+           "            [--range=start:len] [--stats=json] [--trace=file] [-i input] [-o output]\n"
+           "   ./decode [options] -i archive [-C dir | --member=name [-o output]]\n"
+           "   ./decode -t [options] [-i input]\n\n"
 
            "OPTIONS\n"
            "   -v          Display decompression statistics\n"
            "   -i input    Specify input to decompress (stdin by default)\n"
            "   -o output   Specify output of decompressed input (stdout by default)\n"
+           "   -D dict     Preset dictionary the file was compressed with\n"
+           "   -j threads  Decompress chunked files and archives on threads threads (1 by default)\n"
+           "   -C dir      Extract an archive under dir (the current directory by default)\n"
+           "   --member=name  Extract only the archive member name, to the output\n"
+           "   -B size     I/O buffer size, K/M/G suffixes allowed (64K by default)\n"
+           "   -m size     Fit the dictionary, window and buffers in size bytes, K/M/G suffixes allowed\n"
+           "   --io=name   I/O backend: auto, sync, mmap, uring or thread (auto by default)\n"
+           "   --direct    Bypass the page cache with O_DIRECT where supported\n"
+           "   -t          Check the input, its CRC included, without writing its output\n"
+           "   --range=start:len  Decompress only len bytes from offset start, K/M/G suffixes\n"
+           "               allowed, seeking through the index of a file encoded with --index\n"
+           "   --stats=json  Print sizes, I/O calls, timings and codec counters (make STATS=1) as JSON\n"
+           "   --trace=file  Write a Chrome trace of the I/O, codec and dictionary epoch spans to file\n"
            "   -h          Display program usage\n");
 }
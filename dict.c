@@ -0,0 +1,249 @@
+#include "dict.h"
+#include "code.h"
+#include "crc32c.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BYTE       8
+#define TRAIN_BITS 20 // Code width of the trie that collects candidate phrases while training.
+
+/*
+    Little-endian uint32_t fields of a serialized dictionary.
+*/
+static void put_u32(uint8_t *buf, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (uint8_t) (value >> (BYTE * i));
+    }
+}
+
+static uint32_t get_u32(const uint8_t *buf) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= (uint32_t) buf[i] << (BYTE * i);
+    }
+    return value;
+}
+
+size_t lz78_dict_bound(uint32_t phrases) {
+    return DICT_HEADER_SIZE + 4 * (size_t) (phrases != 0 ? phrases : LZ78_DICT_PHRASES);
+}
+
+/*
+    Orders candidate keys, each a phrase's code below its complemented use count.
+*/
+static int compare_keys(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+    Parses the samples as an encoder would, without ever resetting, and counts how often each
+    phrase is gone through. A phrase is used at least as often as its prefix is, so taking the most
+    used phrases, ties going to the older one, keeps every prefix of a kept phrase. In LZW mode the
+    single symbols are seeded anyway, and only longer phrases are kept.
+    Kept phrases are renumbered in their order of creation, which puts parents first.
+*/
+int lz78_dict_train(uint8_t *dst, size_t *dst_len, const uint8_t *samples, size_t samples_len,
+    uint32_t phrases, const LZ78Params *params) {
+    bool lzw = params != NULL && params->lzw;
+    uint8_t bits = params != NULL && params->bits != 0 ? params->bits : LZ78_DEFAULT_BITS;
+    uint32_t base = lzw ? LZW_START_CODE : START_CODE;
+    if (bits < LZ78_MIN_BITS || bits > LZ78_MAX_BITS) {
+        return LZ78_PARAM_ERROR;
+    }
+    if (phrases == 0) {
+        phrases = LZ78_DICT_PHRASES;
+    }
+    if (phrases > max_code(bits) - 1 - base) {
+        phrases = max_code(bits) - 1 - base;
+    }
+    if (*dst_len < lz78_dict_bound(phrases)) {
+        return LZ78_BUF_ERROR;
+    }
+
+    uint32_t capacity = max_code(TRAIN_BITS);
+    Trie *trie = trie_create(TRAIN_BITS);
+    uint32_t *hits = (uint32_t *) calloc(capacity, sizeof(uint32_t));
+    uint32_t *parent = (uint32_t *) malloc(capacity * sizeof(uint32_t));
+    uint8_t *sym = (uint8_t *) malloc(capacity);
+    uint64_t *keys = (uint64_t *) malloc(capacity * sizeof(uint64_t));
+    int response = LZ78_MEM_ERROR;
+    if (trie == NULL || hits == NULL || parent == NULL || sym == NULL || keys == NULL) {
+        goto done;
+    }
+
+    uint32_t next_code = START_CODE;
+    TrieNode *node = trie->root;
+    for (size_t i = 0; i < samples_len; i++) {
+        TrieNode *next = trie_step(trie, node, samples[i]);
+        if (next != NULL) {
+            hits[next->code]++;
+            node = next;
+            continue;
+        }
+        if (next_code < capacity && trie_insert(trie, node, samples[i], next_code) != NULL) {
+            parent[next_code] = node->code;
+            sym[next_code] = samples[i];
+            next_code++;
+        }
+        node = trie->root;
+    }
+
+    uint32_t candidates = 0;
+    for (uint32_t code = START_CODE; code < next_code; code++) {
+        if (hits[code] != 0 && !(lzw && parent[code] == EMPTY_CODE)) {
+            keys[candidates++] = (uint64_t) (UINT32_MAX - hits[code]) << 32 | code;
+        }
+    }
+    qsort(keys, candidates, sizeof(uint64_t), compare_keys);
+    if (candidates > phrases) {
+        candidates = phrases;
+    }
+
+    //hits now maps each kept phrase to its code in the dictionary, and the rest to 0.
+    memset(hits, 0, capacity * sizeof(uint32_t));
+    for (uint32_t i = 0; i < candidates; i++) {
+        hits[(uint32_t) keys[i]] = 1;
+    }
+    uint32_t count = 0;
+    for (uint32_t code = START_CODE; code < next_code; code++) {
+        if (hits[code] == 0) {
+            continue;
+        }
+        uint32_t up = parent[code];
+        if (up != EMPTY_CODE) {
+            up = lzw && parent[up] == EMPTY_CODE ? (uint32_t) START_CODE + sym[up] : hits[up];
+        }
+        hits[code] = base + count;
+        put_u32(dst + DICT_HEADER_SIZE + 4 * (size_t) count, up | (uint32_t) sym[code] << 24);
+        count++;
+    }
+    put_u32(dst, DICT_MAGIC);
+    put_u32(dst + 8, lzw);
+    put_u32(dst + 12, count);
+    put_u32(dst + 4, crc32c(0, dst + 8, 8 + 4 * (size_t) count));
+    *dst_len = DICT_HEADER_SIZE + 4 * (size_t) count;
+    response = LZ78_OK;
+
+done:
+    free(keys);
+    free(sym);
+    free(parent);
+    free(hits);
+    if (trie != NULL) {
+        trie_delete(trie);
+    }
+    return response;
+}
+
+/*
+    Checks the phrases and lays out their words in one pass, then builds the trie in another, with
+    the symbols of each word copied from its parent's.
+*/
+int lz78_dict_load(LZ78Dict **dict, const uint8_t *src, size_t src_len) {
+    *dict = NULL;
+    if (src_len < DICT_HEADER_SIZE || get_u32(src) != DICT_MAGIC) {
+        return LZ78_DATA_ERROR;
+    }
+    uint32_t mode = get_u32(src + 8);
+    uint32_t count = get_u32(src + 12);
+    if (mode > 1 || count > (src_len - DICT_HEADER_SIZE) / 4
+        || get_u32(src + 4) != crc32c(0, src + 8, 8 + 4 * (size_t) count)) {
+        return LZ78_DATA_ERROR;
+    }
+    bool lzw = mode == 1;
+    uint32_t base = lzw ? LZW_START_CODE : START_CODE;
+    if (count >= max_code(LZ78_MAX_BITS) - 1 - base) {
+        return LZ78_DATA_ERROR;
+    }
+
+    LZ78Dict *d = (LZ78Dict *) calloc(1, sizeof(LZ78Dict));
+    if (d == NULL) {
+        return LZ78_MEM_ERROR;
+    }
+    d->id = get_u32(src + 4);
+    d->lzw = lzw;
+    d->next_code = base + count;
+    d->bits = get_bitlength(d->next_code + 1);
+    if (d->bits < LZ78_MIN_BITS) {
+        d->bits = LZ78_MIN_BITS;
+    }
+    d->words = (Word *) malloc((d->next_code - START_CODE) * sizeof(Word));
+    if (d->words == NULL) {
+        lz78_dict_free(d);
+        return LZ78_MEM_ERROR;
+    }
+
+    //Word offsets into syms are kept in syms until it is allocated.
+    uint64_t total = 0;
+    for (uint32_t code = START_CODE; code < d->next_code; code++) {
+        Word *word = &d->words[code - START_CODE];
+        if (code < base) {
+            word->len = 1;
+        } else {
+            uint32_t up = get_u32(src + DICT_HEADER_SIZE + 4 * (size_t) (code - base)) & 0xFFFFFF;
+            if (up >= code || up < (lzw ? START_CODE : EMPTY_CODE)) {
+                lz78_dict_free(d);
+                return LZ78_DATA_ERROR;
+            }
+            word->len = up == EMPTY_CODE ? 1 : d->words[up - START_CODE].len + 1;
+        }
+        word->syms = (uint8_t *) (uintptr_t) total;
+        total += word->len;
+    }
+
+    d->syms = (uint8_t *) malloc(total != 0 ? (size_t) total : 1);
+    d->trie = trie_create(d->bits);
+    if (total != (size_t) total || d->syms == NULL || d->trie == NULL) {
+        lz78_dict_free(d);
+        return LZ78_MEM_ERROR;
+    }
+    if (lzw) {
+        trie_seed(d->trie);
+    }
+    for (uint32_t code = START_CODE; code < d->next_code; code++) {
+        Word *word = &d->words[code - START_CODE];
+        word->syms = d->syms + (uintptr_t) word->syms;
+        if (code < base) {
+            word->syms[0] = (uint8_t) (code - START_CODE);
+            continue;
+        }
+        uint32_t entry = get_u32(src + DICT_HEADER_SIZE + 4 * (size_t) (code - base));
+        uint32_t up = entry & 0xFFFFFF;
+        uint8_t sym = (uint8_t) (entry >> 24);
+        TrieNode *node = &d->trie->nodes[up];
+        if (up != EMPTY_CODE) {
+            memcpy(word->syms, d->words[up - START_CODE].syms, word->len - 1);
+        }
+        word->syms[word->len - 1] = sym;
+        if (trie_step(d->trie, node, sym) != NULL || trie_insert(d->trie, node, sym, code) == NULL) {
+            lz78_dict_free(d);
+            return LZ78_DATA_ERROR;
+        }
+    }
+    *dict = d;
+    return LZ78_OK;
+}
+
+bool lz78_dict_fits(const LZ78Dict *dict, const LZ78Params *params) {
+    uint8_t bits = params->bits != 0 ? params->bits : LZ78_DEFAULT_BITS;
+    return dict->lzw == params->lzw && dict->bits <= bits;
+}
+
+uint32_t lz78_dict_id(const LZ78Dict *dict) {
+    return dict->id;
+}
+
+void lz78_dict_free(LZ78Dict *dict) {
+    if (dict == NULL) {
+        return;
+    }
+    if (dict->trie != NULL) {
+        trie_delete(dict->trie);
+    }
+    free(dict->syms);
+    free(dict->words);
+    free(dict);
+}
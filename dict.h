@@ -0,0 +1,29 @@
+#ifndef __DICT_H__
+#define __DICT_H__
+
+#include "lz78.h"
+#include "trie.h"
+#include "word.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Loaded preset dictionary (see lz78.h for its serialized form). It is built once by
+// lz78_dict_load() and only read afterwards, so any number of streams may share it.
+//
+// The dictionary's codes are its trie's node indices (the root being EMPTY_CODE), as its phrases
+// are inserted in code order, so an encoder starts out with a copy of the trie's pools and a
+// decoder copies the words of the dictionary's codes straight into its output.
+//
+struct LZ78Dict {
+    uint32_t id;
+    bool lzw;
+    uint8_t bits; // Narrowest code width with a code to spare after the dictionary's.
+    uint32_t next_code; // First code after the dictionary's, the first a stream assigns.
+    Trie *trie; // Every phrase of the dictionary, and in LZW mode every symbol.
+    Word *words; // Words of the codes from START_CODE up to next_code.
+    uint8_t *syms; // Symbols of all the words, one after another.
+};
+
+#endif
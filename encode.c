@@ -1,28 +1,37 @@
+#define _GNU_SOURCE // memrchr
+
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 
 #include "io.h"
-#include "code.h"
-#include "trie.h"
-#include "word.h"
+#include "archive.h"
+#include "chunk.h"
+#include "lz78.h"
 #include "helpers.h"
+#include "trace.h"
 
-void encode(int infile, int outfile);
-void write_encode_header(int infile, int outfile);
-void print_verbose(void);
+void encode(Reader *reader, Writer *writer, const LZ78Params *params);
+void encode_stream(Reader *reader, Writer *writer, LZ78Stream *stream);
+bool resume(int outfile, const char *path, LZ78Params *params, const char *dict_file, LZ78Dict **dict,
+    LZ78Stream *stream);
+void encode_live(Reader *reader, Writer *writer, const LZ78Params *params, const Options *options);
+uint64_t estimate(Reader *reader, const LZ78Params *params);
+void write_encode_header(int infile, int outfile, uint16_t flags, const LZ78Dict *dict);
 void print_help(void);
 
+static size_t codec_peak; // Peak bytes of the single stream's dictionary, for -v and --stats.
+
 /*
     Main function that gets arguments and runs encoding algorithms.
 */
 int main(int argc, char **argv) {
-    bool help = false;
-    bool verbose = false;
-    int input_file = 0;
-    int output_file = 1;
+    uint64_t started = trace_now();
+    Options options = { .input_file = 0, .output_file = 1, .chunk_size = CHUNK_SIZE, .batch = CHUNK_BATCH };
 
-    int response = argparser(argc, argv, &input_file, &output_file, &verbose, &help);
+    int response = argparser(argc, argv, &options);
 
     if (response == 4) {
         print_help();
@@ -30,89 +39,454 @@ int main(int argc, char **argv) {
     }
 
     if (response != 0) {
-        check_null_and_close(input_file);
-        check_null_and_close(output_file);
-        if (help) {
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        if (options.help) {
             print_help();
         }
         return -1;
     }
 
-    write_encode_header(input_file, output_file);
-    encode(input_file, output_file);
+    if (options.params.index && (options.threads > 0 || options.archive)) {
+        fprintf(stderr, "An index cannot be written to chunked files or archives\n");
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        return 1;
+    }
+    bool live = options.flush_timed || options.flush_lines;
+    if (options.append && (options.output_path == NULL || live || options.estimate || options.threads > 0
+                              || options.archive || options.params.index)) {
+        fprintf(stderr, "--append continues a single stream in an output file (-o), without an index\n");
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        return 1;
+    }
+    if (options.estimate && (live || options.threads > 0 || options.archive)) {
+        fprintf(stderr, "Only single streams can be estimated\n");
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        return 1;
+    }
+    if (live && (options.threads > 0 || options.archive)) {
+        fprintf(stderr, "Chunked files and archives cannot be flushed\n");
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        return 1;
+    }
+    options.params.sync = live || options.append;
+    options.params.append = options.append;
+    options.io.stream = live;
+    bool parallel = options.threads > 0 || options.archive;
+    //A stream being continued keeps the settings in its header, so resume() checks its width against -m.
+    struct stat output_stat;
+    bool resuming = options.append && fstat(options.output_file, &output_stat) == 0 && output_stat.st_size > 0;
+    if (!fit_memory(&options, &options.params, true, parallel)) {
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        return 1;
+    }
+    if (options.archive == (optind == argc)) {
+        fprintf(stderr, options.archive ? "No files to archive\n" : "Files are only given with --archive\n");
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        return 1;
+    }
+
+    LZ78Dict *dict = NULL;
+    if (options.dict_file != NULL && !resuming) {
+        dict = load_dict(options.dict_file);
+        options.params.dict = dict;
+        if (!lz78_dict_fits(dict, &options.params)) {
+            fprintf(stderr, "Dictionary %s was trained for another --lzw or a wider -b\n", options.dict_file);
+            check_null_and_close(options.input_file);
+            check_null_and_close(options.output_file);
+            return 1;
+        }
+    }
+
+    LZ78Stats stats = { 0 };
+    if (options.stats) {
+        options.params.stats = &stats;
+    }
+    if (options.trace_file != NULL) {
+        if (!trace_open(options.trace_file)) {
+            perror(options.trace_file);
+            return 1;
+        }
+        options.params.epoch = trace_epoch;
+    }
+    LZ78Stream resumed;
+    if (resuming && !resume(options.output_file, options.output_path, &options.params, options.dict_file, &dict,
+                        &resumed)) {
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        return 1;
+    }
 
-    if (verbose) {
-        print_verbose();
+    if (options.estimate) {
+        Reader reader;
+        if (!reader_open(&reader, options.input_file, &options.io)) {
+            fprintf(stderr, "Out of memory\n");
+            return 1;
+        }
+        uint64_t size = LZ78_HEADER_SIZE + (dict != NULL ? DICT_ID_SIZE : 0) + estimate(&reader, &options.params);
+        reader_close(&reader);
+        lz78_dict_free(dict);
+        trace_close();
+        printf("%" PRIu64 "\n", size);
+        if (options.verbose) {
+            print_verbose(size, total_syms);
+            print_memory(codec_peak, false, io_memory(&options.io));
+        }
+        if (options.stats) {
+            print_stats("encode", size, total_syms, trace_now() - started, &stats, codec_peak,
+                io_memory(&options.io));
+        }
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        return 0;
     }
 
-    check_null_and_close(input_file);
-    check_null_and_close(output_file);
+    uint16_t flags = lz78_header_flags(&options.params);
+    if (options.archive) {
+        flags |= FLAG_ARCHIVE;
+    } else if (options.threads > 0) {
+        flags |= FLAG_CHUNKED;
+    }
+    if (!resuming) {
+        write_encode_header(options.input_file, options.output_file, flags, dict);
+    }
+
+    //An archive reads its members itself, not the input.
+    Reader reader;
+    Writer writer;
+    if ((!options.archive && !reader_open(&reader, options.input_file, &options.io))
+        || !writer_open(&writer, options.output_file, &options.io)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    bool valid = true;
+    if (options.archive) {
+        uint64_t offset = LZ78_HEADER_SIZE + (dict != NULL ? DICT_ID_SIZE : 0);
+        uint32_t threads = options.threads > 0 ? options.threads : 1;
+        valid = encode_archive(argv + optind, (uint32_t) (argc - optind), &writer, offset, options.chunk_size,
+            threads, &options.params);
+    } else if (options.threads > 0) {
+        encode_chunked(&reader, &writer, options.chunk_size, options.batch, options.threads, &options.params);
+    } else if (resuming) {
+        encode_stream(&reader, &writer, &resumed);
+    } else if (live) {
+        encode_live(&reader, &writer, &options.params, &options);
+    } else {
+        encode(&reader, &writer, &options.params);
+    }
+    writer_close(&writer);
+    if (!options.archive) {
+        reader_close(&reader);
+    }
+    lz78_dict_free(dict);
+
+    trace_close();
+    if (!valid) {
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        return 1;
+    }
+    //Threads each take up to the bound at once; only a single stream's peak is known.
+    uint64_t codec_memory = codec_peak;
+    if (parallel) {
+        codec_memory = (options.threads > 0 ? options.threads : 1) * lz78_memory_bound(&options.params, true);
+    }
+    uint64_t buffer_memory = io_memory(&options.io) + batch_memory(&options);
+    if (options.verbose) {
+        print_verbose(total_bits / BYTE, total_syms);
+        print_memory(codec_memory, parallel, buffer_memory);
+    }
+    if (options.stats) {
+        print_stats("encode", total_bits / BYTE, total_syms, trace_now() - started, &stats, codec_memory,
+            buffer_memory);
+    }
+
+    check_null_and_close(options.input_file);
+    check_null_and_close(options.output_file);
 
     return 0;
 }
 
 /*
-    Writes encoded header into file
+    Writes encoded header into file, followed by the ID of the preset dictionary if there is one
 */
-void write_encode_header(int infile, int outfile) {
+void write_encode_header(int infile, int outfile, uint16_t flags, const LZ78Dict *dict) {
     FileHeader fileheader;
     memset((void *) &fileheader, 0, sizeof(FileHeader)); //Clears padding to avoid valgrind errors
     struct stat stat_struct;
     fstat(infile, &stat_struct);
     fileheader.magic = MAGIC;
     fileheader.protection = stat_struct.st_mode;
+    fileheader.flags = flags;
     write_header(outfile, &fileheader);
+    if (dict != NULL) {
+        uint8_t id[DICT_ID_SIZE];
+        for (int i = 0; i < DICT_ID_SIZE; i++) {
+            id[i] = (uint8_t) (lz78_dict_id(dict) >> (BYTE * i));
+        }
+        check_print_file_error(write_bytes(outfile, id, DICT_ID_SIZE));
+    }
+}
+
+/*
+    Feeds len bytes of data to the encoder with flush and its output to the writer, until the
+    encoder has taken them all and staged nothing more. Each call into the encoder is a span of
+    the trace. A sync point is written out at once.
+*/
+static void encode_span(LZ78Stream *stream, Writer *writer, const uint8_t *data, size_t len, int flush) {
+    stream->next_in = data;
+    stream->avail_in = len;
+    int response;
+    do {
+        size_t room;
+        stream->next_out = writer_reserve(writer, &room);
+        stream->avail_out = room;
+        uint64_t start = trace_now();
+        uint64_t before = stream->total_in;
+        response = lz78_encode(stream, flush);
+        trace_span("encode", start, trace_now(), "bytes", stream->total_in - before);
+        writer_commit(writer, room - stream->avail_out);
+        total_bits += BYTE * (room - stream->avail_out);
+    } while (response == LZ78_OK && (stream->avail_in > 0 || stream->avail_out == 0));
+    if (flush == LZ78_SYNC) {
+        writer_flush(writer);
+    }
 }
 
 /*
     Compressses infile into outfile
+    Streams the reader's buffers through a raw liblz78 encoder straight into the writer's buffers,
+    the header having been written already. params selects the code width and reset policy.
+*/
+void encode(Reader *reader, Writer *writer, const LZ78Params *params) {
+    LZ78Params raw = *params;
+    raw.raw = true;
+    LZ78Stream stream;
+    if (lz78_encode_init(&stream, &raw) != LZ78_OK) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    encode_stream(reader, writer, &stream);
+}
+
+/*
+    Runs the reader's buffers through stream, an encoder already set up, until it ends, and frees it.
 */
-void encode(int infile, int outfile) {
-    TrieNode *root = trie_create();
-    TrieNode *current_node = root;
-    TrieNode *previous_node = NULL;
-    uint8_t current_sym = 0;
-    uint8_t previous_sym = 0;
-    uint16_t next_code = START_CODE;
-
-    while (read_sym(infile, &current_sym)) {
-        TrieNode *next_node = trie_step(current_node, current_sym);
-        if (next_node != NULL) {
-            previous_node = current_node;
-            current_node = next_node;
-        } else {
-            write_pair(outfile, current_node->code, current_sym, get_bitlength(next_code));
-            current_node->children[current_sym] = trie_node_create(next_code);
-            current_node = root;
-            next_code++;
-        }
-
-        if (next_code == MAX_CODE) {
-            trie_reset(root);
-            current_node = root;
-            next_code = START_CODE;
-        }
-        previous_sym = current_sym;
-    }
-    if (current_node != root) {
-        write_pair(outfile, previous_node->code, previous_sym, get_bitlength(next_code));
-        next_code = (next_code + 1) % MAX_CODE;
-    }
-    write_pair(outfile, STOP_CODE, 0, get_bitlength(next_code));
-    flush_pairs(outfile);
-    trie_delete(root);
-    root = NULL;
+void encode_stream(Reader *reader, Writer *writer, LZ78Stream *stream) {
+    trace_mark();
+
+    const uint8_t *data;
+    size_t len;
+    while ((len = reader_next(reader, &data)) > 0) {
+        total_syms += len;
+        encode_span(stream, writer, data, len, LZ78_RUN);
+    }
+    encode_span(stream, writer, NULL, 0, LZ78_FINISH);
+    codec_peak = lz78_memory_peak(stream);
+    lz78_encode_end(stream);
 }
 
 /*
-    Prints verbose output to stderr
+    Loads a little-endian field of the given number of bytes.
 */
-void print_verbose(void) {
-    uint64_t total_bytes = (total_bits / BYTE);
-    fprintf(stderr, "Compresssed file size: %lu bytes\n", total_bytes);
-    fprintf(stderr, "Uncompressed file size: %lu bytes\n", total_syms);
-    fprintf(stderr, "Compresssion ratio: %02.02f%%\n",
-        100 * (1 - ((float) total_bytes / (float) total_syms)));
+static uint32_t load_field(const uint8_t *buf, int bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint32_t) buf[i] << (BYTE * i);
+    }
+    return value;
+}
+
+/*
+    Sets stream up to continue the stream in outfile (named path) where its append trailer left
+    it: reads the header into params, which keep their hooks and memory limit, checks that dict_file
+    is the file's dictionary if it has one and that the file's code width fits the limit on both
+    sides, and cuts the file back to the end of the last sync point, where the output goes on.
+    Returns false, having said why, if the file cannot be continued.
+*/
+bool resume(int outfile, const char *path, LZ78Params *params, const char *dict_file, LZ78Dict **dict,
+    LZ78Stream *stream) {
+    FileHeader fileheader;
+    memset((void *) &fileheader, 0, sizeof(FileHeader));
+    read_header(outfile, &fileheader);
+    total_syms = 0; //read_header() counts the header, which is not this run's input.
+    LZ78Params header;
+    if (fileheader.magic != MAGIC || !lz78_header_params(&fileheader, &header)) {
+        fprintf(stderr, "%s is not an encoded file\n", path);
+        return false;
+    }
+    if (!header.sync || header.index || (fileheader.flags & (FLAG_CHUNKED | FLAG_ARCHIVE))) {
+        fprintf(stderr, "%s was not written with --append\n", path);
+        return false;
+    }
+    uint64_t offset = sizeof(FileHeader);
+    if (fileheader.flags & FLAG_DICT) {
+        uint8_t field[DICT_ID_SIZE];
+        if (read_bytes(outfile, field, DICT_ID_SIZE) != DICT_ID_SIZE) {
+            fprintf(stderr, "%s is not an encoded file\n", path);
+            return false;
+        }
+        uint32_t id = load_field(field, DICT_ID_SIZE);
+        if (dict_file == NULL) {
+            fprintf(stderr, "%s needs dictionary %08x (-D)\n", path, id);
+            return false;
+        }
+        *dict = load_dict(dict_file);
+        if (lz78_dict_id(*dict) != id) {
+            fprintf(stderr, "Wrong dictionary: %s needs %08x, %s is %08x\n", path, id, dict_file,
+                lz78_dict_id(*dict));
+            return false;
+        }
+        header.dict = *dict;
+        offset += DICT_ID_SIZE;
+    }
+
+    struct stat stat_struct;
+    uint8_t tail[8];
+    uint8_t *trailer = NULL;
+    uint32_t len = 0;
+    if (fstat(outfile, &stat_struct) == 0 && (uint64_t) stat_struct.st_size >= offset + sizeof(tail)
+        && pread(outfile, tail, sizeof(tail), stat_struct.st_size - (off_t) sizeof(tail)) == sizeof(tail)
+        && load_field(tail + 4, 4) == APPEND_MAGIC) {
+        len = load_field(tail, 4);
+        trailer = len <= (uint64_t) stat_struct.st_size - offset ? (uint8_t *) malloc(len) : NULL;
+    }
+    if (trailer == NULL || pread(outfile, trailer, len, stat_struct.st_size - (off_t) len) != (ssize_t) len) {
+        free(trailer);
+        fprintf(stderr, "%s has no append trailer\n", path);
+        return false;
+    }
+    header.raw = true;
+    header.append = true;
+    header.stats = params->stats;
+    header.epoch = params->epoch;
+    header.opaque = params->opaque;
+    header.memory = params->memory;
+    *params = header;
+    size_t needed = lz78_memory_bound(params, true);
+    if (lz78_memory_bound(params, false) > needed) {
+        needed = lz78_memory_bound(params, false);
+    }
+    if (params->memory != 0 && needed > params->memory) {
+        free(trailer);
+        fprintf(stderr, "Memory budget too small: %s needs %zu bytes for its %u-bit codes\n", path, needed,
+            params->bits);
+        return false;
+    }
+    uint64_t end;
+    int response = lz78_encode_resume(stream, params, trailer, len, &end);
+    free(trailer);
+    if (response == LZ78_MEM_ERROR) {
+        fprintf(stderr, "Out of memory\n");
+        return false;
+    }
+    if (response != LZ78_OK || offset + end > (uint64_t) stat_struct.st_size - len) {
+        if (response == LZ78_OK) {
+            lz78_encode_end(stream);
+        }
+        fprintf(stderr, "%s has a corrupt append trailer\n", path);
+        return false;
+    }
+    if (ftruncate(outfile, (off_t) (offset + end)) != 0 || lseek(outfile, (off_t) (offset + end), SEEK_SET) < 0) {
+        lz78_encode_end(stream);
+        perror(path);
+        return false;
+    }
+    return true;
+}
+
+/*
+    Compresses like encode() for input that trickles in, such as a log on a pipe, ending it with
+    sync points so the decoder at the other end can emit it as it comes. With --flush-lines a sync
+    point follows the last newline of every read. With --flush-ms input waits no longer than
+    flush_ms milliseconds for one, whether more is on its way or not: the deadline runs from the
+    first byte after the last sync point, and the read for more input is given up at it.
+*/
+void encode_live(Reader *reader, Writer *writer, const LZ78Params *params, const Options *options) {
+    LZ78Params raw = *params;
+    raw.raw = true;
+    LZ78Stream stream;
+    if (lz78_encode_init(&stream, &raw) != LZ78_OK) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    trace_mark();
+
+    const uint64_t never = UINT64_MAX;
+    uint64_t deadline = never;
+    for (;;) {
+        if (deadline != never) {
+            uint64_t now = trace_now();
+            uint64_t left = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+            if (left == 0 || !reader_wait(reader, (int) left)) {
+                encode_span(&stream, writer, NULL, 0, LZ78_SYNC);
+                deadline = never;
+                continue;
+            }
+        }
+        const uint8_t *data;
+        size_t len = reader_next(reader, &data);
+        if (len == 0) {
+            break;
+        }
+        total_syms += len;
+        const uint8_t *newline = options->flush_lines ? (const uint8_t *) memrchr(data, '\n', len) : NULL;
+        if (newline != NULL) {
+            size_t lines = (size_t) (newline + 1 - data);
+            encode_span(&stream, writer, data, lines, LZ78_SYNC);
+            data += lines;
+            len -= lines;
+            deadline = never;
+        }
+        if (len > 0 && options->flush_timed && deadline == never) {
+            deadline = trace_now() + (uint64_t) options->flush_ms * 1000000;
+        }
+        encode_span(&stream, writer, data, len, LZ78_RUN);
+    }
+    encode_span(&stream, writer, NULL, 0, LZ78_FINISH);
+    codec_peak = lz78_memory_peak(&stream);
+    lz78_encode_end(&stream);
+}
+
+/*
+    Runs the input through a raw liblz78 encoder that discards its output, and returns the number
+    of bytes it would have written (without the header). The dictionary does all the work of a
+    real run, less the copies, writes and CRC. Each call into the encoder is a span of the trace.
+*/
+uint64_t estimate(Reader *reader, const LZ78Params *params) {
+    LZ78Params raw = *params;
+    raw.raw = true;
+    raw.discard = true;
+    LZ78Stream stream;
+    if (lz78_encode_init(&stream, &raw) != LZ78_OK) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    trace_mark();
+
+    int flush = LZ78_RUN;
+    int response;
+    do {
+        if (stream.avail_in == 0 && flush == LZ78_RUN) {
+            stream.avail_in = reader_next(reader, &stream.next_in);
+            total_syms += stream.avail_in;
+            flush = stream.avail_in == 0 ? LZ78_FINISH : LZ78_RUN;
+        }
+        uint64_t start = trace_now();
+        uint64_t before = stream.total_in;
+        response = lz78_encode(&stream, flush);
+        trace_span("estimate", start, trace_now(), "bytes", stream.total_in - before);
+    } while (response == LZ78_OK);
+    codec_peak = lz78_memory_peak(&stream);
+    uint64_t size = stream.total_out;
+    lz78_encode_end(&stream);
+    return size;
 }
 
 void print_help(void) {
@@ -121,11 +495,42 @@ void print_help(void) {
            "   Compressed files are decompressed with the corresponding decoder.\n\n"
 
            "USAGE\n"
-           "   ./encode [-vh] [-i input] [-o output]\n\n"
+           "   ./encode [-vh] [-b bits] [-l level] [--reset=name] [--lzw] [--index[=interval]] [--crc]\n"
+           "            [-D dict] [-j threads] [-c chunk_size] [-B size] [-m size] [--io=backend]\n"
+           "            [--direct] [--flush-ms=ms] [--flush-lines] [--stats=json] [--trace=file] [-i input] [-o output]\n"
+           "   ./encode --append [options] [-i input] -o output\n"
+           "   ./encode --archive [options] [-o output] path...\n"
+           "   ./encode --estimate [options] [-i input]\n\n"
 
            "OPTIONS\n"
            "   -v          Display compression statistics\n"
            "   -i input    Specify input to compress (stdin by default)\n"
            "   -o output   Specify output of compressed input (stdout by default)\n"
+           "   -b bits     Maximum code width, 9 to 24 (16 by default)\n"
+           "   -l level    Entropy stage: 0 plain, 1 truncated binary codes, 2 adaptive Huffman (0 by default)\n"
+           "   --reset=name  Full dictionary policy: fixed, adaptive or never (fixed by default)\n"
+           "   --lzw       Write LZW codes, without a symbol after each code\n"
+           "   --index[=interval]  Append an index of dictionary resets for decode --range, forcing\n"
+           "               a reset every interval bytes if given (K/M/G suffixes allowed, 64K or more)\n"
+           "   --crc       Append a CRC32C of the input, checked by decode (and one per chunk with -j)\n"
+           "   -D dict     Start from the preset dictionary dict, made by train (decode needs it too)\n"
+           "   -j threads  Write the chunked format, compressing chunks on threads threads\n"
+           "               (with --archive, compress the parts of the files on threads threads);\n"
+           "               each is stored, run-length coded or LZ78 coded, whichever is smallest\n"
+           "   -c size     Uncompressed bytes per chunk or archive part, K/M/G suffixes allowed (1M by default)\n"
+           "   --archive   Archive the files given, and the files under the directories given\n"
+           "   -B size     I/O buffer size, K/M/G suffixes allowed (64K by default)\n"
+           "   -m size     Fit the dictionaries and buffers in size bytes, K/M/G suffixes allowed, lowering\n"
+           "               -b, -B and -c as needed; the output decodes with the same -m\n"
+           "   --io=name   I/O backend: auto, sync, mmap, uring or thread (auto by default)\n"
+           "   --direct    Bypass the page cache with O_DIRECT where supported\n"
+           "   --flush-ms=ms  Write input out as a sync point, which decode emits at once, no later\n"
+           "               than ms milliseconds after it is read, for pipes and sockets\n"
+           "   --flush-lines  Write every complete line read out as a sync point\n"
+           "   --append    Continue the stream in output, which ends with an append trailer, with the input\n"
+           "               (a new output is started with an append trailer)\n"
+           "   --estimate  Print the compressed size of the input instead of writing it\n"
+           "   --stats=json  Print sizes, I/O calls, timings and codec counters (make STATS=1) as JSON\n"
+           "   --trace=file  Write a Chrome trace of the I/O, codec and dictionary epoch spans to file\n"
            "   -h          Display program help and usage\n");
 }
@@ -1,4 +1,50 @@
 #include "helpers.h"
+#include "chunk.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//Long options, all without a short form except where val is a letter of OPTIONS.
+enum { OPT_IO = 256, OPT_DIRECT, OPT_RESET, OPT_LZW, OPT_INDEX, OPT_RANGE, OPT_CRC, OPT_STATS, OPT_TRACE, OPT_ARCHIVE, OPT_MEMBER,
+    OPT_FLUSH_MS, OPT_FLUSH_LINES, OPT_ESTIMATE, OPT_APPEND, OPT_COUNT, OPT_LINES };
+
+static const struct option long_options[] = {
+    { "io", required_argument, NULL, OPT_IO },
+    { "direct", no_argument, NULL, OPT_DIRECT },
+    { "buffer-size", required_argument, NULL, 'B' },
+    { "reset", required_argument, NULL, OPT_RESET },
+    { "lzw", no_argument, NULL, OPT_LZW },
+    { "index", optional_argument, NULL, OPT_INDEX },
+    { "range", required_argument, NULL, OPT_RANGE },
+    { "crc", no_argument, NULL, OPT_CRC },
+    { "stats", required_argument, NULL, OPT_STATS },
+    { "trace", required_argument, NULL, OPT_TRACE },
+    { "archive", no_argument, NULL, OPT_ARCHIVE },
+    { "member", required_argument, NULL, OPT_MEMBER },
+    { "flush-ms", required_argument, NULL, OPT_FLUSH_MS },
+    { "flush-lines", no_argument, NULL, OPT_FLUSH_LINES },
+    { "estimate", no_argument, NULL, OPT_ESTIMATE },
+    { "append", no_argument, NULL, OPT_APPEND },
+    { "count", no_argument, NULL, OPT_COUNT },
+    { "lines", no_argument, NULL, OPT_LINES },
+    { NULL, 0, NULL, 0 },
+};
+
+/*
+    Parses a start:len byte range, each with an optional K, M or G suffix.
+*/
+static bool parse_range(const char *arg, uint64_t *start, uint64_t *len) {
+    char first[32];
+    const char *colon = strchr(arg, ':');
+    if (colon == NULL || (size_t) (colon - arg) >= sizeof(first)) {
+        return false;
+    }
+    memcpy(first, arg, (size_t) (colon - arg));
+    first[colon - arg] = '\0';
+    return parse_size(first, start) && parse_size(colon + 1, len);
+}
 
 /*
     Argument parser:
@@ -6,56 +52,457 @@
         - Sets values from command line as appropriate
         - Opens files and error checks if necessary
 */
-int argparser(int argc, char **argv, int *input_file, int *output_file, bool *verbose, bool *help) {
+int argparser(int argc, char **argv, Options *options) {
     int opt = 0;
     int fd;
-    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+    uint64_t value;
+    while ((opt = getopt_long(argc, argv, OPTIONS, long_options, NULL)) != -1) {
         switch (opt) {
         case 'i':
             fd = open(optarg, O_RDONLY);
-            *input_file = fd;
+            options->input_file = fd;
             if (fd < 0) {
                 perror(NULL);
                 return 1;
             }
             break;
-        case 'o':
-            fd = open(optarg, O_CREAT + O_WRONLY + O_TRUNC, S_IRUSR + S_IWUSR);
-            *output_file = fd;
-            if (fd < 0) {
-                perror(NULL);
-                return 2;
+        case 'o': options->output_path = optarg; break;
+        case 'v': options->verbose = true; break;
+        case 'b':
+            if (!parse_size(optarg, &value) || value < LZ78_MIN_BITS || value > LZ78_MAX_BITS) {
+                fprintf(stderr, "Invalid code width: %s\n", optarg);
+                return 3;
+            }
+            options->params.bits = (uint8_t) value;
+            break;
+        case 'l':
+            if (!parse_size(optarg, &value) || value > LZ78_LEVEL_HUFFMAN) {
+                fprintf(stderr, "Invalid level: %s\n", optarg);
+                return 3;
+            }
+            options->params.level = (uint8_t) value;
+            break;
+        case 'D': options->dict_file = optarg; break;
+        case 'n':
+            if (!parse_size(optarg, &value) || value == 0 || value >= (1 << LZ78_MAX_BITS)) {
+                fprintf(stderr, "Invalid phrase count: %s\n", optarg);
+                return 3;
+            }
+            options->phrases = (uint32_t) value;
+            break;
+        case 'j':
+            if (!parse_size(optarg, &value) || value == 0 || value > 1024) {
+                fprintf(stderr, "Invalid thread count: %s\n", optarg);
+                return 3;
+            }
+            options->threads = (uint32_t) value;
+            break;
+        case 'c':
+            if (!parse_size(optarg, &value) || value == 0 || value > (1 << 30)) {
+                fprintf(stderr, "Invalid chunk size: %s\n", optarg);
+                return 3;
+            }
+            options->chunk_size = (uint32_t) value;
+            break;
+        case 'B':
+            if (!parse_size(optarg, &value) || value < 16 || value > (1 << 30)) {
+                fprintf(stderr, "Invalid buffer size: %s\n", optarg);
+                return 3;
+            }
+            options->io.buffer_size = (uint32_t) value;
+            break;
+        case OPT_IO:
+            if (strcmp(optarg, "auto") == 0) {
+                options->io.backend = IO_AUTO;
+            } else if (strcmp(optarg, "sync") == 0) {
+                options->io.backend = IO_SYNC;
+            } else if (strcmp(optarg, "mmap") == 0) {
+                options->io.backend = IO_MMAP;
+            } else if (strcmp(optarg, "uring") == 0) {
+                options->io.backend = IO_URING;
+            } else if (strcmp(optarg, "thread") == 0) {
+                options->io.backend = IO_THREAD;
+            } else {
+                fprintf(stderr, "Invalid I/O backend: %s\n", optarg);
+                return 3;
+            }
+            break;
+        case OPT_DIRECT: options->io.direct = true; break;
+        case OPT_LZW: options->params.lzw = true; break;
+        case OPT_CRC: options->params.checksum = true; break;
+        case OPT_STATS:
+            if (strcmp(optarg, "json") != 0) {
+                fprintf(stderr, "Invalid stats format: %s\n", optarg);
+                return 3;
+            }
+            options->stats = true;
+            break;
+        case OPT_TRACE: options->trace_file = optarg; break;
+        case OPT_ARCHIVE: options->archive = true; break;
+        case OPT_MEMBER: options->member = optarg; break;
+        case 'C': options->dir = optarg; break;
+        case 'm':
+            if (!parse_size(optarg, &value) || value == 0) {
+                fprintf(stderr, "Invalid memory budget: %s\n", optarg);
+                return 3;
+            }
+            options->memory = value;
+            break;
+        case OPT_FLUSH_MS:
+            if (!parse_size(optarg, &value) || value > 60000) {
+                fprintf(stderr, "Invalid flush interval: %s\n", optarg);
+                return 3;
+            }
+            options->flush_timed = true;
+            options->flush_ms = (uint32_t) value;
+            break;
+        case OPT_FLUSH_LINES: options->flush_lines = true; break;
+        case 't': options->test = true; break;
+        case OPT_ESTIMATE: options->estimate = true; break;
+        case OPT_APPEND: options->append = true; break;
+        case OPT_COUNT: options->count = true; break;
+        case OPT_LINES: options->lines = true; break;
+        case OPT_INDEX:
+            if (optarg != NULL && (!parse_size(optarg, &value) || value < LZ78_MIN_INTERVAL)) {
+                fprintf(stderr, "Invalid index interval: %s\n", optarg);
+                return 3;
             }
+            options->params.index = true;
+            options->params.index_interval = optarg != NULL ? value : 0;
             break;
-        case 'v': *verbose = true; break;
-        case 'h': *help = true; return 4;
-        default: *help = true; return 5;
+        case OPT_RANGE:
+            if (!parse_range(optarg, &options->range_start, &options->range_len)) {
+                fprintf(stderr, "Invalid range: %s\n", optarg);
+                return 3;
+            }
+            options->range = true;
+            break;
+        case OPT_RESET:
+            if (strcmp(optarg, "fixed") == 0) {
+                options->params.reset = LZ78_RESET_FIXED;
+            } else if (strcmp(optarg, "adaptive") == 0) {
+                options->params.reset = LZ78_RESET_ADAPTIVE;
+            } else if (strcmp(optarg, "never") == 0) {
+                options->params.reset = LZ78_RESET_NEVER;
+            } else {
+                fprintf(stderr, "Invalid reset policy: %s\n", optarg);
+                return 3;
+            }
+            break;
+        case 'h': options->help = true; return 4;
+        default: options->help = true; return 5;
+        }
+    }
+    //The output is only truncated once --append is known not to be given.
+    if (options->output_path != NULL) {
+        int flags = options->append ? O_CREAT + O_RDWR : O_CREAT + O_WRONLY + O_TRUNC;
+        fd = open(options->output_path, flags, S_IRUSR + S_IWUSR);
+        options->output_file = fd;
+        if (fd < 0) {
+            perror(NULL);
+            return 2;
         }
     }
     return 0;
 }
 
 /*
-    Checks if fd is open (>2... -1 = NULL, 0 = stdin, 1 = stdout, 2 = stderr), and if so, closes that fd.
+    Parses a byte count with an optional K, M or G (binary) suffix into *size.
+    Returns false if arg is not such a number.
 */
-void check_null_and_close(int fd) {
-    if (fd > 2) {
-        int response = close(fd);
-        if (response < 0) {
-            perror(NULL);
+bool parse_size(const char *arg, uint64_t *size) {
+    char *end = NULL;
+    errno = 0;
+    unsigned long long value = strtoull(arg, &end, 10);
+    if (errno != 0 || end == arg || arg[0] == '-') {
+        return false;
+    }
+    int shift = 0;
+    switch (*end) {
+    case '\0': break;
+    case 'k':
+    case 'K': shift = 10; break;
+    case 'm':
+    case 'M': shift = 20; break;
+    case 'g':
+    case 'G': shift = 30; break;
+    default: return false;
+    }
+    if (shift != 0 && end[1] != '\0') {
+        return false;
+    }
+    if (value > (UINT64_MAX >> shift)) {
+        return false;
+    }
+    *size = (uint64_t) value << shift;
+    return true;
+}
+
+/*
+    Loads the preset dictionary at path, mapping the file for the one pass that parses it.
+    Exits if the file cannot be read or is not a dictionary.
+*/
+LZ78Dict *load_dict(const char *path) {
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        exit(1);
+    }
+    uint8_t *map = NULL;
+    if (st.st_size > 0) {
+        map = (uint8_t *) mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            perror(path);
+            exit(1);
+        }
+    }
+    LZ78Dict *dict;
+    int response = lz78_dict_load(&dict, map, (size_t) st.st_size);
+    if (map != NULL) {
+        munmap(map, (size_t) st.st_size);
+    }
+    close(fd);
+    if (response == LZ78_MEM_ERROR) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    if (response != LZ78_OK) {
+        fprintf(stderr, "Invalid dictionary: %s\n", path);
+        exit(1);
+    }
+    return dict;
+}
+
+/*
+    Decodes header from infile, verifies Magic number, sets permissions for outfile.
+    The header is returned through *fileheader for its format flags. An archive's members have
+    modes of their own, so outfile is left alone.
+*/
+bool read_decode_header(int infile, int outfile, FileHeader *fileheader) {
+    memset((void *) fileheader, 0, sizeof(FileHeader)); //Clears padding to avoid valgrind errors
+    read_header(infile, fileheader);
+    if (fileheader->magic != MAGIC) {
+        return false;
+    }
+    if (!(fileheader->flags & FLAG_ARCHIVE)) {
+        fchmod(outfile, (mode_t) fileheader->protection);
+    }
+    return true;
+}
+
+/*
+    Reads the ID of the preset dictionary that follows the header and loads dict_file, which must
+    be that dictionary. Exits if it is missing or another one.
+*/
+LZ78Dict *read_dict_id(int infile, const char *dict_file) {
+    uint8_t field[DICT_ID_SIZE];
+    uint32_t id = 0;
+    if (read_bytes(infile, field, DICT_ID_SIZE) != DICT_ID_SIZE) {
+        fprintf(stderr, "Corrupt file\n");
+        exit(1);
+    }
+    for (int i = 0; i < DICT_ID_SIZE; i++) {
+        id |= (uint32_t) field[i] << (BYTE * i);
+    }
+    if (dict_file == NULL) {
+        fprintf(stderr, "File needs dictionary %08x (-D)\n", id);
+        exit(1);
+    }
+    LZ78Dict *dict = load_dict(dict_file);
+    if (lz78_dict_id(dict) != id) {
+        fprintf(stderr, "Wrong dictionary: file needs %08x, %s is %08x\n", id, dict_file, lz78_dict_id(dict));
+        exit(1);
+    }
+    return dict;
+}
+
+/*
+    Bytes of the input and output buffers of encode -j (a batch of chunks, and a scratch block for
+    each thread) or --archive (a part, its block and a scratch block for each thread), 0 for a
+    single stream.
+*/
+uint64_t batch_memory(const Options *options) {
+    uint64_t block = chunk_bound(options->chunk_size, true, NULL);
+    uint64_t threads = options->threads > 0 ? options->threads : 1;
+    if (options->archive) {
+        return threads * (options->chunk_size + 2 * block);
+    }
+    return options->threads > 0 ? options->batch * (options->chunk_size + block) + threads * block : 0;
+}
+
+/*
+    Halves the I/O buffers, down to BLOCK, until they take at most a quarter of budget.
+*/
+static void fit_io(IOConfig *io, uint64_t budget) {
+    while (io_memory(io) > budget / 4 && io_buffer_size(io) > BLOCK) {
+        io->buffer_size = io_buffer_size(io) / 2;
+    }
+}
+
+/*
+    Fits a run into the budget of -m, if there is one, before anything is allocated: the I/O
+    buffers shrink (to BLOCK at least) until they take a quarter of it. With -j or --archive the
+    chunk or part buffers get another quarter, options->chunk_memory, on both sides: encode first
+    puts fewer chunks in each table, down to one per thread, then halves the chunks (to MIN_CHUNK
+    at least), and last puts fewer chunks in a table still; decode checks the file's chunks against
+    it as it reads them. Each codec stream (one per thread when parallel) gets an even share of
+    the rest in params->memory. The encoder narrows the code width
+    below -b until both its dictionary and the decoder's fit the share, so the file decodes with
+    the same -m; the decoder has to take the width of the file, and only shrinks its window.
+    Returns false, having said why, if the budget is too small.
+*/
+bool fit_memory(Options *options, LZ78Params *params, bool encoding, bool parallel) {
+    uint64_t budget = options->memory;
+    if (budget == 0) {
+        return true;
+    }
+    options->buffer_size = options->io.buffer_size;
+    fit_io(&options->io, budget);
+    uint32_t threads = options->threads > 0 ? options->threads : 1;
+    while (encoding && batch_memory(options) > budget / 4) {
+        if (!options->archive && options->batch > threads) {
+            options->batch = options->batch / 2 > threads ? options->batch / 2 : threads;
+        } else if (options->chunk_size > MIN_CHUNK) {
+            options->chunk_size /= 2;
+        } else if (!options->archive && options->batch > 1) {
+            options->batch /= 2;
+        } else {
+            fprintf(stderr, "Memory budget too small: %" PRIu64 " bytes needed\n",
+                memory_needed(options, params, true, parallel, batch_memory(options)));
+            return false;
+        }
+    }
+    options->chunk_memory = parallel ? budget / 4 : 0;
+    uint64_t fixed = io_memory(&options->io) + options->chunk_memory;
+    uint64_t streams = parallel && options->threads > 0 ? options->threads : 1;
+    uint64_t share = budget > fixed ? (budget - fixed) / streams : 0;
+    params->memory = (size_t) (share != 0 ? share : 1);
+    if (encoding) {
+        LZ78Params fitted = *params;
+        fitted.bits = params->bits != 0 ? params->bits : LZ78_DEFAULT_BITS;
+        while (fitted.bits > LZ78_MIN_BITS
+               && (lz78_memory_bound(&fitted, true) > share || lz78_memory_bound(&fitted, false) > share)) {
+            fitted.bits--;
+        }
+        params->bits = fitted.bits;
+    }
+    uint64_t needed = lz78_memory_bound(params, true);
+    if (!encoding || lz78_memory_bound(params, false) > needed) {
+        needed = lz78_memory_bound(params, false);
+    }
+    if (needed > share) {
+        fprintf(stderr, "Memory budget too small: %" PRIu64 " bytes needed\n",
+            memory_needed(options, params, encoding, parallel, 0));
+        return false;
+    }
+    return true;
+}
+
+/*
+    The smallest -m that passes the checks of fit_memory() and of the decoders, for the memory
+    budget messages: the I/O buffers shrink from -B as fit_memory() shrinks them, the buffers bytes
+    of chunks or parts take at most a quarter (which is kept for them when parallel), and the rest
+    leaves each codec stream the least it runs in, its dictionary with the smallest window, at the
+    narrowest code width when encoding and at the file's when decoding.
+*/
+uint64_t memory_needed(const Options *options, const LZ78Params *params, bool encoding, bool parallel,
+    uint64_t buffers) {
+    LZ78Params least = *params;
+    least.memory = 1;
+    if (encoding) {
+        least.bits = LZ78_MIN_BITS;
+    }
+    uint64_t codec = lz78_memory_bound(&least, false);
+    if (encoding && lz78_memory_bound(&least, true) > codec) {
+        codec = lz78_memory_bound(&least, true);
+    }
+    uint64_t streams = parallel && options->threads > 0 ? options->threads : 1;
+    uint64_t budget = 4 * buffers;
+    while (true) {
+        IOConfig io = options->io;
+        io.buffer_size = options->buffer_size;
+        fit_io(&io, budget);
+        uint64_t rest = io_memory(&io) + streams * codec;
+        if (budget >= rest + (parallel ? budget / 4 : 0)) {
+            return budget;
+        }
+        //The I/O buffers only grow with the budget, so this settles on the smallest that fits.
+        uint64_t next = parallel ? 4 * (rest - 1) / 3 + 1 : rest;
+        budget = next > budget ? next : budget + 1;
+    }
+}
+
+/*
+    Prints the statistics of -v to stderr. The compressed side is the encoder's output and the
+    decoder's input, headers included.
+*/
+void print_verbose(uint64_t compressed, uint64_t uncompressed) {
+    fprintf(stderr, "Compresssed file size: %" PRIu64 " bytes\n", compressed);
+    fprintf(stderr, "Uncompressed file size: %" PRIu64 " bytes\n", uncompressed);
+    fprintf(stderr, "Compresssion ratio: %02.02f%%\n", 100 * (1 - ((float) compressed / (float) uncompressed)));
+}
+
+/*
+    Prints the memory statistics of -v to stderr: the peak bytes of the codec's dictionary and
+    window, or the most all its threads can take when bound is set, and of the buffers.
+*/
+void print_memory(uint64_t codec, bool bound, uint64_t buffers) {
+    fprintf(stderr, "Dictionary memory: %s%" PRIu64 " bytes\n", bound ? "at most " : "", codec);
+    fprintf(stderr, "Buffer memory: %" PRIu64 " bytes\n", buffers);
+}
+
+/*
+    Prints the statistics of --stats=json to stderr as one object: sizes, I/O calls, where the
+    time went (the codec's time being what the I/O waits leave of the wall time), memory as in
+    print_memory() and, if liblz78 was built with LZ78_STATS, the codec's counters ("codec" is
+    null otherwise).
+*/
+void print_stats(const char *tool, uint64_t compressed, uint64_t uncompressed, uint64_t wall_ns,
+    const LZ78Stats *codec, uint64_t codec_memory, uint64_t buffer_memory) {
+    uint64_t wait_ns = io_stats.read_wait_ns + io_stats.write_wait_ns;
+    fprintf(stderr, "{\"tool\":\"%s\",\"compressed_bytes\":%" PRIu64 ",\"uncompressed_bytes\":%" PRIu64, tool,
+        compressed, uncompressed);
+    fprintf(stderr, ",\"ratio\":%.4f", uncompressed != 0 ? (double) compressed / (double) uncompressed : 0.0);
+    fprintf(stderr, ",\"read_calls\":%" PRIu64 ",\"write_calls\":%" PRIu64, io_stats.reads, io_stats.writes);
+    fprintf(stderr, ",\"wall_ns\":%" PRIu64 ",\"codec_ns\":%" PRIu64, wall_ns, wall_ns > wait_ns ? wall_ns - wait_ns : 0);
+    fprintf(stderr, ",\"read_wait_ns\":%" PRIu64 ",\"write_wait_ns\":%" PRIu64, io_stats.read_wait_ns,
+        io_stats.write_wait_ns);
+    fprintf(stderr, ",\"codec_memory_bytes\":%" PRIu64 ",\"buffer_memory_bytes\":%" PRIu64, codec_memory,
+        buffer_memory);
+    if (!lz78_stats_enabled()) {
+        fprintf(stderr, ",\"codec\":null}\n");
+        return;
+    }
+    uint64_t phrases = 0;
+    for (int bits = 0; bits <= LZ78_MAX_BITS; bits++) {
+        phrases += codec->phrases[bits];
+    }
+    fprintf(stderr, ",\"codec\":{\"symbols\":%" PRIu64 ",\"steps\":%" PRIu64 ",\"inserts\":%" PRIu64, codec->symbols,
+        codec->steps, codec->inserts);
+    fprintf(stderr, ",\"node_blocks\":{\"node4\":%" PRIu64 ",\"node16\":%" PRIu64 ",\"node48\":%" PRIu64
+                    ",\"node256\":%" PRIu64 "}",
+        codec->blocks[0], codec->blocks[1], codec->blocks[2], codec->blocks[3]);
+    fprintf(stderr, ",\"resets\":%" PRIu64 ",\"phrases\":%" PRIu64 ",\"phrases_by_width\":{", codec->resets, phrases);
+    const char *separator = "";
+    for (int bits = 0; bits <= LZ78_MAX_BITS; bits++) {
+        if (codec->phrases[bits] != 0) {
+            fprintf(stderr, "%s\"%d\":%" PRIu64, separator, bits, codec->phrases[bits]);
+            separator = ",";
         }
     }
+    fprintf(stderr, "},\"avg_phrase_len\":%.2f", phrases != 0 ? (double) codec->symbols / (double) phrases : 0.0);
+    fprintf(stderr, ",\"window_links\":%" PRIu64 "}}\n", codec->window_links);
 }
 
 /*
-    Gets bit length of code
+    Checks if fd is open (>2... -1 = NULL, 0 = stdin, 1 = stdout, 2 = stderr), and if so, closes that fd.
 */
-uint8_t get_bitlength(uint16_t code) {
-    uint8_t last_one_bit = 0;
-    for (uint32_t i = 0; i < sizeof(uint16_t) * BYTE; i++) {
-        if (((1 << i) & code) >> i) {
-            last_one_bit = i;
+void check_null_and_close(int fd) {
+    if (fd > 2) {
+        int response = close(fd);
+        if (response < 0) {
+            perror(NULL);
         }
     }
-    return last_one_bit + 1;
 }
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "io.h"
+#include "lz78.h"
+
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -9,11 +12,66 @@
 #include <fcntl.h>
 #include <errno.h>
 
-#define OPTIONS "i:o:vh"
+#define OPTIONS "i:o:vhb:j:c:B:l:D:n:C:m:t"
 #define BYTE    8
 
-int argparser(int argc, char **argv, int *input_file, int *output_file, bool *verbose, bool *help);
+//Command line settings shared by encode and decode.
+typedef struct Options {
+    int input_file;
+    int output_file;
+    bool verbose;
+    bool help;
+    uint32_t threads; // Worker threads for the chunked format (0 = single stream format).
+    uint32_t chunk_size; // Uncompressed bytes per chunk.
+    uint32_t batch; // encode -j: chunks per chunk table, at most CHUNK_BATCH.
+    uint64_t chunk_memory; // Bytes the chunk or part buffers may take with -m (0 = no limit).
+    uint32_t buffer_size; // -B as given, which fit_memory() shrinks io.buffer_size from.
+    LZ78Params params; // Code width, reset policy, LZW mode, index, CRC and level.
+    const char *dict_file; // Preset dictionary to load into params.dict, or NULL.
+    uint32_t phrases; // train: phrases to keep (0 = LZ78_DICT_PHRASES).
+    bool range; // Decode only range_len bytes from uncompressed offset range_start.
+    uint64_t range_start;
+    uint64_t range_len;
+    IOConfig io;
+    bool stats; // --stats=json: counters and timings as JSON on stderr.
+    const char *trace_file; // --trace: Chrome trace of the run, or NULL.
+    bool archive; // encode --archive: archive the paths after the options.
+    const char *member; // decode --member: extract only this member of an archive, or NULL.
+    const char *dir; // decode -C: directory to extract an archive under, or NULL for the current one.
+    bool flush_timed; // encode --flush-ms: end input with a sync point within flush_ms milliseconds.
+    uint32_t flush_ms;
+    bool flush_lines; // encode --flush-lines: end every read's last line with a sync point.
+    uint64_t memory; // -m: bytes the dictionaries and buffers must fit in (0 = no limit).
+    bool test; // decode -t: check the input without writing its output.
+    bool estimate; // encode --estimate: print the compressed size without writing the output.
+    bool append; // encode --append: continue the stream in the output instead of replacing it.
+    const char *output_path; // -o, opened once all options are parsed, or NULL for stdout.
+    bool count; // search --count: print the number of matches instead of each.
+    bool lines; // search --lines: report the numbers of the lines with matches, not offsets.
+} Options;
 
-void check_null_and_close(int fd);
+int argparser(int argc, char **argv, Options *options);
+
+bool parse_size(const char *arg, uint64_t *size);
+
+LZ78Dict *load_dict(const char *path);
+
+bool read_decode_header(int infile, int outfile, FileHeader *fileheader);
+
+LZ78Dict *read_dict_id(int infile, const char *dict_file);
+
+bool fit_memory(Options *options, LZ78Params *params, bool encoding, bool parallel);
 
-uint8_t get_bitlength(uint16_t code);
+uint64_t memory_needed(const Options *options, const LZ78Params *params, bool encoding, bool parallel,
+    uint64_t buffers);
+
+uint64_t batch_memory(const Options *options);
+
+void print_verbose(uint64_t compressed, uint64_t uncompressed);
+
+void print_memory(uint64_t codec, bool bound, uint64_t buffers);
+
+void print_stats(const char *tool, uint64_t compressed, uint64_t uncompressed, uint64_t wall_ns,
+    const LZ78Stats *codec, uint64_t codec_memory, uint64_t buffer_memory);
+
+void check_null_and_close(int fd);
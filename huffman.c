@@ -0,0 +1,127 @@
+#include "huffman.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define FIRST_PERIOD 32 // Symbols coded before the first rebuild.
+#define LAST_PERIOD  4096 // Longest period.
+#define FREQ_LIMIT   (1 << 16) // Counts are halved past this total, so old data fades out.
+
+/*
+    Orders leaves by weight, then by symbol, so that both sides build the same code.
+*/
+static int compare_keys(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+    Computes Huffman code lengths from the counts with the two queue method: the leaves sorted by
+    weight, and the merged nodes, which are created in weight order. Any length over HUFF_BITS
+    flattens the weights (halving them) and starts over.
+*/
+static void huff_lengths(HuffModel *m) {
+    uint32_t n = m->symbols;
+    uint64_t keys[HUFF_SYMBOLS];
+    uint64_t weight[2 * HUFF_SYMBOLS];
+    uint16_t parent[2 * HUFF_SYMBOLS];
+    uint8_t depth[2 * HUFF_SYMBOLS];
+    for (uint32_t shift = 0;; shift++) {
+        for (uint32_t i = 0; i < n; i++) {
+            keys[i] = (uint64_t) ((m->freq[i] >> shift) + 1) << 16 | i;
+        }
+        qsort(keys, n, sizeof(uint64_t), compare_keys);
+
+        //Nodes 0..n-1 are the sorted leaves, n.. the merged nodes in creation order.
+        for (uint32_t i = 0; i < n; i++) {
+            weight[i] = keys[i] >> 16;
+        }
+        uint32_t leaf = 0;
+        uint32_t merged = n;
+        for (uint32_t next = n; next < 2 * n - 1; next++) {
+            uint32_t pick[2];
+            for (int k = 0; k < 2; k++) {
+                if (leaf < n && (merged == next || weight[leaf] <= weight[merged])) {
+                    pick[k] = leaf++;
+                } else {
+                    pick[k] = merged++;
+                }
+            }
+            weight[next] = weight[pick[0]] + weight[pick[1]];
+            parent[pick[0]] = (uint16_t) next;
+            parent[pick[1]] = (uint16_t) next;
+        }
+
+        uint8_t longest = 0;
+        depth[2 * n - 2] = 0;
+        for (uint32_t i = 2 * n - 2; i-- > 0;) {
+            depth[i] = depth[parent[i]] + 1;
+            if (i < n && depth[i] > longest) {
+                longest = depth[i];
+            }
+        }
+        if (longest <= HUFF_BITS) {
+            for (uint32_t i = 0; i < n; i++) {
+                m->len[keys[i] & 0xFFFF] = depth[i];
+            }
+            return;
+        }
+    }
+}
+
+/*
+    Assigns canonical codes (shorter codes first, then by symbol) from the lengths, bit reversed,
+    and fills the decoding table: a code of length len owns every index whose low len bits are it.
+*/
+static void huff_codes(HuffModel *m) {
+    uint32_t count[HUFF_BITS + 1] = { 0 };
+    uint32_t next[HUFF_BITS + 1];
+    for (uint32_t i = 0; i < m->symbols; i++) {
+        count[m->len[i]]++;
+    }
+    uint32_t code = 0;
+    count[0] = 0;
+    for (int len = 1; len <= HUFF_BITS; len++) {
+        code = (code + count[len - 1]) << 1;
+        next[len] = code;
+    }
+    for (uint32_t i = 0; i < m->symbols; i++) {
+        int len = m->len[i];
+        uint32_t canonical = next[len]++;
+        uint32_t reversed = 0;
+        for (int b = 0; b < len; b++) {
+            reversed |= ((canonical >> b) & 1) << (len - 1 - b);
+        }
+        m->code[i] = (uint16_t) reversed;
+        for (uint32_t index = reversed; index < (1 << HUFF_BITS); index += 1 << len) {
+            m->table[index] = (uint16_t) (i << 4 | len);
+        }
+    }
+}
+
+void huff_rebuild(HuffModel *m) {
+    if (m->total > FREQ_LIMIT) {
+        m->total = 0;
+        for (uint32_t i = 0; i < m->symbols; i++) {
+            m->freq[i] >>= 1;
+            m->total += m->freq[i];
+        }
+    }
+    huff_lengths(m);
+    huff_codes(m);
+    if (m->period < LAST_PERIOD) {
+        m->period *= 2;
+    }
+    m->until = m->period;
+}
+
+void huff_init(HuffModel *m, uint32_t symbols) {
+    m->symbols = symbols;
+    m->total = 0;
+    memset(m->freq, 0, sizeof(m->freq));
+    huff_lengths(m);
+    huff_codes(m);
+    m->period = FIRST_PERIOD;
+    m->until = FIRST_PERIOD;
+}
@@ -0,0 +1,73 @@
+#ifndef __HUFFMAN_H__
+#define __HUFFMAN_H__
+
+#include "bitio.h"
+
+#include <stdint.h>
+
+#define HUFF_BITS    11 // Longest code, and the index width of the decoding table.
+#define HUFF_SYMBOLS 256 // Largest alphabet.
+
+//
+// Adaptive Huffman model shared by an encoder and a decoder.
+//
+// Both sides count the symbols they code and rebuild the same length-limited canonical code from
+// the counts every period symbols, so no table is ever transmitted. The period starts short and
+// doubles up to a limit, so the code follows the data quickly and is then rebuilt rarely. Codes
+// are stored bit reversed, matching the LSB first accumulator, and the decoder resolves a symbol
+// with one lookup of the next HUFF_BITS bits.
+//
+typedef struct HuffModel {
+    uint32_t symbols;
+    uint32_t until; // Symbols left before the next rebuild.
+    uint32_t period;
+    uint32_t total; // Sum of freq, kept under a limit by halving.
+    uint32_t freq[HUFF_SYMBOLS];
+    uint16_t code[HUFF_SYMBOLS];
+    uint8_t len[HUFF_SYMBOLS];
+    uint16_t table[1 << HUFF_BITS]; // Next HUFF_BITS bits -> symbol << 4 | code length.
+} HuffModel;
+
+//
+// Starts m over with every one of symbols symbols equally likely.
+//
+void huff_init(HuffModel *m, uint32_t symbols);
+
+//
+// Rebuilds the code from the counts.
+//
+void huff_rebuild(HuffModel *m);
+
+//
+// Counts sym, rebuilding the code when the period is over.
+//
+static inline void huff_update(HuffModel *m, uint32_t sym) {
+    m->freq[sym]++;
+    m->total++;
+    if (--m->until == 0) {
+        huff_rebuild(m);
+    }
+}
+
+//
+// Adds the code of sym through bits_put(). Returns its length.
+//
+static inline int huff_put(HuffModel *m, BitAccumulator *a, uint8_t *buf, uint32_t *pos, uint32_t sym) {
+    int len = m->len[sym];
+    bits_put(a, buf, pos, m->code[sym], len);
+    huff_update(m, sym);
+    return len;
+}
+
+//
+// Removes and returns the next symbol. The caller must have refilled HUFF_BITS bits.
+//
+static inline uint32_t huff_take(HuffModel *m, BitAccumulator *a) {
+    uint16_t entry = m->table[a->acc & ((1 << HUFF_BITS) - 1)];
+    uint32_t sym = entry >> 4;
+    bits_take(a, entry & 0xF);
+    huff_update(m, sym);
+    return sym;
+}
+
+#endif
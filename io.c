@@ -1,46 +1,31 @@
+#define _GNU_SOURCE // O_DIRECT
+
 #include "io.h"
 #include "endian.h"
-#include "code.h"
+#include "trace.h"
 
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <math.h>
+#include <poll.h>
 #include <assert.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define FILE_ERROR -1
+#define IO_PENDING INT32_MIN // Reader buffer with a read in flight.
 
 #define BYTE 8
 
-//Buffer struct that stores
-// ptr (buffer)
-// index
-// length
-//of the buffer.
-typedef struct Buffer {
-    uint8_t ptr[BLOCK];
-    uint32_t index;
-    uint32_t length;
-} Buffer;
-
-typedef uint16_t Bit;
-
-//Two buffers, one for symbols and one for the pairs
-static Buffer syms_buffer;
-static Buffer pairs_buffer;
-
 uint64_t total_syms = 0; // To count the symbols processed.
 uint64_t total_bits = 0; // To count the bits processed.
+IOStats io_stats = { 0 };
 
 void check_swap_endian_header(FileHeader *header);
-void check_print_file_error(int response);
-void flush_and_reset_buffer_to_file(int outfile, Buffer *buffer, uint64_t to_write);
-void clear_and_reset_buffer_from_file(int infile, Buffer *buffer, uint64_t to_read);
-void write_bits(int outfile, uint16_t bits, int bitlen);
-void write_single_bit(Bit bit, int block, int position);
-Bit get_single_bit(uint16_t bits, uint8_t bit_offset);
 
 /*
     This function reads *to_read* number of bytes from file *infile* and places them in the buffer *buf*
@@ -55,9 +40,10 @@ int read_bytes(int infile, uint8_t *buf, int to_read) {
     uint8_t *curr_buf = buf;
     do {
         bytes_read = (int) read(infile, curr_buf, to_read);
+        __atomic_fetch_add(&io_stats.reads, 1, __ATOMIC_RELAXED); // Archive threads read files at once.
         total_bytes_read += bytes_read;
         to_read -= bytes_read;
-        curr_buf += (uint8_t) bytes_read;
+        curr_buf += bytes_read;
         if (bytes_read < 0) {
             return FILE_ERROR;
         }
@@ -75,9 +61,10 @@ int write_bytes(int outfile, uint8_t *buf, int to_write) {
     uint8_t *curr_buf = buf;
     do {
         bytes_written = (int) write(outfile, curr_buf, to_write);
+        __atomic_fetch_add(&io_stats.writes, 1, __ATOMIC_RELAXED);
         total_byte_written += bytes_written;
         to_write -= bytes_written;
-        curr_buf += (uint8_t) bytes_written;
+        curr_buf += bytes_written;
         if (bytes_written < 0) {
             return FILE_ERROR;
         }
@@ -92,6 +79,7 @@ void check_swap_endian_header(FileHeader *header) {
     if (big_endian()) {
         header->magic = swap32(header->magic);
         header->protection = swap16(header->protection);
+        header->flags = swap16(header->flags);
     }
     return;
 }
@@ -128,172 +116,617 @@ void write_header(int outfile, FileHeader *header) {
 }
 
 /*
-    Flushes *to_write* bytes from *buffer* into *outfile* and sets buffer->index to zero.
+    Aborts through check_print_file_error with errno set to err.
 */
-void flush_and_reset_buffer_to_file(int outfile, Buffer *buffer, uint64_t to_write) {
-    total_bits += BYTE * to_write;
-    int response = write_bytes(outfile, buffer->ptr, (int) to_write);
-    memset(buffer->ptr, 0, BLOCK);
-    buffer->index = 0;
-    check_print_file_error(response);
+static void fail_with(int err) {
+    errno = err;
+    check_print_file_error(FILE_ERROR);
 }
 
 /*
-    Clears buffer by reading new bytes into buffer.
-    Reads *to_read* (or less as returned by read_bytes) bytes and places them into *buffer*.
-    Resets buffer->index to zero and buffer->length to # of bytes read to ensure no going over bytes read.
+    Turns O_DIRECT on or off for fd. Returns false if the file system refuses.
 */
-void clear_and_reset_buffer_from_file(int infile, Buffer *buffer, uint64_t to_read) {
-    memset(buffer->ptr, 0, BLOCK);
-    int response = read_bytes(infile, buffer->ptr, to_read);
-    check_print_file_error(response);
+static bool set_direct(int fd, bool on) {
+#ifdef O_DIRECT
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0) {
+        return false;
+    }
+    flags = on ? (flags | O_DIRECT) : (flags & ~O_DIRECT);
+    return fcntl(fd, F_SETFL, flags) == 0;
+#else
+    (void) fd;
+    return !on;
+#endif
+}
 
-    buffer->index = 0;
-    buffer->length = response;
-    total_syms += response;
+/*
+    Allocates count buffers of size bytes aligned for O_DIRECT.
+*/
+static bool alloc_buffers(uint8_t **buffers, uint32_t count, uint32_t size) {
+    for (uint32_t i = 0; i < count; i++) {
+        void *buffer = NULL;
+        if (posix_memalign(&buffer, IO_ALIGN, size) != 0) {
+            return false;
+        }
+        buffers[i] = (uint8_t *) buffer;
+    }
+    return true;
 }
 
 /*
-    Reads symbol in amoritzed time by calling 
+    Buffer size from the config, rounded up to IO_ALIGN when O_DIRECT is requested.
 */
-bool read_sym(int infile, uint8_t *sym) {
-    int response = 1;
-    if (syms_buffer.index == 0 || syms_buffer.index == syms_buffer.length) {
-        response = read_bytes(infile, syms_buffer.ptr, BLOCK);
-        check_print_file_error(response);
+uint32_t io_buffer_size(const IOConfig *config) {
+    uint32_t size = config->backend == IO_THREAD ? IO_THREAD_SIZE : IO_BUFFER_SIZE;
+    if (config->buffer_size != 0) {
+        size = config->buffer_size;
+    }
+    if (config->direct) {
+        size = (size + IO_ALIGN - 1) / IO_ALIGN * IO_ALIGN;
+    }
+    return size;
+}
+
+/*
+    The reader and the writer each hold IO_DEPTH buffers with the io_uring and thread backends, and
+    one otherwise (none for a mapped input, which is not counted).
+*/
+size_t io_memory(const IOConfig *config) {
+    size_t count = config->backend == IO_URING || config->backend == IO_THREAD ? IO_DEPTH : 1;
+    return 2 * count * io_buffer_size(config);
+}
 
-        syms_buffer.index = 0;
-        syms_buffer.length = response;
-        total_syms += response;
+/*
+    Issues the read for buffer i at the reader's offset through io_uring.
+*/
+static void reader_submit(Reader *r, uint32_t i) {
+    r->results[i] = IO_PENDING;
+    if (!ring_submit(r->ring, false, r->fd, r->buffers[i], r->buffer_size, r->offset, i)) {
+        fail_with(EIO);
     }
+    r->offset += r->buffer_size;
+    r->in_flight++;
+    io_stats.reads++;
+}
+
+static void *reader_thread(void *arg);
 
-    *sym = syms_buffer.ptr[syms_buffer.index];
-    syms_buffer.index = syms_buffer.index + 1;
+/*
+    Picks the backend and prepares r.
+    Regular files get a sequential access hint and are read at explicit offsets from the current
+    position; with O_DIRECT the first read starts at the aligned offset below it and skips ahead.
+*/
+bool reader_open(Reader *r, int fd, const IOConfig *config) {
+    struct stat st;
+    memset(r, 0, sizeof(Reader));
+    r->fd = fd;
+    r->held = -1;
+    r->buffer_size = io_buffer_size(config);
+    r->backend = config->backend == IO_AUTO ? IO_MMAP : config->backend;
+    r->regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+    off_t start = r->regular ? lseek(fd, 0, SEEK_CUR) : -1;
+    if (start < 0) {
+        r->regular = false;
+        r->stream = config->stream;
+        r->backend = r->backend == IO_THREAD && !r->stream ? IO_THREAD : IO_SYNC;
+    } else {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        r->offset = (uint64_t) start;
+    }
+
+    if (r->backend == IO_MMAP) {
+        r->backend = IO_SYNC;
+        if (st.st_size > start) {
+            void *map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                madvise(map, (size_t) st.st_size, MADV_SEQUENTIAL);
+                r->map = (uint8_t *) map;
+                r->map_len = (size_t) st.st_size;
+                r->span = r->map + start;
+                r->span_len = (size_t) (st.st_size - start);
+                r->backend = IO_MMAP;
+                r->eof = true;
+                return true;
+            }
+        }
+    }
+
+    if (config->direct && r->regular && set_direct(fd, true)) {
+        r->direct = true;
+        r->skip = (uint32_t) (r->offset % IO_ALIGN);
+        r->offset -= r->skip;
+    }
 
-    if (response == 0) {
+    if (r->backend == IO_URING) {
+        r->ring = r->regular ? ring_create(IO_DEPTH) : NULL;
+        if (r->ring == NULL) {
+            r->backend = IO_SYNC;
+        }
+    }
+
+    uint32_t count = r->backend == IO_URING || r->backend == IO_THREAD ? IO_DEPTH : 1;
+    if (!alloc_buffers(r->buffers, count, r->buffer_size)) {
+        reader_close(r);
         return false;
     }
+    if (r->backend == IO_URING) {
+        for (uint32_t i = 0; i < IO_DEPTH; i++) {
+            reader_submit(r, i);
+        }
+    }
+    if (r->backend == IO_THREAD) {
+        r->pipeline = pipeline_create(IO_DEPTH);
+        if (r->pipeline == NULL || pthread_create(&r->thread, NULL, reader_thread, r) != 0) {
+            pipeline_delete(r->pipeline);
+            r->pipeline = NULL;
+            r->backend = IO_SYNC;
+        }
+    }
     return true;
 }
 
 /*
-    Places *bit* into *position* of *bits*
+    Reads the next buffer's worth of input into buf, blocking. Returns the number of bytes read,
+    fewer than the buffer size only at end of file, unless streaming: then whatever one read()
+    returns, 0 at end of file.
 */
-uint16_t read_single_bit_with_position(uint16_t bits, Bit bit, int position) {
-    return (uint16_t) (bit << position) | bits;
+static size_t read_buffer(Reader *r, uint8_t *buf) {
+    size_t got = 0;
+    if (r->stream) {
+        ssize_t n;
+        do {
+            n = read(r->fd, buf, r->buffer_size);
+            io_stats.reads++;
+        } while (n < 0 && errno == EINTR);
+        if (n < 0) {
+            check_print_file_error(FILE_ERROR);
+        }
+        got = (size_t) n;
+    } else if (!r->regular) {
+        int response = read_bytes(r->fd, buf, (int) r->buffer_size);
+        check_print_file_error(response);
+        got = (size_t) response;
+    } else {
+        while (got < r->buffer_size) {
+            ssize_t n = pread(r->fd, buf + got, r->buffer_size - got, (off_t) (r->offset + got));
+            io_stats.reads++;
+            if (n < 0) {
+                check_print_file_error(FILE_ERROR);
+            }
+            got += (size_t) n;
+            if (n == 0 || (r->direct && got % IO_ALIGN != 0)) {
+                break;
+            }
+        }
+        r->offset += got;
+    }
+    return got;
+}
+
+/*
+    Reads the next buffer synchronously. Returns the number of bytes read.
+*/
+static size_t reader_fill_sync(Reader *r) {
+    size_t got = read_buffer(r, r->buffers[0]);
+    if (got == 0 || (got < r->buffer_size && !r->stream)) {
+        r->eof = true;
+    }
+    return got;
+}
+
+/*
+    Thread body: fills buffers in file order as fast as the codec frees them, until end of file
+    or until reader_close stops the pipeline.
+*/
+static void *reader_thread(void *arg) {
+    Reader *r = (Reader *) arg;
+    int32_t i;
+    while ((i = pipeline_claim(r->pipeline)) >= 0) {
+        size_t got = read_buffer(r, r->buffers[i]);
+        pipeline_publish(r->pipeline, (int64_t) got);
+        if (got < r->buffer_size) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+    Takes the next buffer the reader thread filled, handing the previous one back to it.
+    Returns the number of bytes read.
+*/
+static size_t reader_fill_thread(Reader *r) {
+    if (r->held >= 0) {
+        pipeline_release(r->pipeline);
+    }
+    int64_t got;
+    r->held = (int32_t) pipeline_take(r->pipeline, &got);
+    if ((uint64_t) got < r->buffer_size) {
+        r->eof = true;
+    }
+    return (size_t) got;
+}
+
+/*
+    Takes the next buffer in file order from io_uring, handing the previous one back for
+    the read after the last one issued. Returns the number of bytes read.
+*/
+static size_t reader_fill_uring(Reader *r) {
+    if (r->held >= 0 && !r->eof) {
+        reader_submit(r, (uint32_t) r->held);
+    }
+    uint32_t i = r->next;
+    while (r->results[i] == IO_PENDING) {
+        uint64_t tag;
+        int32_t result;
+        if (!ring_wait(r->ring, &tag, &result)) {
+            fail_with(errno);
+        }
+        r->results[tag] = result;
+        r->in_flight--;
+    }
+    if (r->results[i] < 0) {
+        fail_with(-r->results[i]);
+    }
+    if ((uint32_t) r->results[i] < r->buffer_size) {
+        r->eof = true;
+    }
+    r->held = (int32_t) i;
+    r->next = (i + 1) % IO_DEPTH;
+    return (size_t) r->results[i];
 }
 
 /*
-    This function is highly complex. Given more time, I would definitely refactor this.
-    An overview: Reads *bitlen* bits from pairs_buffer (or infile) and place those bits into *bits*.
-    It does so bit by bit. 
-    Of course, the retreival of data from disk is done in sizes of BLOCK. 
-    This is checked if pairs_buffer.index == 0 (No data retreived yet) or pairs_buffer.index == (BLOCK*BYTE) (Buffer full).
+    Moves the next run of input into r->span, timing the wait.
 */
-void read_bits(int infile, uint16_t *bits, int bitlen) {
-    int block = pairs_buffer.index / BYTE;
-    int position = pairs_buffer.index % BYTE;
-    int original_position = position;
+static void reader_fill(Reader *r) {
+    size_t got;
+    if (r->backend == IO_MMAP) {
+        return;
+    }
+    uint64_t start = trace_now();
+    if (r->backend == IO_URING) {
+        if (r->eof && r->in_flight == 0 && r->results[r->next] == 0) {
+            return;
+        }
+        got = reader_fill_uring(r);
+        r->span = r->buffers[r->held];
+    } else if (r->backend == IO_THREAD) {
+        if (r->eof) {
+            return;
+        }
+        got = reader_fill_thread(r);
+        r->span = r->buffers[r->held];
+    } else {
+        if (r->eof) {
+            return;
+        }
+        got = reader_fill_sync(r);
+        r->span = r->buffers[0];
+    }
+    uint32_t skip = got < r->skip ? (uint32_t) got : r->skip;
+    r->span += skip;
+    r->span_len = got - skip;
+    r->skip = 0;
+    uint64_t end = trace_now();
+    io_stats.read_wait_ns += end - start;
+    trace_span("read", start, end, "bytes", got);
+}
 
-    for (int i = 0; i < bitlen; i++) {
-        if (pairs_buffer.index == 0 || pairs_buffer.index == (BLOCK * BYTE)) {
-            clear_and_reset_buffer_from_file(infile, &pairs_buffer, BLOCK);
-            block = 0;
+/*
+    Hands out everything not yet handed out, refilling first if that is nothing.
+*/
+size_t reader_next(Reader *r, const uint8_t **data) {
+    while (r->span_len == 0) {
+        bool more = !r->eof || (r->backend == IO_URING && r->in_flight > 0);
+        if (!more) {
+            return 0;
         }
-        *bits = read_single_bit_with_position(*bits,
-            get_single_bit(pairs_buffer.ptr[block], position % BYTE), position - original_position);
-        pairs_buffer.index = pairs_buffer.index + 1;
+        reader_fill(r);
+    }
+    size_t len = r->span_len;
+    *data = r->span;
+    r->span += len;
+    r->span_len = 0;
+    return len;
+}
+
+/*
+    Polls streamed input, whose reads are the only ones that may block once issued.
+*/
+bool reader_wait(Reader *r, int timeout_ms) {
+    if (r->span_len > 0 || r->eof || !r->stream) {
+        return true;
+    }
+    struct pollfd fds = { .fd = r->fd, .events = POLLIN };
+    int ready;
+    do {
+        ready = poll(&fds, 1, timeout_ms);
+    } while (ready < 0 && errno == EINTR);
+    return ready != 0;
+}
 
-        if (position == 15 || position == 7) {
-            block++;
+/*
+    Copies input into buf until len bytes are copied or the input ends.
+*/
+size_t reader_read(Reader *r, uint8_t *buf, size_t len) {
+    size_t copied = 0;
+    while (copied < len) {
+        if (r->span_len == 0) {
+            bool more = !r->eof || (r->backend == IO_URING && r->in_flight > 0);
+            if (!more) {
+                break;
+            }
+            reader_fill(r);
+            continue;
         }
-        position++;
+        size_t n = len - copied < r->span_len ? len - copied : r->span_len;
+        memcpy(buf + copied, r->span, n);
+        r->span += n;
+        r->span_len -= n;
+        copied += n;
     }
+    return copied;
 }
 
 /*
-    Reads bits from infile and places into of code and sym appropriately. Bitlen is bitlength of code.
-    If code is STOP_CODE, returns false indicating the end of the file.
+    Drains io_uring, stops the reader thread, undoes O_DIRECT and releases buffers and mappings.
+    The thread may be blocked in read() on a pipe with nothing more to come, so it is cancelled
+    rather than waited for.
 */
-bool read_pair(int infile, uint16_t *code, uint8_t *sym, int bitlen) {
-    *code = 0;
-    read_bits(infile, code, bitlen);
+void reader_close(Reader *r) {
+    if (r->pipeline != NULL) {
+        pipeline_stop(r->pipeline);
+        pthread_cancel(r->thread);
+        pthread_join(r->thread, NULL);
+        pipeline_delete(r->pipeline);
+    }
+    while (r->in_flight > 0) {
+        uint64_t tag;
+        int32_t result;
+        if (!ring_wait(r->ring, &tag, &result)) {
+            break;
+        }
+        r->in_flight--;
+    }
+    ring_delete(r->ring);
+    if (r->direct) {
+        set_direct(r->fd, false);
+    }
+    if (r->map != NULL) {
+        munmap(r->map, r->map_len);
+    }
+    for (uint32_t i = 0; i < IO_DEPTH; i++) {
+        free(r->buffers[i]);
+    }
+    memset(r, 0, sizeof(Reader));
+    r->fd = -1;
+}
 
-    if (*code == STOP_CODE) {
-        return false;
+static void *writer_thread(void *arg);
+
+/*
+    Picks the backend and prepares w.
+    With O_DIRECT the first buffer is shortened so that later writes start on IO_ALIGN boundaries.
+*/
+bool writer_open(Writer *w, int fd, const IOConfig *config) {
+    struct stat st;
+    memset(w, 0, sizeof(Writer));
+    w->fd = fd;
+    w->buffer_size = io_buffer_size(config);
+    w->backend = config->backend == IO_URING || config->backend == IO_THREAD ? config->backend : IO_SYNC;
+    w->regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+
+    off_t start = w->regular ? lseek(fd, 0, SEEK_CUR) : -1;
+    if (start < 0) {
+        w->regular = false;
+        w->backend = w->backend == IO_THREAD ? IO_THREAD : IO_SYNC;
+    } else {
+        w->offset = (uint64_t) start;
     }
-    uint16_t temp_sym = 0;
-    read_bits(infile, &temp_sym, sizeof(uint8_t) * BYTE);
 
-    *sym = (uint8_t) temp_sym;
+    if (config->direct && w->regular && set_direct(fd, true)) {
+        w->direct = true;
+    }
+    if (w->backend == IO_URING) {
+        w->ring = ring_create(IO_DEPTH);
+        if (w->ring == NULL) {
+            w->backend = IO_SYNC;
+        }
+    }
 
+    uint32_t count = w->backend == IO_URING || w->backend == IO_THREAD ? IO_DEPTH : 1;
+    if (!alloc_buffers(w->buffers, count, w->buffer_size)) {
+        writer_close(w);
+        return false;
+    }
+    w->capacity = w->buffer_size - (w->direct ? (uint32_t) (w->offset % IO_ALIGN) : 0);
+    if (w->backend == IO_THREAD) {
+        w->thread_offset = w->offset;
+        w->pipeline = pipeline_create(IO_DEPTH);
+        if (w->pipeline == NULL || pthread_create(&w->thread, NULL, writer_thread, w) != 0) {
+            pipeline_delete(w->pipeline);
+            w->pipeline = NULL;
+            w->backend = IO_SYNC;
+        }
+    }
     return true;
 }
 
 /*
-    Gets single bit from *bits* in position *bit_offset* and returns it (As a Bit).
+    Waits for one io_uring write and retires its buffer.
+    Writes to regular files complete in full unless the device fails.
 */
-Bit get_single_bit(uint16_t bits, uint8_t bit_offset) {
-    return (Bit) (bits >> bit_offset) & 1;
+static void writer_reap(Writer *w) {
+    uint64_t tag;
+    int32_t result;
+    if (!ring_wait(w->ring, &tag, &result)) {
+        fail_with(errno);
+    }
+    if (result < 0) {
+        fail_with(-result);
+    }
+    w->busy[tag] = false;
+    w->in_flight--;
 }
 
 /*
-    Writes *bit* into pairs_buffer at byte *block* and bit *position* in that block.
+    Writes len bytes of buf at offset with pwrite() (or write() for pipes).
+    Unaligned O_DIRECT writes, the first and last, are made with O_DIRECT switched off.
 */
-void write_single_bit(Bit bit, int block, int position) {
-    pairs_buffer.ptr[block] &= ~(1 << position);
-    pairs_buffer.ptr[block] |= (bit << position);
+static void writer_write_sync(Writer *w, uint8_t *buf, uint32_t len, uint64_t offset) {
+    if (!w->regular) {
+        check_print_file_error(write_bytes(w->fd, buf, (int) len));
+        return;
+    }
+    bool unaligned = w->direct && (offset % IO_ALIGN != 0 || len % IO_ALIGN != 0);
+    if (unaligned) {
+        set_direct(w->fd, false);
+    }
+    uint32_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(w->fd, buf + done, len - done, (off_t) (offset + done));
+        io_stats.writes++;
+        if (n < 0) {
+            check_print_file_error(FILE_ERROR);
+        }
+        done += (uint32_t) n;
+    }
+    if (unaligned) {
+        set_direct(w->fd, true);
+    }
 }
 
 /*
-    Writes bits bit by bit from *bits* up to *bitlen* to *outfile*. 
+    Thread body: writes buffers out in order as the codec fills them, until the empty one
+    writer_close sends last.
 */
-void write_bits(int outfile, uint16_t bits, int bitlen) {
-    for (int i = 0; i < bitlen; i++) {
-        if (pairs_buffer.index == (BLOCK * BYTE)) {
-            flush_pairs(outfile);
+static void *writer_thread(void *arg) {
+    Writer *w = (Writer *) arg;
+    for (;;) {
+        int64_t len;
+        uint32_t i = pipeline_take(w->pipeline, &len);
+        if (len == 0) {
+            return NULL;
         }
-
-        int block = pairs_buffer.index / BYTE;
-        int position = pairs_buffer.index % BYTE;
-        Bit bit = get_single_bit(bits, i);
-        write_single_bit(bit, block, position);
-        pairs_buffer.index = pairs_buffer.index + 1;
+        writer_write_sync(w, w->buffers[i], (uint32_t) len, w->thread_offset);
+        w->thread_offset += (uint64_t) len;
+        pipeline_release(w->pipeline);
     }
 }
 
 /*
-    Writes *code* and *sym* into outfile. Bitlen is bit length of code.  
+    Writes out the current buffer and moves on to a free one, timing the wait.
 */
-void write_pair(int outfile, uint16_t code, uint8_t sym, int bitlen) {
-    write_bits(outfile, code, bitlen);
-    write_bits(outfile, (uint16_t) sym, sizeof(uint8_t) * BYTE);
+static void writer_submit(Writer *w) {
+    uint32_t len = w->used;
+    if (len == 0) {
+        return;
+    }
+    uint64_t start = trace_now();
+    uint8_t *buf = w->buffers[w->current];
+    bool aligned = !w->direct || (w->offset % IO_ALIGN == 0 && len % IO_ALIGN == 0);
+    if (w->backend == IO_THREAD) {
+        pipeline_publish(w->pipeline, len);
+        w->current = (uint32_t) pipeline_claim(w->pipeline);
+    } else if (w->backend == IO_URING && aligned) {
+        if (!ring_submit(w->ring, true, w->fd, buf, len, w->offset, w->current)) {
+            fail_with(EIO);
+        }
+        w->busy[w->current] = true;
+        w->in_flight++;
+        io_stats.writes++;
+        w->current = (w->current + 1) % IO_DEPTH;
+        while (w->busy[w->current]) {
+            writer_reap(w);
+        }
+    } else {
+        while (w->in_flight > 0) {
+            writer_reap(w);
+        }
+        writer_write_sync(w, buf, len, w->offset);
+    }
+    w->offset += len;
+    w->used = 0;
+    w->capacity = w->buffer_size;
+    uint64_t end = trace_now();
+    io_stats.write_wait_ns += end - start;
+    trace_span("write", start, end, "bytes", len);
 }
 
 /*
-    Flushes pairs_buffer to *outfile*
+    Hands out the free tail of the current buffer, submitting it first if it is full.
 */
-void flush_pairs(int outfile) {
-    flush_and_reset_buffer_to_file(outfile, &pairs_buffer, (pairs_buffer.index / BYTE));
+uint8_t *writer_reserve(Writer *w, size_t *len) {
+    if (w->used == w->capacity) {
+        writer_submit(w);
+    }
+    *len = w->capacity - w->used;
+    return w->buffers[w->current] + w->used;
 }
 
 /*
-    Writes Word *w* to *outfile* (or buffer).
+    Accounts for bytes placed in the reserved space.
 */
-void write_word(int outfile, Word *w) {
-    if (w->len + syms_buffer.index >= BLOCK) {
-        flush_words(outfile);
+void writer_commit(Writer *w, size_t len) {
+    w->used += (uint32_t) len;
+    if (w->used == w->capacity) {
+        writer_submit(w);
     }
+}
 
-    for (uint32_t i = 0; i < w->len; i++) {
-        syms_buffer.ptr[syms_buffer.index] = w->syms[i];
-        syms_buffer.index = syms_buffer.index + 1;
+/*
+    Copies buf into the output buffers.
+*/
+void writer_write(Writer *w, const uint8_t *buf, size_t len) {
+    while (len > 0) {
+        size_t room;
+        uint8_t *dest = writer_reserve(w, &room);
+        size_t n = len < room ? len : room;
+        memcpy(dest, buf, n);
+        writer_commit(w, n);
+        buf += n;
+        len -= n;
     }
 }
 
 /*
-    Flushes words in syms_buffer to outfile.  
+    Submits the current buffer, partly filled as it may be.
+*/
+void writer_flush(Writer *w) {
+    writer_submit(w);
+}
+
+/*
+    Writes the last buffer, waits for io_uring or the writer thread and leaves the fd after the
+    output.
 */
-void flush_words(int outfile) {
-    flush_and_reset_buffer_to_file(outfile, &syms_buffer, syms_buffer.index);
+void writer_close(Writer *w) {
+    if (w->buffers[0] != NULL) {
+        writer_submit(w);
+    }
+    uint64_t start = trace_now();
+    if (w->pipeline != NULL) {
+        pipeline_publish(w->pipeline, 0);
+        pthread_join(w->thread, NULL);
+        pipeline_delete(w->pipeline);
+    }
+    while (w->in_flight > 0) {
+        writer_reap(w);
+    }
+    io_stats.write_wait_ns += trace_now() - start;
+    ring_delete(w->ring);
+    if (w->direct) {
+        set_direct(w->fd, false);
+    }
+    if (w->regular) {
+        lseek(w->fd, (off_t) w->offset, SEEK_SET);
+    }
+    for (uint32_t i = 0; i < IO_DEPTH; i++) {
+        free(w->buffers[i]);
+    }
+    memset(w, 0, sizeof(Writer));
+    w->fd = -1;
 }
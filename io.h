@@ -1,20 +1,90 @@
 #ifndef __IO_H__
 #define __IO_H__
 
-#include "word.h"
+#include "lz78.h"
+#include "pipeline.h"
+#include "uring.h"
+#include <pthread.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-#define BLOCK 4096 // 4KB blocks.
-#define MAGIC 0xBAADBAAC // Unique encoder/decoder magic number.
+#define BLOCK          4096 // 4KB blocks.
+#define IO_BUFFER_SIZE (1 << 16) // Default Reader/Writer buffer size.
+#define IO_DEPTH       4 // Buffers in flight with the io_uring and thread backends.
+#define IO_THREAD_SIZE (1 << 20) // Default buffer size with the thread backend.
+#define IO_ALIGN       4096 // Buffer, offset and length alignment required by O_DIRECT.
+
+//Reader/Writer backends. Each falls back to IO_SYNC when the fd does not support it
+//(pipes, terminals, mmap for output, kernels without io_uring).
+//IO_THREAD works on any fd: a thread of its own does the read() or write() calls, a ring of
+//IO_DEPTH buffers ahead of or behind the codec, so I/O waits overlap coding.
+typedef enum IOBackend { IO_AUTO, IO_SYNC, IO_MMAP, IO_URING, IO_THREAD } IOBackend;
+
+typedef struct IOConfig {
+    IOBackend backend; // IO_AUTO maps regular input files and uses read()/write() otherwise.
+    uint32_t buffer_size; // Bytes per buffer (0 = IO_BUFFER_SIZE, or IO_THREAD_SIZE with IO_THREAD).
+    bool direct; // Bypass the page cache with O_DIRECT where the file system allows it.
+    bool stream; // Hand out pipe and socket input as each read() returns it, with IO_SYNC, for low latency.
+} IOConfig;
+
+//Buffered input from an fd, starting at its current position.
+typedef struct Reader {
+    int fd;
+    IOBackend backend; // Backend actually in use.
+    bool regular; // Regular file: read with explicit offsets.
+    bool direct;
+    bool stream; // Pipe or socket read a read() at a time (IOConfig.stream).
+    bool eof; // No more reads will be issued.
+    uint32_t buffer_size;
+    uint64_t offset; // File offset of the next read (owned by the reader thread with IO_THREAD).
+    uint32_t skip; // Bytes before the start position in the first (aligned) read.
+    uint8_t *map;
+    size_t map_len;
+    uint8_t *buffers[IO_DEPTH];
+    int32_t results[IO_DEPTH]; // Bytes read into each buffer, or IO_PENDING.
+    uint32_t next; // Buffer handed out next.
+    int32_t held; // Buffer currently handed out to the caller, or -1.
+    uint32_t in_flight;
+    const uint8_t *span; // Data not yet handed out.
+    size_t span_len;
+    Ring *ring;
+    Pipeline *pipeline; // Hands filled buffers from the reader thread.
+    pthread_t thread;
+} Reader;
+
+//Buffered output to an fd, starting at its current position.
+typedef struct Writer {
+    int fd;
+    IOBackend backend;
+    bool regular;
+    bool direct;
+    uint32_t buffer_size;
+    uint64_t offset; // File offset of the next write.
+    uint8_t *buffers[IO_DEPTH];
+    bool busy[IO_DEPTH]; // Buffer is being written by io_uring.
+    uint32_t current; // Buffer being filled.
+    uint32_t used;
+    uint32_t capacity; // Usable bytes of the current buffer.
+    uint32_t in_flight;
+    Ring *ring;
+    Pipeline *pipeline; // Hands full buffers to the writer thread.
+    pthread_t thread;
+    uint64_t thread_offset; // File offset of the writer thread's next write.
+} Writer;
 
 extern uint64_t total_syms; // To count the symbols processed.
 extern uint64_t total_bits; // To count the bits processed.
 
-typedef struct FileHeader {
-    uint32_t magic;
-    uint16_t protection;
-} FileHeader;
+//I/O counters for --stats. The waits are the time the codec spent blocked on a Reader or Writer.
+typedef struct IOStats {
+    uint64_t reads; // read() and pread() calls and io_uring reads.
+    uint64_t writes; // write() and pwrite() calls and io_uring writes.
+    uint64_t read_wait_ns;
+    uint64_t write_wait_ns;
+} IOStats;
+
+extern IOStats io_stats;
 
 //
 // Read up to to_read bytes from infile and store them in buf. Return the number of bytes actually
@@ -36,108 +106,112 @@ int read_bytes(int infile, uint8_t *buf, int to_read);
 int write_bytes(int outfile, uint8_t *buf, int to_write);
 
 //
-// Read a file header from infile into *header.
+// Print the error and abort if response (from read_bytes or write_bytes) signals a file error.
 //
-// This function need not create any additional buffer to store the contents of the file header.
-// File headers, like any struct or any value in C, are just represented by bytes in memory which
-// means you can use read_bytes to read however many bytes the header consumes (use sizeof!) into
-// *header.
+void check_print_file_error(int response);
+
 //
-// Since we decided that the canonical byte order for our headers is little-endian, this function
-// will need to swap the byte order of both the header fields if it is run on a big-endian system.
-// For example, here is how the 4 bytes of the magic number will look when written to the file:
+// Bytes per Reader or Writer buffer with config.
 //
-// +------+------+------+------+
-// | 0xAC | 0xBA | 0xAD | 0xBA |
-// +------+------+------+------+
+uint32_t io_buffer_size(const IOConfig *config);
+
 //
-// A big-endian computer would interpret those bytes as the 4-byte number 0xACBAADBA, which is
-// not what we want, so you would have to change the order of those bytes in memory. A little-endian
-// computer will interpret that as 0xBAADBAAC.
+// Most bytes of buffers a Reader and a Writer opened with config allocate.
 //
-// This function should also make sure the magic number is correct. Since it has no return value you
-// may call assert() to do that, or print out an error message and exit the program, or use some
-// other way to report the error.
+size_t io_memory(const IOConfig *config);
+
 //
-void read_header(int infile, FileHeader *header);
+// Set up r to read fd from its current position with the configured backend.
+// Returns false if the buffers could not be allocated.
+//
+bool reader_open(Reader *r, int fd, const IOConfig *config);
 
 //
-// Write a file header from *header to outfile. Like above, this function should swap the byte order
-// of the header's two fields if necessary.
+// Hand out the next run of input bytes through *data and return its length, 0 at end of file.
+// The bytes stay valid until the next call. File errors abort like check_print_file_error.
 //
-void write_header(int outfile, FileHeader *header);
+size_t reader_next(Reader *r, const uint8_t **data);
 
 //
-// Read one symbol from infile into *sym. Return true if a symbol was successfully read, false
-// otherwise.
+// Copy up to len bytes of input into buf. Returns fewer than len only at end of file.
 //
-// Reading one symbol at a time is slow, so this function will need to maintain a global buffer
-// (an array) of BLOCK bytes. Most calls will only need to read a symbol out of that buffer, and
-// then update some counter so that the function knows what position in the buffer it is at. If
-// there are no more bytes in the buffer for it to return, it will have to call read_bytes to refill
-// the buffer with fresh data. If this call fails then you cannot read a symbol and should return
-// false.
+size_t reader_read(Reader *r, uint8_t *buf, size_t len);
+
+//
+// Wait up to timeout_ms milliseconds (-1 for ever) for input, and return whether reader_next would
+// return without blocking. Only streamed input may block; other input is always ready.
 //
-bool read_sym(int infile, uint8_t *sym);
+bool reader_wait(Reader *r, int timeout_ms);
 
 //
-// Write a pair -- bitlen bits of code, followed by all 8 bits of sym -- to outfile.
+// Wait for outstanding reads, undo O_DIRECT and free r's buffers.
+//
+void reader_close(Reader *r);
+
 //
-// This function should also use a buffer. It writes into individual bits in the buffer, starting
-// with the least significant bit of the first byte, until the most significant bit of the first
-// byte, and then the least significant bit of the second byte, and so on. You will need bitwise
-// arithmetic to manipulate individual bits within your buffer -- consult asgn3/set.c if you don't
-// remember how to do this.
+// Set up w to write fd from its current position with the configured backend.
+// Returns false if the buffers could not be allocated.
 //
-// The first bit of code to be written is the least significant bit, and the same holds for sym.
+bool writer_open(Writer *w, int fd, const IOConfig *config);
+
 //
-// This function will need to track which *bit* in the buffer will be written to next. If it ever
-// reaches the end of the buffer it needs to write out the contents of the buffer to outfile; you
-// may use flush_pairs to do this.
+// Return free space in the current output buffer and its size through *len (never 0).
+// Fill some of it and pass the count to writer_commit.
 //
-void write_pair(int outfile, uint16_t code, uint8_t sym, int bitlen);
+uint8_t *writer_reserve(Writer *w, size_t *len);
 
 //
-// Write any pairs that are in write_pair's buffer but haven't been written yet to outfile.
+// Mark len bytes of the space from writer_reserve as written.
 //
-// This function will need to be called at the end of encode since otherwise those pairs would never
-// be written. You don't have to, but it would be easy to make this function also work when called
-// by write_pair, since otherwise you would write essentially the same code in two places.
+void writer_commit(Writer *w, size_t len);
+
 //
-// If not all bits of the last byte in your buffer have been written to, make sure that the
-// unwritten bits are set to zero. An easy way to do this is by zeroing the entire buffer after
-// flushing it every time.
+// Copy len bytes from buf into the output.
 //
-void flush_pairs(int outfile);
+void writer_write(Writer *w, const uint8_t *buf, size_t len);
 
 //
-// Read bitlen bits of a code into *code, and then a full 8-bit symbol into *sym, from infile.
-// Return true if the complete pair was read and false otherwise.
+// Start writing everything buffered so far now, for a reader at the other end of a pipe or socket,
+// rather than once a buffer fills.
 //
-// Like write_pair, this function must read the least significant bit of each input byte first, and
-// will store those bits into the LSB of *code and of *sym first.
+void writer_flush(Writer *w);
+
 //
-// It may be useful to write a helper function that reads a single bit from a file using a buffer.
+// Write everything still buffered, wait for outstanding writes and free w's buffers. The fd is
+// left positioned after the last byte written.
 //
-bool read_pair(int infile, uint16_t *code, uint8_t *sym, int bitlen);
+void writer_close(Writer *w);
 
 //
-// Write every symbol from w into outfile.
+// Read a file header from infile into *header.
 //
-// These symbols should also be buffered and the buffer flushed whenever necessary (note you will
-// likely sometimes fill up your buffer in the middle of writing a word, so you cannot only check
-// that the buffer is full at the end of this function).
+// This function need not create any additional buffer to store the contents of the file header.
+// File headers, like any struct or any value in C, are just represented by bytes in memory which
+// means you can use read_bytes to read however many bytes the header consumes (use sizeof!) into
+// *header.
 //
-void write_word(int outfile, Word *w);
-
+// Since we decided that the canonical byte order for our headers is little-endian, this function
+// will need to swap the byte order of both the header fields if it is run on a big-endian system.
+// For example, here is how the 4 bytes of the magic number will look when written to the file:
 //
-// Write any unwritten word symbols from the buffer used by write_word to outfile.
+// +------+------+------+------+
+// | 0xAC | 0xBA | 0xAD | 0xBA |
+// +------+------+------+------+
 //
-// Similarly to flush_pairs, this function must be called at the end of decode since otherwise you
-// would have symbols remaining in the buffer that were never written.
+// A big-endian computer would interpret those bytes as the 4-byte number 0xACBAADBA, which is
+// not what we want, so you would have to change the order of those bytes in memory. A little-endian
+// computer will interpret that as 0xBAADBAAC.
+//
+// This function should also make sure the magic number is correct. Since it has no return value you
+// may call assert() to do that, or print out an error message and exit the program, or use some
+// other way to report the error.
 //
-void flush_words(int outfile);
+void read_header(int infile, FileHeader *header);
 
-void write_bits(int outfile, uint16_t bits, int bitlen);
+//
+// Write a file header from *header to outfile. Like above, this function should swap the byte order
+// of the header's two fields if necessary.
+//
+void write_header(int outfile, FileHeader *header);
 
 #endif
@@ -0,0 +1,293 @@
+#include "lz78.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DICT_SAMPLE (1 << 16) // Bytes of each file that a dictionary is trained on.
+#define PATTERN_LEN 6 // Bytes of each file searched for.
+#define DAMAGE_LEN  4096 // Least input damaged, for the middle of its stream to lie in the pairs.
+
+//Parameters each file is round tripped with, by lz78_compress() and by streams.
+typedef struct Case {
+    const char *name;
+    LZ78Params params;
+} Case;
+
+static const Case cases[] = {
+    { "defaults", { 0 } },
+    { "raw", { .raw = true } },
+    { "-b 9", { .bits = 9 } },
+    { "-b 24 -l 2", { .bits = 24, .level = LZ78_LEVEL_HUFFMAN } },
+    { "-l 1 --crc", { .level = LZ78_LEVEL_PHASED, .checksum = true } },
+    { "--lzw -l 2", { .lzw = true, .level = LZ78_LEVEL_HUFFMAN } },
+    { "--lzw -b 9 --reset=adaptive", { .lzw = true, .bits = 9, .reset = LZ78_RESET_ADAPTIVE } },
+    { "-b 12 --reset=never", { .bits = 12, .reset = LZ78_RESET_NEVER } },
+    { "--index=64K --crc", { .index_interval = 1 << 16, .checksum = true } },
+    { "--append -l 2", { .append = true, .level = LZ78_LEVEL_HUFFMAN } },
+};
+
+static uint32_t failures;
+
+static void fail(const char *path, const char *name, const char *what, int response) {
+    fprintf(stderr, "FAIL: %s: %s: %s (%d)\n", path, name, what, response);
+    failures++;
+}
+
+static uint8_t *read_file(const char *path, size_t *len) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *buf = (uint8_t *) malloc(size > 0 ? (size_t) size : 1);
+    *len = buf != NULL && size > 0 ? fread(buf, 1, (size_t) size, file) : 0;
+    fclose(file);
+    return buf;
+}
+
+/*
+    Runs s, an initialized encoder or decoder, over src into dst a few bytes at a time, the input
+    and output both handed over in pieces of step bytes. Returns the last response, with the
+    output's size in *dst_len.
+*/
+static int run_stream(LZ78Stream *s, bool encoding, uint8_t *dst, size_t *dst_len, const uint8_t *src,
+    size_t src_len, size_t step) {
+    size_t in = 0;
+    size_t out = 0;
+    int response = LZ78_OK;
+    while (response == LZ78_OK) {
+        size_t give = src_len - in < step ? src_len - in : step;
+        size_t room = *dst_len - out < step ? *dst_len - out : step;
+        s->next_in = src + in;
+        s->avail_in = give;
+        s->next_out = dst + out;
+        s->avail_out = room;
+        bool last = in + give == src_len;
+        response = encoding ? lz78_encode(s, last ? LZ78_FINISH : 0) : lz78_decode(s, last ? LZ78_FINISH : 0);
+        in += give - s->avail_in;
+        out += room - s->avail_out;
+        if (response == LZ78_OK && give == s->avail_in && room == s->avail_out) {
+            response = LZ78_BUF_ERROR;
+        }
+    }
+    *dst_len = out;
+    return response;
+}
+
+/*
+    Compresses src with lz78_compress() into lz78_compress_bound() bytes and back, checks that an
+    encoder and a decoder fed a few bytes at a time give the same bytes, that a discarding encoder
+    counts as many, and that a stream cut short, or with a CRC and a byte changed, is rejected.
+*/
+static void check_case(const char *path, const Case *c, const uint8_t *src, size_t len, uint8_t *unpacked) {
+    const LZ78Params *params = &c->params;
+    size_t bound = lz78_compress_bound(len, params);
+    uint8_t *packed = (uint8_t *) malloc(bound);
+    uint8_t *streamed = (uint8_t *) malloc(bound);
+    size_t packed_len = bound;
+    int response = packed != NULL && streamed != NULL ? lz78_compress(packed, &packed_len, src, len, params)
+                                                      : LZ78_MEM_ERROR;
+    if (response != LZ78_OK) {
+        fail(path, c->name, "lz78_compress() into lz78_compress_bound() bytes", response);
+        free(packed);
+        free(streamed);
+        return;
+    }
+    size_t unpacked_len = len;
+    response = lz78_decompress(unpacked, &unpacked_len, packed, packed_len, params);
+    if (response != LZ78_OK || unpacked_len != len || memcmp(src, unpacked, len) != 0) {
+        fail(path, c->name, "lz78_decompress()", response);
+    }
+
+    LZ78Stream s;
+    size_t streamed_len = bound;
+    response = lz78_encode_init(&s, params);
+    if (response == LZ78_OK) {
+        response = run_stream(&s, true, streamed, &streamed_len, src, len, 7);
+        lz78_encode_end(&s);
+    }
+    if (response != LZ78_STREAM_END || streamed_len != packed_len
+        || memcmp(streamed, packed, packed_len) != 0) {
+        fail(path, c->name, "lz78_encode() 7 bytes at a time differs from lz78_compress()", response);
+    }
+    unpacked_len = len;
+    response = lz78_decode_init(&s, params);
+    if (response == LZ78_OK) {
+        response = run_stream(&s, false, unpacked, &unpacked_len, packed, packed_len, 5);
+        lz78_decode_end(&s);
+    }
+    if (response != LZ78_STREAM_END || unpacked_len != len || memcmp(src, unpacked, len) != 0) {
+        fail(path, c->name, "lz78_decode() 5 bytes at a time", response);
+    }
+
+    LZ78Params discard = *params;
+    discard.discard = true;
+    response = lz78_encode_init(&s, &discard);
+    if (response == LZ78_OK) {
+        s.next_in = src;
+        s.avail_in = len;
+        response = lz78_encode(&s, LZ78_FINISH);
+        if (response != LZ78_STREAM_END || s.total_out != packed_len) {
+            fail(path, c->name, "discarding lz78_encode() miscounts", response);
+        }
+        lz78_encode_end(&s);
+    }
+
+    if (len >= DAMAGE_LEN && !params->append) {
+        unpacked_len = len;
+        response = lz78_decompress(unpacked, &unpacked_len, packed, packed_len / 2, params);
+        if (response == LZ78_OK) {
+            fail(path, c->name, "lz78_decompress() of half the stream", response);
+        }
+    }
+    if (len >= DAMAGE_LEN && params->checksum) {
+        packed[packed_len / 2] ^= 0x40;
+        unpacked_len = len;
+        response = lz78_decompress(unpacked, &unpacked_len, packed, packed_len, params);
+        if (response == LZ78_OK) {
+            fail(path, c->name, "lz78_decompress() with a byte changed", response);
+        }
+    }
+    free(packed);
+    free(streamed);
+}
+
+/*
+    Reads slices of an indexed stream with lz78_decompress_range(), against the bytes of src.
+*/
+static void check_range(const char *path, const uint8_t *src, size_t len, uint8_t *unpacked) {
+    LZ78Params params = { .index_interval = 1 << 16 };
+    size_t packed_len = lz78_compress_bound(len, &params);
+    uint8_t *packed = (uint8_t *) malloc(packed_len);
+    int response = packed != NULL ? lz78_compress(packed, &packed_len, src, len, &params) : LZ78_MEM_ERROR;
+    if (response != LZ78_OK) {
+        fail(path, "range", "lz78_compress() with an index", response);
+        free(packed);
+        return;
+    }
+    const size_t starts[] = { 0, 1, len / 3, (1 << 16) - 1, 1 << 16, len > 10 ? len - 10 : 0, len };
+    for (size_t i = 0; i < sizeof(starts) / sizeof(starts[0]); i++) {
+        size_t start = starts[i] < len ? starts[i] : len;
+        size_t want = len - start < 70000 ? len - start : 70000;
+        size_t got = 70000;
+        response = lz78_decompress_range(unpacked, &got, packed, packed_len, start, &params);
+        if (response != LZ78_OK || got != want || memcmp(src + start, unpacked, want) != 0) {
+            fail(path, "range", "lz78_decompress_range()", response);
+        }
+    }
+    free(packed);
+}
+
+/*
+    Trains a dictionary on the start of src, for lzw or not, and round trips src with it, which a
+    stream without it must refuse.
+*/
+static void check_dict(const char *path, const uint8_t *src, size_t len, bool lzw, uint8_t *unpacked) {
+    LZ78Params params = { .bits = 12, .lzw = lzw };
+    size_t dict_len = lz78_dict_bound(1024);
+    uint8_t *serialized = (uint8_t *) malloc(dict_len);
+    LZ78Dict *dict = NULL;
+    size_t sample = len < DICT_SAMPLE ? len : DICT_SAMPLE;
+    int response = lz78_dict_train(serialized, &dict_len, src, sample, 1024, &params);
+    if (response == LZ78_OK) {
+        response = lz78_dict_load(&dict, serialized, dict_len);
+    }
+    free(serialized);
+    if (response != LZ78_OK || !lz78_dict_fits(dict, &params)) {
+        fail(path, "dict", "lz78_dict_train() and lz78_dict_load()", response);
+        lz78_dict_free(dict);
+        return;
+    }
+    params.dict = dict;
+    size_t packed_len = lz78_compress_bound(len, &params);
+    uint8_t *packed = (uint8_t *) malloc(packed_len);
+    response = packed != NULL ? lz78_compress(packed, &packed_len, src, len, &params) : LZ78_MEM_ERROR;
+    size_t unpacked_len = len;
+    if (response == LZ78_OK) {
+        response = lz78_decompress(unpacked, &unpacked_len, packed, packed_len, &params);
+    }
+    if (response != LZ78_OK || unpacked_len != len || memcmp(src, unpacked, len) != 0) {
+        fail(path, "dict", "round trip with a dictionary", response);
+    }
+    params.dict = NULL;
+    unpacked_len = len;
+    response = lz78_decompress(unpacked, &unpacked_len, packed, packed_len, &params);
+    if (response != LZ78_DICT_ERROR) {
+        fail(path, "dict", "lz78_decompress() without the dictionary", response);
+    }
+    free(packed);
+    lz78_dict_free(dict);
+}
+
+static void count_match(void *opaque, uint64_t offset, uint64_t line) {
+    (void) offset;
+    (void) line;
+    (*(uint64_t *) opaque)++;
+}
+
+/*
+    Searches the compressed src for bytes from its middle with lz78_search(), which must find as
+    many matches, overlapping ones included, as a scan of src.
+*/
+static void check_search(const char *path, const uint8_t *src, size_t len) {
+    if (len < PATTERN_LEN) {
+        return;
+    }
+    const uint8_t *pattern = src + len / 2;
+    uint64_t expected = 0;
+    for (size_t i = 0; i + PATTERN_LEN <= len; i++) {
+        expected += memcmp(src + i, pattern, PATTERN_LEN) == 0;
+    }
+    LZ78Params params = { .level = LZ78_LEVEL_HUFFMAN };
+    size_t packed_len = lz78_compress_bound(len, &params);
+    uint8_t *packed = (uint8_t *) malloc(packed_len);
+    int response = packed != NULL ? lz78_compress(packed, &packed_len, src, len, &params) : LZ78_MEM_ERROR;
+    uint64_t found = 0;
+    params.pattern = pattern;
+    params.pattern_len = PATTERN_LEN;
+    params.match = count_match;
+    params.opaque = &found;
+    if (response == LZ78_OK) {
+        response = lz78_search(packed, packed_len, &params);
+    }
+    if (response != LZ78_OK || found != expected) {
+        fail(path, "search", "lz78_search() miscounts", response);
+    }
+    free(packed);
+}
+
+/*
+    Checks the library's one-shot, streaming, range, dictionary and search calls on each file given.
+*/
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s file...\n", argv[0]);
+        return 2;
+    }
+    for (int i = 1; i < argc; i++) {
+        size_t len;
+        uint8_t *src = read_file(argv[i], &len);
+        if (src == NULL) {
+            perror(argv[i]);
+            return 2;
+        }
+        uint8_t *unpacked = (uint8_t *) malloc(len > 70000 ? len : 70000);
+        if (unpacked == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            return 2;
+        }
+        for (size_t j = 0; j < sizeof(cases) / sizeof(cases[0]); j++) {
+            check_case(argv[i], &cases[j], src, len, unpacked);
+        }
+        check_range(argv[i], src, len, unpacked);
+        check_dict(argv[i], src, len, false, unpacked);
+        check_dict(argv[i], src, len, true, unpacked);
+        check_search(argv[i], src, len);
+        free(unpacked);
+        free(src);
+    }
+    return failures == 0 ? 0 : 1;
+}
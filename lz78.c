@@ -0,0 +1,2000 @@
+#include "lz78.h"
+#include "bitio.h"
+#include "code.h"
+#include "crc32c.h"
+#include "dict.h"
+#include "huffman.h"
+#include "match.h"
+#include "trie.h"
+#include "word.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BYTE         8
+#define STAGING      4096 // Encoder output staging buffer.
+#define RESET_WINDOW (1 << 16) // Input bytes per window of the adaptive reset policy.
+#define RESET_STREAK 2 // Degraded windows in a row that trigger an adaptive reset.
+#define CRC_SIZE     4 // Bytes of the CRC32C after the final byte of a FLAG_CRC stream.
+#define CODE_SLICES  64 // LZ78_LEVEL_HUFFMAN: parts of the code space told apart by the code model.
+#define WINDOW_SIZE  (1 << 22) // Smallest decoder output window.
+#define WIDTH_CHANGE 2 // Internal: a kernel stopped at the end of its code width.
+
+//Inlined into each caller, so that a constant width argument specializes the body.
+#define KERNEL static inline __attribute__((always_inline))
+
+//Every width next_code can have, from START_CODE's up to LZ78_MAX_BITS, for the kernels
+//instantiated per width at LZ78_LEVEL_PLAIN.
+#define FOR_EACH_WIDTH(X) \
+    X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) X(16) X(17) X(18) X(19) \
+    X(20) X(21) X(22) X(23) X(24)
+
+//Decoder: a code's phrase, as its place in the output and as its parent phrase plus a symbol.
+typedef struct Phrase {
+    uint64_t pos; // Output offset of the phrase's first byte where it was last output.
+    uint32_t len;
+    uint32_t link; // Parent code | last symbol << 24, for a phrase that has left the window.
+} Phrase;
+
+//Per-stream codec state.
+struct LZ78State {
+    bool encoding;
+    bool raw;
+    bool lzw;
+    bool finished; // Encoder: the STOP pair has been staged. Decoder: STOP_CODE was read.
+    bool sync; // FLAG_SYNC: a bit after each STOP tells a sync point from the end.
+    uint32_t sync_span; // FLAG_SYNC: least bits from a sync point's STOP to its end (see sync_span()).
+    uint64_t sync_position; // Encoder: input offset of the last sync point.
+
+    //Header bytes (and dictionary ID), staged by the encoder or collected by the decoder.
+    uint8_t header[LZ78_HEADER_SIZE + DICT_ID_SIZE];
+    uint32_t header_len;
+
+    //CRC32C of the input (encoder) or output (decoder) so far, and the stream's own once read.
+    bool checksum;
+    bool partial; // Decoder: seeked, so the output is not the whole stream and cannot be checked.
+    uint32_t crc;
+    uint8_t trailer[CRC_SIZE];
+    uint32_t trailer_len;
+
+    BitAccumulator acc;
+    uint8_t level; // Entropy stage, LZ78_LEVEL_*.
+    HuffModel literals; // LZ78_LEVEL_HUFFMAN: symbols of pairs.
+    HuffModel codes; // LZ78_LEVEL_HUFFMAN: slices of the code space that codes fall in.
+    uint8_t bits;
+    uint8_t reset;
+    const LZ78Dict *dict; // Preset dictionary, or NULL.
+    uint32_t start_code; // First code assigned after a reset.
+    uint32_t next_code;
+    uint32_t max_code;
+    size_t memory; // Most bytes the stream may take, 0 for no limit.
+    bool discard; // Count the output in total_out without producing it.
+    bool append; // Encoder: end with an append trailer.
+    uint64_t out_base; // Encoder: bytes of the stream before this encoder's, when resumed.
+
+    //Encoder
+    Trie *trie;
+    TrieNode *current_node;
+    TrieNode *previous_node;
+    uint8_t previous_sym;
+    uint8_t staging[STAGING];
+    uint32_t staging_pos;
+    uint32_t staging_len;
+
+    //Encoder, adaptive reset: output bits of the window starting at input byte window_start, and
+    //of the history_len input bytes coded since the last reset.
+    uint64_t window_start;
+    uint64_t window_bits;
+    uint64_t history_bits;
+    uint64_t history_len;
+    uint32_t degraded_windows;
+
+    //Encoder, index: boundaries as (bit offset, uncompressed offset) pairs, and the footer
+    //serialized from them once the stream ends.
+    bool indexed; // Encoder: record boundaries. Decoder: the stream has FLAG_INDEX.
+    bool index_failed; // An index allocation failed.
+    uint64_t index_interval; // Input bytes between forced boundaries, 0 for none.
+    uint64_t index_position; // Uncompressed offset of the last boundary.
+    uint64_t *index;
+    uint32_t index_len;
+    uint32_t index_capacity;
+    uint8_t *footer;
+    uint32_t footer_pos;
+    uint32_t footer_len;
+
+    //Decoder: phrases by code, and the latest output, from output offset window_offset on.
+    Phrase *phrases;
+    uint8_t *window;
+    size_t window_len;
+    size_t window_size;
+    uint64_t window_offset;
+    const uint8_t *pending;
+    uint32_t pending_len;
+    uint32_t pad_bits; // Zero bits appended to the accumulator past the end of the input.
+    size_t crc_len; // Discarding with a CRC: the window is checksummed up to here.
+    uint32_t previous_code; // LZW: the previous code, or STOP_CODE at the start of a dictionary.
+    uint64_t previous_pos; // LZW: output offset of the previous code's phrase.
+    uint32_t code_peak; // Most codes assigned before the last reset.
+
+    //Decoder, search: the pattern and hook until the code space is known, then the matcher.
+    uint8_t pattern[LZ78_MAX_PATTERN];
+    uint32_t pattern_len;
+    void (*match)(void *opaque, uint64_t offset, uint64_t line);
+    Matcher *matcher;
+
+    //Counters (with LZ78_STATS) for the caller's, and the hook told where each epoch ends.
+    LZ78Stats stats;
+    LZ78Stats *stats_sink;
+    void (*epoch)(void *opaque, uint64_t start, uint64_t end);
+    void *opaque;
+    uint64_t epoch_start; // Uncompressed offset where the dictionary last started over.
+};
+
+/*
+    Sets up the code space for the stream's width, mode and dictionary.
+*/
+static void codes_init(LZ78State *st) {
+    st->start_code = st->dict != NULL ? st->dict->next_code : st->lzw ? LZW_START_CODE : START_CODE;
+    st->next_code = st->start_code;
+    st->max_code = max_code(st->bits);
+}
+
+/*
+    Whether the preset dictionary was built for the stream's mode, with its codes below the width.
+*/
+static bool dict_fits(const LZ78State *st) {
+    return st->dict->lzw == st->lzw && st->dict->bits <= st->bits;
+}
+
+/*
+    Bits to refill before take_code() with n codes, and before take_literal().
+*/
+static inline int code_bits(const LZ78State *st, uint32_t n) {
+    return st->level == LZ78_LEVEL_HUFFMAN ? HUFF_BITS + get_bitlength(n) : get_bitlength(n);
+}
+
+static inline int literal_bits(const LZ78State *st) {
+    return st->level == LZ78_LEVEL_HUFFMAN ? HUFF_BITS : BYTE;
+}
+
+/*
+    Least bits a sync point spans from the start of its STOP pair (STOP_CODE in LZW mode). At the
+    entropy levels codes may be shorter than the bits the decoder refills to read them, so it
+    refills the longest pair and the sync bit before every pair of a stream with FLAG_SYNC, and
+    the sync point's zero bits run on for that long. At LZ78_LEVEL_PLAIN pairs are exactly as long
+    as the decoder reads, and the zero bits only run to the next byte.
+*/
+static int sync_span(const LZ78State *st) {
+    if (st->level == LZ78_LEVEL_PLAIN) {
+        return 0;
+    }
+    return code_bits(st, st->max_code) + (st->lzw ? 0 : literal_bits(st)) + 1;
+}
+
+/*
+    Bytes of the decoder's output window for codes below max_code: WINDOW_SIZE or, for wider codes,
+    four times the longest phrase, unless memory (if not 0) is too small for that and the phrase
+    table. The window then takes what is left, down to four times the longest phrase.
+*/
+static size_t window_bytes(uint32_t max_code, size_t memory) {
+    size_t least = 4 * ((size_t) max_code + 1);
+    size_t size = least < WINDOW_SIZE ? WINDOW_SIZE : least;
+    size_t fixed = sizeof(LZ78State) + (size_t) max_code * sizeof(Phrase);
+    if (memory != 0 && fixed + size > memory) {
+        size = memory > fixed + least ? memory - fixed : least;
+    }
+    return size;
+}
+
+/*
+    lz78_memory_bound() of a stream whose codes are up to bits wide.
+*/
+static size_t memory_bound(uint8_t bits, bool encoding, size_t memory) {
+    if (encoding) {
+        return sizeof(LZ78State) + trie_size(bits);
+    }
+    uint32_t max = max_code(bits);
+    return sizeof(LZ78State) + (size_t) max * sizeof(Phrase) + window_bytes(max, memory);
+}
+
+size_t lz78_memory_bound(const LZ78Params *params, bool encoding) {
+    uint8_t bits = params != NULL && params->bits != 0 ? params->bits : LZ78_DEFAULT_BITS;
+    return memory_bound(bits, encoding, params != NULL ? params->memory : 0);
+}
+
+/*
+    Whether the stream's code width fits its memory limit.
+*/
+static bool memory_fits(const LZ78State *st) {
+    return st->memory == 0 || memory_bound(st->bits, st->encoding, st->memory) <= st->memory;
+}
+
+/*
+    Allocates the shared part of a stream's state.
+    A decoder that reads a header checks its dictionary against the header instead.
+*/
+static int state_create(LZ78Stream *s, const LZ78Params *params, bool encoding) {
+    s->next_in = NULL;
+    s->avail_in = 0;
+    s->total_in = 0;
+    s->next_out = NULL;
+    s->avail_out = 0;
+    s->total_out = 0;
+    memset(&s->header, 0, sizeof(FileHeader));
+    s->state = (LZ78State *) calloc(1, sizeof(LZ78State));
+    if (s->state == NULL) {
+        return LZ78_MEM_ERROR;
+    }
+    s->state->encoding = encoding;
+    s->state->raw = params != NULL && params->raw;
+    s->state->bits = params != NULL && params->bits != 0 ? params->bits : LZ78_DEFAULT_BITS;
+    s->state->reset = params != NULL ? params->reset : LZ78_RESET_FIXED;
+    s->state->lzw = params != NULL && params->lzw;
+    s->state->dict = params != NULL ? params->dict : NULL;
+    codes_init(s->state);
+    s->state->checksum = params != NULL && params->checksum;
+    s->state->level = params != NULL ? params->level : LZ78_LEVEL_PLAIN;
+    s->state->append = encoding && params != NULL && params->append;
+    s->state->sync = params != NULL && (params->sync || s->state->append);
+    s->state->sync_span = s->state->sync ? (uint32_t) sync_span(s->state) : 0;
+    s->state->indexed = params != NULL && (params->index || params->index_interval != 0);
+    s->state->index_interval = params != NULL ? params->index_interval : 0;
+    s->state->stats_sink = params != NULL ? params->stats : NULL;
+    s->state->epoch = params != NULL ? params->epoch : NULL;
+    s->state->opaque = params != NULL ? params->opaque : NULL;
+    s->state->memory = params != NULL ? params->memory : 0;
+    s->state->pattern_len = params != NULL && params->pattern != NULL ? params->pattern_len : 0;
+    s->state->match = params != NULL ? params->match : NULL;
+    s->state->discard = (params != NULL && params->discard) || s->state->pattern_len != 0;
+    bool sized = encoding || s->state->raw;
+    if (s->state->bits < LZ78_MIN_BITS || s->state->bits > LZ78_MAX_BITS
+        || s->state->reset > LZ78_RESET_NEVER || s->state->level > LZ78_LEVEL_HUFFMAN
+        || (s->state->index_interval != 0 && s->state->index_interval < LZ78_MIN_INTERVAL)
+        || (s->state->append && s->state->indexed)
+        || (params != NULL && params->pattern != NULL
+            && (encoding || params->pattern_len == 0 || params->pattern_len > LZ78_MAX_PATTERN || params->match == NULL))
+        || (s->state->dict != NULL && sized && !dict_fits(s->state))
+        || (sized && !memory_fits(s->state))) {
+        free(s->state);
+        s->state = NULL;
+        return LZ78_PARAM_ERROR;
+    }
+    if (s->state->pattern_len != 0) {
+        memcpy(s->state->pattern, params->pattern, s->state->pattern_len);
+    }
+    return LZ78_OK;
+}
+
+/*
+    Ends the dictionary epoch that started at epoch_start at uncompressed offset position, for the
+    epoch hook.
+*/
+static void epoch_end(LZ78State *st, uint64_t position) {
+    if (st->epoch != NULL) {
+        st->epoch(st->opaque, st->epoch_start, position);
+    }
+    st->epoch_start = position;
+}
+
+/*
+    Adds the stream's counters to the caller's. The sum is atomic, field by field, as streams on
+    other threads may share them; every field of LZ78Stats is a uint64_t.
+*/
+static void stats_flush(LZ78State *st) {
+#ifdef LZ78_STATS
+    if (st->stats_sink == NULL) {
+        return;
+    }
+    if (st->trie != NULL) {
+        memcpy(st->stats.blocks, st->trie->blocks, sizeof(st->stats.blocks));
+    }
+    const uint64_t *from = (const uint64_t *) &st->stats;
+    uint64_t *to = (uint64_t *) st->stats_sink;
+    for (size_t i = 0; i < sizeof(LZ78Stats) / sizeof(uint64_t); i++) {
+        __atomic_fetch_add(&to[i], from[i], __ATOMIC_RELAXED);
+    }
+#else
+    (void) st;
+#endif
+}
+
+bool lz78_stats_enabled(void) {
+#ifdef LZ78_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+    Little-endian fields of the index footer.
+*/
+static void store_le(uint8_t *buf, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        buf[i] = (uint8_t) (value >> (BYTE * i));
+    }
+}
+
+static uint64_t load_le(const uint8_t *buf, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value |= (uint64_t) buf[i] << (BYTE * i);
+    }
+    return value;
+}
+
+/*
+    Serializes a header as its little-endian fields.
+*/
+static void header_pack(const FileHeader *header, uint8_t *buf) {
+    for (int i = 0; i < 4; i++) {
+        buf[i] = (uint8_t) (header->magic >> (BYTE * i));
+    }
+    buf[4] = (uint8_t) header->protection;
+    buf[5] = (uint8_t) (header->protection >> BYTE);
+    buf[6] = (uint8_t) header->flags;
+    buf[7] = (uint8_t) (header->flags >> BYTE);
+}
+
+static void header_unpack(FileHeader *header, const uint8_t *buf) {
+    header->magic = 0;
+    for (int i = 0; i < 4; i++) {
+        header->magic |= (uint32_t) buf[i] << (BYTE * i);
+    }
+    header->protection = (uint16_t) (buf[4] | buf[5] << BYTE);
+    header->flags = (uint16_t) (buf[6] | buf[7] << BYTE);
+}
+
+/*
+    The defaults are recorded as 0, so such files match those written before the parameters
+    were configurable.
+*/
+uint16_t lz78_header_flags(const LZ78Params *params) {
+    uint16_t flags = 0;
+    if (params->bits != 0 && params->bits != LZ78_DEFAULT_BITS) {
+        flags |= (uint16_t) (params->bits << FLAG_BITS_SHIFT);
+    }
+    flags |= (uint16_t) (params->reset << FLAG_RESET_SHIFT);
+    if (params->lzw) {
+        flags |= FLAG_LZW;
+    }
+    if (params->index || params->index_interval != 0) {
+        flags |= FLAG_INDEX;
+    }
+    if (params->checksum) {
+        flags |= FLAG_CRC;
+    }
+    flags |= (uint16_t) (params->level << FLAG_LEVEL_SHIFT);
+    if (params->dict != NULL) {
+        flags |= FLAG_DICT;
+    }
+    if (params->sync) {
+        flags |= FLAG_SYNC;
+    }
+    return flags;
+}
+
+bool lz78_header_params(const FileHeader *header, LZ78Params *params) {
+    memset(params, 0, sizeof(LZ78Params));
+    params->protection = header->protection;
+    params->bits = (uint8_t) ((header->flags & FLAG_BITS_MASK) >> FLAG_BITS_SHIFT);
+    params->reset = (uint8_t) ((header->flags & FLAG_RESET_MASK) >> FLAG_RESET_SHIFT);
+    params->lzw = (header->flags & FLAG_LZW) != 0;
+    params->index = (header->flags & FLAG_INDEX) != 0;
+    params->checksum = (header->flags & FLAG_CRC) != 0;
+    params->level = (uint8_t) ((header->flags & FLAG_LEVEL_MASK) >> FLAG_LEVEL_SHIFT);
+    params->sync = (header->flags & FLAG_SYNC) != 0;
+    if (params->bits == 0) {
+        params->bits = LZ78_DEFAULT_BITS;
+    }
+    return (header->flags & ~(FLAG_CHUNKED | FLAG_ARCHIVE | FLAG_CODEC)) == 0 && params->bits >= LZ78_MIN_BITS
+           && params->bits <= LZ78_MAX_BITS && params->reset <= LZ78_RESET_NEVER
+           && params->level <= LZ78_LEVEL_HUFFMAN;
+}
+
+/*
+    Starts the encoder's dictionary over: with the preset dictionary's phrases, copied in bulk,
+    or else empty, but for every symbol in LZW mode.
+*/
+static void trie_start(LZ78State *st) {
+    if (st->dict != NULL) {
+        trie_copy(st->trie, st->dict->trie);
+        return;
+    }
+    trie_reset(st->trie);
+    if (st->lzw) {
+        trie_seed(st->trie);
+    }
+}
+
+/*
+    Starts the entropy models over, at the start of a stream and at the dictionary resets of an
+    indexed stream, which must decode from scratch.
+*/
+static void models_reset(LZ78State *st) {
+    if (st->level == LZ78_LEVEL_HUFFMAN) {
+        huff_init(&st->literals, ALPHABET);
+        huff_init(&st->codes, CODE_SLICES);
+    }
+}
+
+/*
+    Records an index boundary: a decoder can start over with an empty dictionary at bit offset bit
+    of the stream, which decodes to the input from byte offset position on.
+*/
+static void index_add(LZ78State *st, uint64_t bit, uint64_t position) {
+    if (st->index_len == st->index_capacity) {
+        uint32_t capacity = st->index_capacity == 0 ? 64 : 2 * st->index_capacity;
+        uint64_t *index = (uint64_t *) realloc(st->index, 2 * (size_t) capacity * sizeof(uint64_t));
+        if (index == NULL) {
+            st->index_failed = true;
+            return;
+        }
+        st->index = index;
+        st->index_capacity = capacity;
+    }
+    st->index[2 * st->index_len] = bit;
+    st->index[2 * st->index_len + 1] = position;
+    st->index_len++;
+}
+
+/*
+    Prepares an encoder: a fresh trie and, unless raw, the header and dictionary ID staged for output.
+*/
+int lz78_encode_init(LZ78Stream *s, const LZ78Params *params) {
+    int response = state_create(s, params, true);
+    if (response != LZ78_OK) {
+        return response;
+    }
+    LZ78State *st = s->state;
+    st->trie = trie_create(st->bits);
+    if (st->trie == NULL) {
+        lz78_encode_end(s);
+        return LZ78_MEM_ERROR;
+    }
+    trie_start(st);
+    st->current_node = st->trie->root;
+    models_reset(st);
+
+    if (!st->raw) {
+        s->header.magic = MAGIC;
+        s->header.protection = params != NULL ? params->protection : 0;
+        LZ78Params recorded = {
+            .bits = st->bits,
+            .reset = st->reset,
+            .lzw = st->lzw,
+            .index = st->indexed,
+            .checksum = st->checksum,
+            .level = st->level,
+            .sync = st->sync,
+            .dict = st->dict,
+        };
+        s->header.flags = lz78_header_flags(&recorded);
+        header_pack(&s->header, st->staging);
+        st->header_len = LZ78_HEADER_SIZE;
+        if (st->dict != NULL) {
+            store_le(st->staging + st->header_len, st->dict->id, DICT_ID_SIZE);
+            st->header_len += DICT_ID_SIZE;
+        }
+        st->staging_len = st->header_len;
+    }
+    if (st->indexed) {
+        index_add(st, 0, 0);
+    }
+    return LZ78_OK;
+}
+
+/*
+    Copies staged output to next_out, or with discard only counts it. Returns true once the
+    staging buffer is empty.
+*/
+static bool drain_staging(LZ78Stream *s) {
+    LZ78State *st = s->state;
+    uint32_t staged = st->staging_len - st->staging_pos;
+    uint32_t n = staged < s->avail_out || st->discard ? staged : (uint32_t) s->avail_out;
+    if (!st->discard) {
+        memcpy(s->next_out, st->staging + st->staging_pos, n);
+        s->next_out += n;
+        s->avail_out -= n;
+    }
+    s->total_out += n;
+    st->staging_pos += n;
+    if (st->staging_pos < st->staging_len) {
+        return false;
+    }
+    st->staging_pos = 0;
+    st->staging_len = 0;
+    return true;
+}
+
+/*
+    Stages a pair: bitlen bits of code, then all 8 bits of sym.
+*/
+static inline void stage_pair(LZ78State *st, uint32_t code, uint8_t sym, int bitlen) {
+    bits_put(&st->acc, st->staging, &st->staging_len, (uint32_t) code | ((uint32_t) sym << bitlen),
+        bitlen + BYTE);
+}
+
+/*
+    First code of slice slice of n codes. The CODE_SLICES slices split the codes evenly, and those
+    below 64 codes leave some slices empty.
+*/
+static inline uint32_t slice_start(uint32_t slice, uint32_t n) {
+    return (uint32_t) (((uint64_t) slice * n + CODE_SLICES - 1) / CODE_SLICES);
+}
+
+/*
+    Stages code, one of the n codes below n, as the level codes it: in get_bitlength(n) bits
+    (LZ78_LEVEL_PLAIN), as a truncated binary code (LZ78_LEVEL_PHASED), or as its slice of the
+    codes from the code model followed by its place in the slice in truncated binary
+    (LZ78_LEVEL_HUFFMAN). Older, shorter phrases are used more often than new ones, which the
+    slices capture whatever the size of the dictionary. Returns the bits staged.
+*/
+static inline int put_code(LZ78State *st, uint32_t code, uint32_t n) {
+    if (st->level == LZ78_LEVEL_PLAIN) {
+        int bitlen = get_bitlength(n);
+        bits_put(&st->acc, st->staging, &st->staging_len, code, bitlen);
+        return bitlen;
+    }
+    if (st->level == LZ78_LEVEL_PHASED) {
+        return bits_put_phased(&st->acc, st->staging, &st->staging_len, code, n);
+    }
+    uint32_t slice = (uint32_t) (((uint64_t) code * CODE_SLICES) / n);
+    uint32_t start = slice_start(slice, n);
+    int staged = huff_put(&st->codes, &st->acc, st->staging, &st->staging_len, slice);
+    return staged
+           + bits_put_phased(&st->acc, st->staging, &st->staging_len, code - start, slice_start(slice + 1, n) - start);
+}
+
+/*
+    Stages a pair with n codes below n, its symbol through the literal model at
+    LZ78_LEVEL_HUFFMAN and in 8 bits otherwise. Returns the bits staged.
+*/
+static inline int put_pair(LZ78State *st, uint32_t code, uint8_t sym, uint32_t n) {
+    if (st->level == LZ78_LEVEL_PLAIN) {
+        int bitlen = get_bitlength(n);
+        stage_pair(st, code, sym, bitlen);
+        return bitlen + BYTE;
+    }
+    int staged = put_code(st, code, n);
+    if (st->level == LZ78_LEVEL_HUFFMAN) {
+        return staged + huff_put(&st->literals, &st->acc, st->staging, &st->staging_len, sym);
+    }
+    bits_put(&st->acc, st->staging, &st->staging_len, sym, BYTE);
+    return staged + BYTE;
+}
+
+/*
+    Adaptive reset policy: adds a pair_bits pair to the current window, and closes the window once
+    it spans RESET_WINDOW input bytes up to position. A window is degraded if it took over 1/4
+    more bits per input byte than the dictionary has averaged since its last reset. Returns true
+    after RESET_STREAK degraded windows in a row: the data has changed character and the
+    dictionary no longer fits it. A single window is not enough, as ratios vary within a file.
+*/
+static bool window_degraded(LZ78State *st, uint64_t position, int pair_bits) {
+    st->window_bits += pair_bits;
+    uint64_t len = position - st->window_start;
+    if (len < RESET_WINDOW) {
+        return false;
+    }
+    if (st->history_len != 0 && 4 * st->window_bits * st->history_len > 5 * st->history_bits * len) {
+        st->degraded_windows++;
+    } else {
+        st->degraded_windows = 0;
+    }
+    st->history_bits += st->window_bits;
+    st->history_len += len;
+    st->window_start = position;
+    st->window_bits = 0;
+    return st->degraded_windows >= RESET_STREAK;
+}
+
+/*
+    Called after each phrase is staged, staged_bits long, with position input bytes consumed.
+    Returns true if the dictionary must start over, having emptied the trie: a full dictionary is
+    kept under LZ78_RESET_NEVER and reset otherwise. LZ78_RESET_ADAPTIVE also resets it early
+    once the ratio degrades, and an index forces a reset every index_interval input bytes, staging
+    a RESET_SYM pair (LZW_RESET_CODE in LZW mode) to tell the decoder.
+    Every restart of an indexed stream is recorded as a boundary.
+*/
+static bool restart_due(LZ78Stream *s, uint32_t next_code, uint64_t position, int staged_bits) {
+    LZ78State *st = s->state;
+    bool restart = next_code == st->max_code && st->reset != LZ78_RESET_NEVER;
+    bool signal = st->reset == LZ78_RESET_ADAPTIVE && window_degraded(st, position, staged_bits) && !restart;
+    if (st->index_interval != 0 && position - st->index_position >= st->index_interval && !restart) {
+        signal = true;
+    }
+    if (signal) {
+        if (st->lzw) {
+            put_code(st, LZW_RESET_CODE, next_code);
+        } else {
+            put_pair(st, STOP_CODE, RESET_SYM, next_code);
+        }
+        restart = true;
+    }
+    //In LZW mode the symbol that ended the last phrase starts the next epoch.
+    if (restart) {
+        STAT(st->stats.resets++);
+        epoch_end(st, st->lzw ? position - 1 : position);
+    }
+    if (restart && st->indexed) {
+        st->index_position = st->epoch_start;
+        uint64_t out = s->total_out + st->staging_len - st->staging_pos - st->header_len;
+        index_add(st, BYTE * out + st->acc.bits, st->index_position);
+    }
+    if (restart) {
+        st->history_bits = 0;
+        st->history_len = 0;
+        st->degraded_windows = 0;
+        trie_start(st);
+        if (st->indexed) {
+            models_reset(st);
+        }
+    }
+    return restart;
+}
+
+/*
+    Runs the dictionary over next_in until it is consumed or the staging buffer is full.
+    The loop works on locals and stores them back once, since it runs for every input byte.
+    With a width (a constant, at LZ78_LEVEL_PLAIN) every pair is that wide, and the loop also
+    stops where next_code outgrows it; with 0 pairs go through put_pair().
+*/
+KERNEL void encode_symbols(LZ78Stream *s, const int width) {
+    LZ78State *st = s->state;
+    Trie *trie = st->trie;
+    TrieNode *root = trie->root;
+    TrieNode *current_node = st->current_node;
+    TrieNode *previous_node = st->previous_node;
+    uint8_t previous_sym = st->previous_sym;
+    uint32_t next_code = st->next_code;
+    uint32_t max = st->max_code;
+    const uint8_t *in = s->next_in;
+    const uint8_t *end = in + s->avail_in;
+    STAT(uint64_t steps = 0);
+
+    //Each symbol stages at most two pairs (a phrase and a reset), of up to 46 bits each.
+    while (in < end && st->staging_len <= STAGING - 4 * sizeof(uint32_t)) {
+        uint8_t current_sym = *in++;
+        TrieNode *next_node = trie_step(trie, current_node, current_sym);
+        if (next_node != NULL) {
+            STAT(steps++);
+            previous_node = current_node;
+            current_node = next_node;
+        } else {
+            STAT(st->stats.phrases[get_bitlength(next_code)]++);
+            int staged = width + BYTE;
+            if (width != 0) {
+                stage_pair(st, current_node->code, current_sym, width);
+            } else {
+                staged = put_pair(st, current_node->code, current_sym, next_code);
+            }
+            if (next_code < max) {
+                STAT(st->stats.inserts++);
+                trie_insert(trie, current_node, current_sym, next_code);
+                next_code++;
+            }
+            current_node = root;
+            previous_sym = current_sym;
+            if (restart_due(s, next_code, s->total_in + (size_t) (in - s->next_in), staged)) {
+                root = trie->root;
+                current_node = root;
+                next_code = st->start_code;
+                if (width != 0) {
+                    break;
+                }
+            }
+            if (width != 0 && next_code == (uint32_t) 1 << width) {
+                break;
+            }
+        }
+        previous_sym = current_sym;
+    }
+
+    size_t consumed = (size_t) (in - s->next_in);
+    s->next_in = in;
+    s->avail_in -= consumed;
+    s->total_in += consumed;
+    st->current_node = current_node;
+    st->previous_node = previous_node;
+    st->previous_sym = previous_sym;
+    st->next_code = next_code;
+    STAT(st->stats.steps += steps);
+}
+
+/*
+    LZW mode counterpart of encode_symbols(): a phrase that cannot be extended is staged as its
+    code alone, and the symbol that ended it starts the next phrase.
+*/
+KERNEL void encode_codes(LZ78Stream *s, const int width) {
+    LZ78State *st = s->state;
+    Trie *trie = st->trie;
+    TrieNode *current_node = st->current_node;
+    uint32_t next_code = st->next_code;
+    uint32_t max = st->max_code;
+    const uint8_t *in = s->next_in;
+    const uint8_t *end = in + s->avail_in;
+    STAT(uint64_t steps = 0);
+
+    //Each symbol stages at most two codes (a phrase and a reset), of up to 35 bits each.
+    while (in < end && st->staging_len <= STAGING - 4 * sizeof(uint32_t)) {
+        uint8_t current_sym = *in++;
+        TrieNode *next_node = trie_step(trie, current_node, current_sym);
+        if (next_node != NULL) {
+            STAT(steps++);
+            current_node = next_node;
+        } else {
+            STAT(st->stats.phrases[get_bitlength(next_code)]++);
+            int staged = width;
+            if (width != 0) {
+                bits_put(&st->acc, st->staging, &st->staging_len, current_node->code, width);
+            } else {
+                staged = put_code(st, current_node->code, next_code);
+            }
+            if (next_code < max) {
+                STAT(st->stats.inserts++);
+                trie_insert(trie, current_node, current_sym, next_code);
+                next_code++;
+            }
+            bool restarted = restart_due(s, next_code, s->total_in + (size_t) (in - s->next_in), staged);
+            if (restarted) {
+                next_code = st->start_code;
+            }
+            current_node = trie_step(trie, trie->root, current_sym);
+            if (width != 0 && (restarted || next_code == (uint32_t) 1 << width)) {
+                break;
+            }
+        }
+    }
+
+    size_t consumed = (size_t) (in - s->next_in);
+    s->next_in = in;
+    s->avail_in -= consumed;
+    s->total_in += consumed;
+    st->current_node = current_node;
+    st->next_code = next_code;
+    STAT(st->stats.steps += steps);
+}
+
+/*
+    Runs the dictionary over next_in like encode_symbols() or encode_codes(). At LZ78_LEVEL_PLAIN
+    every code until next_code's next power of two has the same width, so the loops run as
+    kernels instantiated for that width, with the shifts and masks of bits_put() constant,
+    dispatched again each time next_code crosses into a new width or the dictionary restarts.
+*/
+static void encode_run(LZ78Stream *s) {
+    LZ78State *st = s->state;
+    if (st->level != LZ78_LEVEL_PLAIN) {
+        if (st->lzw) {
+            encode_codes(s, 0);
+        } else {
+            encode_symbols(s, 0);
+        }
+        return;
+    }
+#define ENCODE_WIDTH(w) \
+    case w: \
+        if (st->lzw) { \
+            encode_codes(s, w); \
+        } else { \
+            encode_symbols(s, w); \
+        } \
+        break;
+    do {
+        switch (get_bitlength(st->next_code)) {
+            FOR_EACH_WIDTH(ENCODE_WIDTH)
+        }
+    } while (s->avail_in > 0 && st->staging_len <= STAGING - 4 * sizeof(uint32_t));
+#undef ENCODE_WIDTH
+}
+
+/*
+    Serializes the index footer described in lz78.h, for a stream of total input bytes.
+    Returns false if an allocation fails.
+*/
+static bool footer_create(LZ78State *st, uint64_t total) {
+    st->footer_len = 16 * st->index_len + INDEX_TRAILER_SIZE;
+    st->footer = (uint8_t *) malloc(st->footer_len);
+    if (st->footer == NULL) {
+        return false;
+    }
+    uint8_t *buf = st->footer;
+    for (uint32_t i = 0; i < 2 * st->index_len; i++, buf += 8) {
+        store_le(buf, st->index[i], 8);
+    }
+    store_le(buf, total, 8);
+    store_le(buf + 8, st->index_len, 4);
+    store_le(buf + 12, INDEX_MAGIC, 4);
+    return true;
+}
+
+/*
+    Copies the footer to next_out once the staging buffer is empty, or with discard only counts
+    it. Returns true once it is all out.
+*/
+static bool drain_footer(LZ78Stream *s) {
+    LZ78State *st = s->state;
+    uint32_t left = st->footer_len - st->footer_pos;
+    uint32_t n = left < s->avail_out || st->discard ? left : (uint32_t) s->avail_out;
+    if (!st->discard) {
+        memcpy(s->next_out, st->footer + st->footer_pos, n);
+        s->next_out += n;
+        s->avail_out -= n;
+    }
+    s->total_out += n;
+    st->footer_pos += n;
+    return st->footer_pos == st->footer_len;
+}
+
+/*
+    Stages a sync point: the phrase still being matched, as encode_finish() would, then the STOP
+    pair, a 1 bit and zero bits for sync_span() and up to the next byte. The phrase takes a code in LZ78 mode, though
+    the trie does not get it, since the decoder adds its copy of the phrase as for any pair. In
+    LZW mode nothing is added, and the decoder starts the next phrase as after a reset, so the
+    STOP_CODE is as wide as after one more code. Either may fill the dictionary and restart it;
+    in LZW mode the restart is at the current input offset, there being no next symbol yet.
+*/
+static void encode_sync(LZ78Stream *s) {
+    LZ78State *st = s->state;
+    uint32_t next_code = st->next_code;
+    if (st->current_node != st->trie->root) {
+        STAT(st->stats.phrases[get_bitlength(next_code)]++);
+        int staged;
+        if (st->lzw) {
+            staged = put_code(st, st->current_node->code, next_code);
+        } else {
+            staged = put_pair(st, st->previous_node->code, st->previous_sym, next_code);
+        }
+        if (next_code < st->max_code) {
+            next_code++;
+        }
+        if (restart_due(s, next_code, st->lzw ? s->total_in + 1 : s->total_in, staged)) {
+            next_code = st->start_code;
+            st->next_code = next_code;
+        } else if (!st->lzw) {
+            st->next_code = next_code;
+        }
+        st->current_node = st->trie->root;
+    }
+    uint32_t stop = BYTE * st->staging_len + st->acc.bits;
+    if (st->lzw) {
+        put_code(st, STOP_CODE, next_code);
+    } else {
+        put_pair(st, STOP_CODE, 0, next_code);
+    }
+    bits_put(&st->acc, st->staging, &st->staging_len, 1, 1);
+    uint32_t spanned = BYTE * st->staging_len + st->acc.bits - stop;
+    for (; spanned < st->sync_span; spanned += BYTE) {
+        uint32_t zeros = st->sync_span - spanned;
+        bits_put(&st->acc, st->staging, &st->staging_len, 0, zeros < BYTE ? (int) zeros : BYTE);
+    }
+    bits_flush(&st->acc, st->staging, &st->staging_len);
+    st->sync_position = s->total_in;
+}
+
+/*
+    Bytes of a model in an append trailer.
+*/
+static size_t model_size(const HuffModel *m) {
+    return 12 + 7 * (size_t) m->symbols;
+}
+
+static uint8_t *model_store(uint8_t *p, const HuffModel *m) {
+    store_le(p, m->until, 4);
+    store_le(p + 4, m->period, 4);
+    store_le(p + 8, m->total, 4);
+    p += 12;
+    for (uint32_t i = 0; i < m->symbols; i++, p += 7) {
+        store_le(p, m->freq[i], 4);
+        store_le(p + 4, m->code[i], 2);
+        p[6] = m->len[i];
+    }
+    return p;
+}
+
+/*
+    Loads what model_store() stored into m, which huff_init() sized for the same alphabet. The
+    decoding table is left out, the encoder not needing it.
+*/
+static const uint8_t *model_load(const uint8_t *p, HuffModel *m) {
+    m->until = (uint32_t) load_le(p, 4);
+    m->period = (uint32_t) load_le(p + 4, 4);
+    m->total = (uint32_t) load_le(p + 8, 4);
+    p += 12;
+    for (uint32_t i = 0; i < m->symbols; i++, p += 7) {
+        m->freq[i] = (uint32_t) load_le(p, 4);
+        m->code[i] = (uint16_t) load_le(p + 4, 2);
+        m->len[i] = p[6];
+    }
+    return p;
+}
+
+/*
+    Bytes of the append trailer of a stream whose next code is next_code.
+*/
+static size_t append_size(const LZ78State *st, uint32_t next_code) {
+    size_t models = st->level == LZ78_LEVEL_HUFFMAN ? model_size(&st->literals) + model_size(&st->codes) : 0;
+    return APPEND_STATE_SIZE + 4 * (size_t) (next_code - st->start_code) + models + APPEND_TRAILER_SIZE;
+}
+
+/*
+    Serializes the append trailer described in lz78.h into the footer, at a sync point, before
+    anything follows it. The nodes a reset leaves in the trie are the codes below start_code, at
+    the same indices, so the rest are the entries.
+    Returns false if an allocation fails.
+*/
+static bool append_create(LZ78Stream *s) {
+    LZ78State *st = s->state;
+    Trie *t = st->trie;
+    size_t len = append_size(st, st->next_code);
+    uint32_t *parents = (uint32_t *) calloc(t->node_count, sizeof(uint32_t));
+    st->footer = (uint8_t *) malloc(len);
+    if (parents == NULL || st->footer == NULL) {
+        free(parents);
+        return false;
+    }
+    trie_parents(t, parents);
+    uint8_t *p = st->footer;
+    store_le(p, st->out_base + s->total_out + st->staging_len - st->staging_pos - st->header_len, 8);
+    store_le(p + 8, s->total_in, 8);
+    store_le(p + 16, st->epoch_start, 8);
+    store_le(p + 24, st->window_start, 8);
+    store_le(p + 32, st->window_bits, 8);
+    store_le(p + 40, st->history_bits, 8);
+    store_le(p + 48, st->history_len, 8);
+    store_le(p + 56, st->crc, 4);
+    store_le(p + 60, st->degraded_windows, 4);
+    store_le(p + 64, st->next_code, 4);
+    p += APPEND_STATE_SIZE;
+    memset(p, 0, 4 * (size_t) (st->next_code - st->start_code));
+    for (uint32_t index = st->start_code; index < t->node_count; index++) {
+        store_le(p + 4 * (size_t) (t->nodes[index].code - st->start_code), parents[index], 4);
+    }
+    p += 4 * (size_t) (st->next_code - st->start_code);
+    free(parents);
+    if (st->level == LZ78_LEVEL_HUFFMAN) {
+        p = model_store(p, &st->literals);
+        p = model_store(p, &st->codes);
+    }
+    store_le(p, crc32c(0, st->footer, (size_t) (p - st->footer)), 4);
+    store_le(p + 4, len, 4);
+    store_le(p + 8, APPEND_MAGIC, 4);
+    st->footer_len = (uint32_t) len;
+    return true;
+}
+
+/*
+    Restores the state an append trailer holds into a new encoder. The trie is rebuilt by
+    inserting the entries in code order, as they first were, from the same starting trie, which
+    lays out its pools exactly as they were.
+*/
+static int append_load(LZ78Stream *s, const uint8_t *trailer, size_t len) {
+    LZ78State *st = s->state;
+    Trie *t = st->trie;
+    if (len < APPEND_STATE_SIZE + APPEND_TRAILER_SIZE || load_le(trailer + len - 4, 4) != APPEND_MAGIC
+        || load_le(trailer + len - 8, 4) != len
+        || load_le(trailer + len - APPEND_TRAILER_SIZE, 4) != crc32c(0, trailer, len - APPEND_TRAILER_SIZE)) {
+        return LZ78_DATA_ERROR;
+    }
+    uint32_t next_code = (uint32_t) load_le(trailer + 64, 4);
+    if (next_code < st->start_code || next_code > st->max_code || append_size(st, next_code) != len) {
+        return LZ78_DATA_ERROR;
+    }
+    const uint8_t *p = trailer + APPEND_STATE_SIZE;
+    for (uint32_t code = st->start_code; code < next_code; code++, p += 4) {
+        uint32_t entry = (uint32_t) load_le(p, 4);
+        uint32_t parent = entry & 0xFFFFFF;
+        uint8_t sym = (uint8_t) (entry >> 24);
+        if (entry == 0) {
+            continue;
+        }
+        if (parent == 0 || parent >= t->node_count || trie_step(t, &t->nodes[parent], sym) != NULL
+            || trie_insert(t, &t->nodes[parent], sym, code) == NULL) {
+            return LZ78_DATA_ERROR;
+        }
+    }
+    if (st->level == LZ78_LEVEL_HUFFMAN) {
+        p = model_load(p, &st->literals);
+        model_load(p, &st->codes);
+    }
+    st->out_base = load_le(trailer, 8);
+    s->total_in = load_le(trailer + 8, 8);
+    st->sync_position = s->total_in;
+    st->epoch_start = load_le(trailer + 16, 8);
+    st->window_start = load_le(trailer + 24, 8);
+    st->window_bits = load_le(trailer + 32, 8);
+    st->history_bits = load_le(trailer + 40, 8);
+    st->history_len = load_le(trailer + 48, 8);
+    st->crc = (uint32_t) load_le(trailer + 56, 4);
+    st->degraded_windows = (uint32_t) load_le(trailer + 60, 4);
+    st->next_code = next_code;
+    return LZ78_OK;
+}
+
+int lz78_encode_resume(LZ78Stream *s, const LZ78Params *params, const uint8_t *trailer, size_t len,
+    uint64_t *offset) {
+    if (params == NULL || !params->raw || !params->append) {
+        return LZ78_PARAM_ERROR;
+    }
+    int response = lz78_encode_init(s, params);
+    if (response != LZ78_OK) {
+        return response;
+    }
+    response = append_load(s, trailer, len);
+    if (response != LZ78_OK) {
+        lz78_encode_end(s);
+        return response;
+    }
+    *offset = s->state->out_base;
+    return LZ78_OK;
+}
+
+/*
+    Stages the pair for a phrase still being matched, the STOP pair, and every whole byte
+    left in the accumulator.
+    In LZW mode the phrase and STOP_CODE are codes alone, and next_code advances as it
+    would have for one more symbol, since that is the width the decoder expects.
+    With FLAG_SYNC the STOP pair is followed by a 0 bit.
+    A sealed stream (one with a CRC, an index or an entropy stage) also stages its last partial
+    byte, then the CRC, and serializes the footer. Its STOP pair is coded exactly as the decoder
+    reads it, since either data follows the final byte or the pair is not all zero bits.
+    With append, a sync point and the append trailer's snapshot of it come first, and the last
+    partial byte is staged too, for the trailer to follow.
+*/
+static int encode_finish(LZ78Stream *s) {
+    LZ78State *st = s->state;
+    if (st->append) {
+        if (s->total_in != st->sync_position) {
+            encode_sync(s);
+        }
+        if (!append_create(s)) {
+            return LZ78_MEM_ERROR;
+        }
+    }
+    uint32_t next_code = st->next_code;
+    bool sealed = st->indexed || st->checksum || st->level != LZ78_LEVEL_PLAIN;
+    if (st->lzw) {
+        if (st->current_node != st->trie->root) {
+            STAT(st->stats.phrases[get_bitlength(next_code)]++);
+            put_code(st, st->current_node->code, next_code);
+            if (next_code < st->max_code) {
+                next_code++;
+            }
+            if (next_code == st->max_code && st->reset != LZ78_RESET_NEVER) {
+                next_code = st->start_code;
+            }
+        }
+        put_code(st, STOP_CODE, next_code);
+    } else {
+        if (st->current_node != st->trie->root) {
+            STAT(st->stats.phrases[get_bitlength(next_code)]++);
+            put_pair(st, st->previous_node->code, st->previous_sym, next_code);
+            if (st->reset == LZ78_RESET_NEVER) {
+                if (next_code < st->max_code) {
+                    next_code++;
+                }
+            } else if (sealed) {
+                next_code = next_code + 1 == st->max_code ? st->start_code : next_code + 1;
+            } else {
+                next_code = (next_code + 1) % st->max_code;
+            }
+        }
+        put_pair(st, STOP_CODE, 0, next_code);
+    }
+    if (st->sync) {
+        bits_put(&st->acc, st->staging, &st->staging_len, 0, 1);
+    }
+    bits_drain(&st->acc, st->staging, &st->staging_len);
+    st->finished = true;
+    epoch_end(st, s->total_in);
+    if (sealed || st->append) {
+        bits_flush(&st->acc, st->staging, &st->staging_len);
+    }
+    if (st->checksum) {
+        store_le(st->staging + st->staging_len, st->crc, CRC_SIZE);
+        st->staging_len += CRC_SIZE;
+    }
+    if (st->indexed && !footer_create(st, s->total_in)) {
+        return LZ78_MEM_ERROR;
+    }
+    return LZ78_OK;
+}
+
+/*
+    Compresses next_in into next_out through the staging buffer.
+    The CRC is taken over each span of input as the dictionary consumes it, unless the output is
+    discarded, which only needs the CRC's size.
+*/
+int lz78_encode(LZ78Stream *s, int flush) {
+    if (s == NULL || s->state == NULL || !s->state->encoding) {
+        return LZ78_PARAM_ERROR;
+    }
+    LZ78State *st = s->state;
+    if (flush == LZ78_SYNC && !st->sync) {
+        return LZ78_PARAM_ERROR;
+    }
+    while (drain_staging(s)) {
+        if (st->index_failed) {
+            return LZ78_MEM_ERROR;
+        }
+        if (s->avail_in > 0) {
+            const uint8_t *in = s->next_in;
+            encode_run(s);
+            if (st->checksum && !st->discard) {
+                st->crc = crc32c(st->crc, in, (size_t) (s->next_in - in));
+            }
+            STAT(st->stats.symbols += (uint64_t) (s->next_in - in));
+        } else if (flush == LZ78_SYNC && s->total_in != st->sync_position && !st->finished) {
+            encode_sync(s);
+        } else if (flush == LZ78_FINISH && !st->finished) {
+            if (encode_finish(s) != LZ78_OK) {
+                return LZ78_MEM_ERROR;
+            }
+        } else if (st->footer_pos < st->footer_len) {
+            if (!drain_footer(s)) {
+                return LZ78_OK;
+            }
+        } else {
+            return st->finished ? LZ78_STREAM_END : LZ78_OK;
+        }
+    }
+    return LZ78_OK;
+}
+
+/*
+    Counts the index with the encoder's trie. The decoder's window is touched up to window_len
+    until the first time it slides, and all of it after; a search's matcher is counted whole.
+*/
+size_t lz78_memory_peak(const LZ78Stream *s) {
+    if (s == NULL || s->state == NULL) {
+        return 0;
+    }
+    const LZ78State *st = s->state;
+    if (st->encoding) {
+        return sizeof(LZ78State) + trie_peak(st->trie) + 2 * (size_t) st->index_capacity * sizeof(uint64_t)
+               + st->footer_len;
+    }
+    if (st->phrases == NULL) {
+        return sizeof(LZ78State);
+    }
+    uint32_t codes = st->next_code > st->code_peak ? st->next_code : st->code_peak;
+    size_t window = st->window_offset != 0 ? st->window_size : st->window_len;
+    size_t search = st->matcher != NULL ? (size_t) st->max_code * (sizeof(MatchCode) + sizeof(uint32_t)) : 0;
+    return sizeof(LZ78State) + (size_t) codes * sizeof(Phrase) + window + search;
+}
+
+/*
+    Frees the encoder's trie, index and state.
+*/
+int lz78_encode_end(LZ78Stream *s) {
+    if (s == NULL || s->state == NULL) {
+        return LZ78_PARAM_ERROR;
+    }
+    stats_flush(s->state);
+    trie_delete(s->state->trie);
+    free(s->state->index);
+    free(s->state->footer);
+    free(s->state);
+    s->state = NULL;
+    return LZ78_OK;
+}
+
+/*
+    Sets up the matcher of a decoder with a pattern, which builds no window. The codes below
+    start_code are spelled out from the root: in LZW mode the symbols, and a preset dictionary's
+    words from the parents its trie holds, which come first.
+*/
+static bool matcher_start(LZ78State *st) {
+    st->matcher = matcher_create(st->pattern, st->pattern_len, st->max_code, EMPTY_CODE, st->match, st->opaque);
+    if (st->matcher == NULL) {
+        return false;
+    }
+    if (st->dict != NULL) {
+        uint32_t *parents = (uint32_t *) calloc(st->dict->trie->node_count, sizeof(uint32_t));
+        if (parents == NULL) {
+            return false;
+        }
+        trie_parents(st->dict->trie, parents);
+        for (uint32_t code = START_CODE; code < st->start_code; code++) {
+            matcher_add(st->matcher, code, parents[code] & 0xFFFFFF, (uint8_t) (parents[code] >> 24));
+        }
+        free(parents);
+    } else if (st->lzw) {
+        for (uint32_t sym = 0; sym < 256; sym++) {
+            matcher_add(st->matcher, START_CODE + sym, EMPTY_CODE, (uint8_t) sym);
+        }
+    }
+    return true;
+}
+
+/*
+    Allocates the decoder's phrase table and output window for the stream's code width. The codes
+    below start_code never change: the root, and the preset dictionary's words or in LZW mode the
+    symbols, at the codes trie_seed() assigns them. No phrase is longer than the code space, so
+    a quarter of the window holds any phrase. The window shrinks to fit a memory limit, and a
+    search has none.
+*/
+static int table_create(LZ78State *st) {
+    bool searching = st->pattern_len != 0;
+    st->window_size = searching ? 0 : window_bytes(st->max_code, st->memory);
+    st->phrases = (Phrase *) malloc((size_t) st->max_code * sizeof(Phrase));
+    st->window = searching ? NULL : (uint8_t *) malloc(st->window_size);
+    if (st->phrases == NULL || (!searching && st->window == NULL)) {
+        return LZ78_MEM_ERROR;
+    }
+    for (uint32_t code = STOP_CODE; code < st->start_code; code++) {
+        uint32_t len = code < START_CODE ? 0 : st->dict != NULL ? st->dict->words[code - START_CODE].len : 1;
+        st->phrases[code] = (Phrase) { .len = len };
+    }
+    models_reset(st);
+    if (searching && !matcher_start(st)) {
+        return LZ78_MEM_ERROR;
+    }
+    return LZ78_OK;
+}
+
+/*
+    Starts the decoder's dictionary over, position bytes into the output. Nothing is freed: the
+    codes are simply assigned again.
+*/
+static void table_reset(LZ78State *st, uint64_t position) {
+    STAT(st->stats.resets++);
+    if (st->next_code > st->code_peak) {
+        st->code_peak = st->next_code;
+    }
+    epoch_end(st, position);
+    st->next_code = st->start_code;
+    st->previous_code = STOP_CODE;
+    if (st->indexed) {
+        models_reset(st);
+    }
+}
+
+/*
+    Prepares a decoder. The phrase table and window are sized once the code width is known, which
+    for a stream with a header is after the header has been read.
+*/
+int lz78_decode_init(LZ78Stream *s, const LZ78Params *params) {
+    int response = state_create(s, params, false);
+    if (response != LZ78_OK) {
+        return response;
+    }
+    if (s->state->raw && table_create(s->state) != LZ78_OK) {
+        lz78_decode_end(s);
+        return LZ78_MEM_ERROR;
+    }
+    return LZ78_OK;
+}
+
+/*
+    Collects header bytes until there are size. Returns false if next_in runs dry first.
+*/
+static bool collect_header(LZ78Stream *s, uint32_t size) {
+    LZ78State *st = s->state;
+    while (st->header_len < size && s->avail_in > 0) {
+        st->header[st->header_len++] = *s->next_in++;
+        s->avail_in--;
+        s->total_in++;
+    }
+    return st->header_len == size;
+}
+
+/*
+    Collects and checks the header, and with FLAG_DICT the ID of the dictionary that must have
+    been given. Returns LZ78_STREAM_END once it is complete.
+*/
+static int decode_header(LZ78Stream *s, int flush) {
+    LZ78State *st = s->state;
+    if (!collect_header(s, LZ78_HEADER_SIZE)) {
+        return flush == LZ78_FINISH ? LZ78_DATA_ERROR : LZ78_OK;
+    }
+    header_unpack(&s->header, st->header);
+    if (s->header.magic != MAGIC) {
+        return LZ78_MAGIC_ERROR;
+    }
+    LZ78Params params;
+    int response;
+    if ((s->header.flags & (FLAG_CHUNKED | FLAG_ARCHIVE)) != 0 || !lz78_header_params(&s->header, &params)) {
+        return LZ78_DATA_ERROR;
+    }
+    bool preset = (s->header.flags & FLAG_DICT) != 0;
+    if (preset && !collect_header(s, LZ78_HEADER_SIZE + DICT_ID_SIZE)) {
+        return flush == LZ78_FINISH ? LZ78_DATA_ERROR : LZ78_OK;
+    }
+    st->bits = params.bits;
+    st->reset = params.reset;
+    st->lzw = params.lzw;
+    st->indexed = params.index;
+    st->checksum = params.checksum;
+    st->level = params.level;
+    st->sync = params.sync;
+    st->sync_span = st->sync ? (uint32_t) sync_span(st) : 0;
+    uint64_t id = preset ? load_le(st->header + LZ78_HEADER_SIZE, DICT_ID_SIZE) : 0;
+    if (preset != (st->dict != NULL) || (preset && (id != st->dict->id || !dict_fits(st)))) {
+        return LZ78_DICT_ERROR;
+    }
+    codes_init(st);
+    if (!memory_fits(st)) {
+        return LZ78_PARAM_ERROR;
+    }
+    response = table_create(st);
+    return response == LZ78_OK ? LZ78_STREAM_END : response;
+}
+
+/*
+    Copies as much of the pending word as fits to next_out. Returns true once it is all out.
+    With discard the word is only counted; window_checksum() takes its CRC with its neighbours'.
+*/
+static bool drain_pending(LZ78Stream *s) {
+    LZ78State *st = s->state;
+    if (st->pending_len == 0) {
+        return true;
+    }
+    if (st->discard) {
+        s->total_out += st->pending_len;
+        st->pending_len = 0;
+        return true;
+    }
+    uint32_t n = st->pending_len < s->avail_out ? st->pending_len : (uint32_t) s->avail_out;
+    memcpy(s->next_out, st->pending, n);
+    s->next_out += n;
+    s->avail_out -= n;
+    s->total_out += n;
+    st->pending += n;
+    st->pending_len -= n;
+    return st->pending_len == 0;
+}
+
+/*
+    Ensures the accumulator holds bitlen bits, taking bytes from next_in.
+    Returns false if next_in runs dry first. With LZ78_FINISH the stream is padded with zero bits.
+*/
+static bool decode_refill(LZ78Stream *s, int bitlen, int flush) {
+    LZ78State *st = s->state;
+    while (st->acc.bits < (uint32_t) bitlen) {
+        if (s->avail_in == 0) {
+            if (flush != LZ78_FINISH) {
+                return false;
+            }
+            uint32_t real = st->acc.bits;
+            bits_pad(&st->acc);
+            st->pad_bits += st->acc.bits - real;
+            break;
+        }
+        uint32_t len = s->avail_in < UINT32_MAX ? (uint32_t) s->avail_in : UINT32_MAX;
+        uint32_t pos = 0;
+        bits_refill(&st->acc, s->next_in, &pos, len);
+        s->next_in += pos;
+        s->avail_in -= pos;
+        s->total_in += pos;
+    }
+    return true;
+}
+
+/*
+    Whether the final STOP_CODE came from padding rather than the input: the encoder leaves off
+    only the zero bits of its last partial byte, so more than 7 bits of padding read by the end
+    mean the stream was cut short.
+*/
+static inline bool stop_missing(const LZ78State *st) {
+    uint32_t unread = st->acc.bits < st->pad_bits ? st->acc.bits : st->pad_bits;
+    return st->pad_bits - unread >= BYTE;
+}
+
+/*
+    Bits to refill before a pair (or code) of bits bits: with FLAG_SYNC, enough for its STOP to be
+    followed by the sync bit, and at least a sync point's span.
+*/
+static inline int sync_refill(const LZ78State *st, int bits) {
+    if (!st->sync) {
+        return bits;
+    }
+    return bits + 1 > (int) st->sync_span ? bits + 1 : (int) st->sync_span;
+}
+
+/*
+    Drops the zero bits of a sync point after its sync bit, held being the bits there were before
+    its STOP pair.
+*/
+static inline void sync_skip(LZ78State *st, uint32_t held) {
+    uint32_t spanned = held - st->acc.bits;
+    if (spanned < st->sync_span) {
+        bits_take(&st->acc, (int) (st->sync_span - spanned));
+    }
+    bits_take(&st->acc, st->acc.bits % BYTE);
+}
+
+/*
+    Removes a code staged by put_code() with n codes. Returns n for an empty slice, which the
+    callers reject as they do any code out of range.
+*/
+static inline uint32_t take_code(LZ78State *st, uint32_t n) {
+    if (st->level == LZ78_LEVEL_PLAIN) {
+        return bits_take(&st->acc, get_bitlength(n));
+    }
+    if (st->level == LZ78_LEVEL_PHASED) {
+        return bits_take_phased(&st->acc, n);
+    }
+    uint32_t slice = huff_take(&st->codes, &st->acc);
+    uint32_t start = slice_start(slice, n);
+    uint32_t end = slice_start(slice + 1, n);
+    if (start == end) {
+        return n;
+    }
+    return start + bits_take_phased(&st->acc, end - start);
+}
+
+static inline uint8_t take_literal(LZ78State *st) {
+    if (st->level == LZ78_LEVEL_HUFFMAN) {
+        return (uint8_t) huff_take(&st->literals, &st->acc);
+    }
+    return (uint8_t) bits_take(&st->acc, BYTE);
+}
+
+/*
+    Adds the output built in the window since the last call to the CRC, for a discarded stream,
+    whose output never reaches next_out. One call covers many phrases.
+*/
+static void window_checksum(LZ78State *st) {
+    st->crc = crc32c(st->crc, st->window + st->crc_len, st->window_len - st->crc_len);
+    st->crc_len = st->window_len;
+}
+
+/*
+    Makes room for len more bytes at the end of the window and returns where they go. A full
+    window keeps only its last quarter, which leaves room for any phrase and still holds the
+    previous one.
+*/
+static inline uint8_t *window_reserve(LZ78State *st, uint32_t len) {
+    if (st->window_len + len > st->window_size) {
+        if (st->discard && st->checksum) {
+            window_checksum(st);
+        }
+        size_t keep = st->window_size / 4;
+        memmove(st->window, st->window + st->window_len - keep, keep);
+        st->window_offset += st->window_len - keep;
+        st->window_len = keep;
+        st->crc_len = keep;
+    }
+    return st->window + st->window_len;
+}
+
+/*
+    Writes the phrase of code to dst, at the end of the window. A phrase still in the window is
+    one copy from where it was last output. Otherwise its last symbols are taken from its links,
+    until what is left of it is a phrase still in the window, or a code below start_code, whose
+    words never change. Every phrase met on the way is a prefix of dst, which becomes its place in
+    the output, so phrases in use stay in the window.
+*/
+static inline void phrase_copy(LZ78State *st, uint32_t code, uint8_t *dst) {
+    uint32_t len = st->phrases[code].len;
+    uint64_t pos = st->window_offset + (size_t) (dst - st->window);
+    while (code >= st->start_code) {
+        Phrase *phrase = &st->phrases[code];
+        uint64_t from = phrase->pos;
+        phrase->pos = pos;
+        if (from >= st->window_offset) {
+            memcpy(dst, st->window + (from - st->window_offset), len);
+            return;
+        }
+        STAT(st->stats.window_links++);
+        dst[--len] = (uint8_t) (phrase->link >> 24);
+        code = phrase->link & 0xFFFFFF;
+    }
+    if (st->dict != NULL && code >= START_CODE) {
+        memcpy(dst, st->dict->words[code - START_CODE].syms, len);
+    } else if (code >= START_CODE) {
+        dst[0] = (uint8_t) (code - START_CODE);
+    }
+}
+
+/*
+    Appends the len bytes at dst, written by phrase_copy(), to the window as the pending output.
+*/
+static inline void window_emit(LZ78State *st, uint8_t *dst, uint32_t len) {
+    st->window_len += len;
+    st->pending = dst;
+    st->pending_len = len;
+}
+
+/*
+    Runs the matcher over the phrase of a pair, output at offset, and returns its length. The
+    phrase takes the next code, or once they run out the matcher's spare one. A search keeps the
+    phrases' lengths in the matcher alone, so each pair looks up one code.
+*/
+static inline uint32_t search_pair(LZ78State *st, uint32_t code, uint8_t sym, uint64_t offset) {
+    uint32_t slot = st->next_code < st->max_code ? st->next_code++ : st->max_code;
+    matcher_add(st->matcher, slot, code, sym);
+    return matcher_phrase(st->matcher, slot, offset);
+}
+
+/*
+    LZW mode counterpart of search_pair(), for a code that completes the previous code's entry
+    if extend.
+*/
+static inline uint32_t search_code(LZ78State *st, uint32_t code, bool extend, uint64_t offset) {
+    if (extend) {
+        uint32_t head = code < st->next_code ? code : st->previous_code;
+        matcher_add(st->matcher, st->next_code++, st->previous_code, (uint8_t) (st->matcher->codes[head].link >> 24));
+    }
+    st->previous_code = code;
+    return matcher_phrase(st->matcher, code, offset);
+}
+
+/*
+    Decodes pairs into next_out, one pair at a time.
+    A dictionary reset is deferred to the next pair so the pending word stays valid.
+    A STOP_CODE pair with RESET_SYM is an explicit reset under LZ78_RESET_ADAPTIVE or in an
+    indexed stream, and with FLAG_SYNC one followed by a 1 bit a sync point. A new phrase is the
+    pair's output, which is where it is added. A stream discarded without a CRC to check only
+    counts its phrases, never building them in the window, and a search only runs its matcher
+    over them.
+    With a width, as for encode_symbols(), returns WIDTH_CHANGE once next_code outgrows it.
+*/
+KERNEL int decode_pairs(LZ78Stream *s, int flush, const int width) {
+    LZ78State *st = s->state;
+    const bool build = (!st->discard || st->checksum) && st->matcher == NULL;
+    while (drain_pending(s)) {
+        if (st->finished) {
+            return LZ78_STREAM_END;
+        }
+        if (st->next_code == st->max_code && st->reset != LZ78_RESET_NEVER) {
+            table_reset(st, s->total_out);
+        }
+        if (width != 0 && get_bitlength(st->next_code) != width) {
+            return WIDTH_CHANGE;
+        }
+        int bits = width != 0 ? width + BYTE : code_bits(st, st->next_code) + literal_bits(st);
+        if (!decode_refill(s, sync_refill(st, bits), flush)) {
+            return LZ78_OK;
+        }
+        uint32_t held = st->acc.bits;
+        uint32_t code = width != 0 ? bits_take(&st->acc, width) : take_code(st, st->next_code);
+        uint8_t sym = width != 0 ? (uint8_t) bits_take(&st->acc, BYTE) : take_literal(st);
+        if (code == STOP_CODE) {
+            if (sym == RESET_SYM && (st->reset == LZ78_RESET_ADAPTIVE || st->indexed)) {
+                table_reset(st, s->total_out);
+                continue;
+            }
+            if (sym != 0) {
+                return LZ78_DATA_ERROR;
+            }
+            if (st->sync && bits_take(&st->acc, 1)) {
+                sync_skip(st, held);
+                continue;
+            }
+            if (stop_missing(st)) {
+                return LZ78_DATA_ERROR;
+            }
+            st->finished = true;
+            epoch_end(st, s->total_out);
+            return LZ78_STREAM_END;
+        }
+        if (code >= st->next_code) {
+            return LZ78_DATA_ERROR;
+        }
+        STAT(st->stats.phrases[get_bitlength(st->next_code)]++);
+        if (st->matcher != NULL) {
+            st->pending_len = search_pair(st, code, sym, s->total_out);
+            continue;
+        }
+        uint32_t len = st->phrases[code].len + 1;
+        if (!build) {
+            if (st->next_code < st->max_code) {
+                st->phrases[st->next_code++].len = len;
+            }
+            st->pending_len = len;
+            continue;
+        }
+        uint8_t *dst = window_reserve(st, len);
+        phrase_copy(st, code, dst);
+        dst[len - 1] = sym;
+        if (st->next_code < st->max_code) {
+            st->phrases[st->next_code++] = (Phrase) {
+                .pos = st->window_offset + st->window_len,
+                .len = len,
+                .link = code | (uint32_t) sym << 24,
+            };
+        }
+        window_emit(st, dst, len);
+    }
+    return LZ78_OK;
+}
+
+/*
+    LZW mode counterpart of decode_pairs(). Each code but the first after a reset completes the
+    entry the encoder added for the previous code, whose last symbol is the first of this code's
+    word. A code may be that very entry (the KwKwK case), whose first symbol is then the previous
+    word's. Codes are as wide as the encoder's next_code, which is one ahead of ours while the
+    previous entry is incomplete. The entry is the previous code's output and the symbol that
+    follows it. After a sync point, as after a reset, there is no previous code. Discarded
+    streams are counted, and searched, as in decode_pairs().
+*/
+KERNEL int decode_codes(LZ78Stream *s, int flush, const int width) {
+    LZ78State *st = s->state;
+    const bool build = (!st->discard || st->checksum) && st->matcher == NULL;
+    while (drain_pending(s)) {
+        if (st->finished) {
+            return LZ78_STREAM_END;
+        }
+        uint32_t encoder_code = st->next_code + (st->previous_code != STOP_CODE);
+        if (encoder_code > st->max_code) {
+            encoder_code = st->max_code;
+        } else if (encoder_code == st->max_code && st->reset != LZ78_RESET_NEVER) {
+            table_reset(st, s->total_out);
+            encoder_code = st->next_code;
+        }
+        if (width != 0 && get_bitlength(encoder_code) != width) {
+            return WIDTH_CHANGE;
+        }
+        if (!decode_refill(s, sync_refill(st, width != 0 ? width : code_bits(st, encoder_code)), flush)) {
+            return LZ78_OK;
+        }
+        uint32_t held = st->acc.bits;
+        uint32_t code = width != 0 ? bits_take(&st->acc, width) : take_code(st, encoder_code);
+        if (code == STOP_CODE) {
+            if (st->sync && bits_take(&st->acc, 1)) {
+                sync_skip(st, held);
+                st->previous_code = STOP_CODE;
+                continue;
+            }
+            if (stop_missing(st)) {
+                return LZ78_DATA_ERROR;
+            }
+            st->finished = true;
+            epoch_end(st, s->total_out);
+            return LZ78_STREAM_END;
+        }
+        if (code == LZW_RESET_CODE) {
+            if (st->reset != LZ78_RESET_ADAPTIVE && !st->indexed) {
+                return LZ78_DATA_ERROR;
+            }
+            table_reset(st, s->total_out);
+            continue;
+        }
+        bool extend = st->previous_code != STOP_CODE && st->next_code < st->max_code;
+        if (code > st->next_code || (code == st->next_code && !extend)) {
+            return LZ78_DATA_ERROR;
+        }
+        STAT(st->stats.phrases[get_bitlength(encoder_code)]++);
+        if (st->matcher != NULL) {
+            st->pending_len = search_code(st, code, extend, s->total_out);
+            continue;
+        }
+        if (!build) {
+            if (extend) {
+                st->phrases[st->next_code++].len = st->phrases[st->previous_code].len + 1;
+            }
+            st->pending_len = code < st->next_code ? st->phrases[code].len : st->phrases[st->previous_code].len + 1;
+            st->previous_code = code;
+            continue;
+        }
+        uint32_t len;
+        uint8_t *dst;
+        if (code < st->next_code) {
+            len = st->phrases[code].len;
+            dst = window_reserve(st, len);
+            phrase_copy(st, code, dst);
+        } else {
+            len = st->phrases[st->previous_code].len + 1;
+            dst = window_reserve(st, len);
+            phrase_copy(st, st->previous_code, dst);
+            dst[len - 1] = dst[0];
+        }
+        if (extend) {
+            st->phrases[st->next_code++] = (Phrase) {
+                .pos = st->previous_pos,
+                .len = st->phrases[st->previous_code].len + 1,
+                .link = st->previous_code | (uint32_t) dst[0] << 24,
+            };
+        }
+        st->previous_code = code;
+        st->previous_pos = st->window_offset + st->window_len;
+        window_emit(st, dst, len);
+    }
+    return LZ78_OK;
+}
+
+/*
+    Decodes like decode_pairs() or decode_codes(), at LZ78_LEVEL_PLAIN with the kernel for the
+    width of the next code, as encode_run() encodes.
+*/
+static int decode_run(LZ78Stream *s, int flush) {
+    LZ78State *st = s->state;
+    if (st->level != LZ78_LEVEL_PLAIN) {
+        return st->lzw ? decode_codes(s, flush, 0) : decode_pairs(s, flush, 0);
+    }
+    int response = WIDTH_CHANGE;
+#define DECODE_WIDTH(w) \
+    case w: \
+        response = st->lzw ? decode_codes(s, flush, w) : decode_pairs(s, flush, w); \
+        break;
+    while (response == WIDTH_CHANGE) {
+        uint32_t n = st->next_code;
+        if (st->lzw) {
+            n += st->previous_code != STOP_CODE && n < st->max_code;
+        }
+        switch (get_bitlength(n)) {
+            FOR_EACH_WIDTH(DECODE_WIDTH)
+        }
+    }
+#undef DECODE_WIDTH
+    return response;
+}
+
+/*
+    Reads the CRC after the final byte and checks the output against it. The final byte's unused
+    bits are dropped first, and any whole bytes the accumulator read ahead are the CRC's. Past the
+    end of a truncated stream they read as zero, and so fail the check. A search has no output to
+    check, so only reads it.
+    Returns LZ78_STREAM_END once the CRC matches.
+*/
+static int decode_trailer(LZ78Stream *s, int flush) {
+    LZ78State *st = s->state;
+    bits_take(&st->acc, st->acc.bits % BYTE);
+    while (st->trailer_len < CRC_SIZE && st->acc.bits > 0) {
+        st->trailer[st->trailer_len++] = (uint8_t) bits_take(&st->acc, BYTE);
+    }
+    while (st->trailer_len < CRC_SIZE && s->avail_in > 0) {
+        st->trailer[st->trailer_len++] = *s->next_in++;
+        s->avail_in--;
+        s->total_in++;
+    }
+    if (st->trailer_len < CRC_SIZE) {
+        return flush == LZ78_FINISH ? LZ78_DATA_ERROR : LZ78_OK;
+    }
+    if (!st->partial && st->matcher == NULL && load_le(st->trailer, CRC_SIZE) != st->crc) {
+        return LZ78_CHECK_ERROR;
+    }
+    return LZ78_STREAM_END;
+}
+
+/*
+    Decompresses next_in into next_out.
+    The CRC is taken over the span of output each call produces, or as it is discarded.
+*/
+int lz78_decode(LZ78Stream *s, int flush) {
+    if (s == NULL || s->state == NULL || s->state->encoding) {
+        return LZ78_PARAM_ERROR;
+    }
+    LZ78State *st = s->state;
+    if (st->phrases == NULL) {
+        int response = decode_header(s, flush);
+        if (response != LZ78_STREAM_END) {
+            return response;
+        }
+    }
+    uint8_t *out = s->next_out;
+    STAT(uint64_t before = s->total_out);
+    int response = decode_run(s, flush);
+    STAT(st->stats.symbols += s->total_out - before);
+    if (st->checksum && st->matcher == NULL) {
+        if (st->discard) {
+            window_checksum(st);
+        } else {
+            st->crc = crc32c(st->crc, out, (size_t) (s->next_out - out));
+        }
+    }
+    if (st->checksum && response == LZ78_STREAM_END) {
+        response = decode_trailer(s, flush);
+    }
+    return response;
+}
+
+/*
+    Reads the header (unless raw) and the index footer, then binary searches the index for the
+    last boundary at or before start. Bit offsets count from the end of the header. The
+    accumulator takes the bits of the boundary's first byte that follow it, and the input ends
+    where the footer starts.
+*/
+int lz78_decode_seek(LZ78Stream *s, const uint8_t *src, size_t src_len, uint64_t start) {
+    if (s == NULL || s->state == NULL || s->state->encoding || s->state->header_len != 0
+        || s->state->acc.bits != 0 || s->total_out != 0) {
+        return LZ78_PARAM_ERROR;
+    }
+    LZ78State *st = s->state;
+    if (!st->raw) {
+        s->next_in = src;
+        s->avail_in = src_len;
+        int response = decode_header(s, LZ78_FINISH);
+        if (response != LZ78_STREAM_END) {
+            return response;
+        }
+    }
+    size_t header_len = st->header_len;
+    if (src_len < header_len + INDEX_TRAILER_SIZE) {
+        return LZ78_DATA_ERROR;
+    }
+    if (!st->indexed) {
+        return LZ78_PARAM_ERROR;
+    }
+
+    const uint8_t *trailer = src + src_len - INDEX_TRAILER_SIZE;
+    uint64_t total = load_le(trailer, 8);
+    uint64_t count = load_le(trailer + 8, 4);
+    if (load_le(trailer + 12, 4) != INDEX_MAGIC || count == 0
+        || count > (src_len - header_len - INDEX_TRAILER_SIZE) / 16) {
+        return LZ78_DATA_ERROR;
+    }
+    if (start > total) {
+        return LZ78_PARAM_ERROR;
+    }
+    const uint8_t *index = trailer - 16 * count;
+    size_t end = (size_t) (index - src);
+    uint64_t low = 0;
+    uint64_t high = count;
+    while (high - low > 1) {
+        uint64_t mid = low + (high - low) / 2;
+        if (load_le(index + 16 * mid + 8, 8) <= start) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    uint64_t bit = load_le(index + 16 * low, 8);
+    uint64_t position = load_le(index + 16 * low + 8, 8);
+    if (bit > BYTE * (end - header_len) || position > start) {
+        return LZ78_DATA_ERROR;
+    }
+
+    size_t byte = header_len + (size_t) (bit / BYTE);
+    s->next_in = src + byte;
+    s->avail_in = end - byte;
+    s->total_in = byte;
+    s->total_out = position;
+    st->epoch_start = position;
+    st->partial = true;
+    if (bit % BYTE != 0) {
+        st->acc.acc = *s->next_in++ >> (bit % BYTE);
+        st->acc.bits = BYTE - (uint32_t) (bit % BYTE);
+        s->avail_in--;
+        s->total_in++;
+    }
+    return LZ78_OK;
+}
+
+/*
+    Frees the decoder's phrase table, window and state.
+*/
+int lz78_decode_end(LZ78Stream *s) {
+    if (s == NULL || s->state == NULL) {
+        return LZ78_PARAM_ERROR;
+    }
+    stats_flush(s->state);
+    free(s->state->phrases);
+    free(s->state->window);
+    matcher_free(s->state->matcher);
+    free(s->state);
+    s->state = NULL;
+    return LZ78_OK;
+}
+
+/*
+    Each pair consumes at least one symbol and takes at most code_bits() of the largest code plus
+    literal_bits(), the longest pair the decoder refills for (see sync_span()): bits bits of code at
+    LZ78_LEVEL_PLAIN and no more as a truncated binary code at LZ78_LEVEL_PHASED; at
+    LZ78_LEVEL_HUFFMAN a slice code of up to HUFF_BITS and fewer than bits bits in the slice; and 8
+    bits of symbol, up to HUFF_BITS at LZ78_LEVEL_HUFFMAN, none in LZW mode. A full dictionary
+    comes after at least a pair per code after the start code, an adaptive reset at most once per
+    RESET_WINDOW bytes and a forced one once per index_interval bytes; each restart may take a
+    reset pair and an index entry. Add the final pair, the STOP pair and a sync point's span, the
+    header and dictionary ID, the CRC, the index footer and an append trailer holding every code.
+*/
+size_t lz78_compress_bound(size_t len, const LZ78Params *params) {
+    LZ78Params p = { 0 };
+    if (params != NULL) {
+        p = *params;
+    }
+    uint8_t bits = p.bits != 0 ? p.bits : LZ78_DEFAULT_BITS;
+    bool huffman = p.level == LZ78_LEVEL_HUFFMAN;
+    size_t pair_bits = (huffman ? HUFF_BITS : 0) + bits + (p.lzw ? 0 : huffman ? HUFF_BITS : BYTE);
+    uint32_t start_code = p.dict != NULL ? p.dict->next_code : p.lzw ? LZW_START_CODE : START_CODE;
+    size_t restarts = len / (max_code(bits) - start_code) + 1;
+    if (p.reset == LZ78_RESET_ADAPTIVE) {
+        restarts += len / RESET_WINDOW;
+    }
+    if (p.index_interval != 0) {
+        restarts += len / p.index_interval;
+    }
+    size_t pair_bytes = (len + restarts + 4) * pair_bits / BYTE + 2;
+    size_t header = p.raw ? 0 : LZ78_HEADER_SIZE + (p.dict != NULL ? DICT_ID_SIZE : 0);
+    size_t crc = p.checksum ? CRC_SIZE : 0;
+    size_t index = p.index || p.index_interval != 0 ? 16 * (restarts + 1) + INDEX_TRAILER_SIZE : 0;
+    size_t models = huffman ? 2 * 12 + 7 * (size_t) (HUFF_SYMBOLS + CODE_SLICES) : 0;
+    size_t entries = 4 * (size_t) max_code(bits);
+    size_t trailer = p.append ? APPEND_STATE_SIZE + entries + models + APPEND_TRAILER_SIZE : 0;
+    return pair_bytes + header + crc + index + trailer;
+}
+
+/*
+    Compresses src into dst in one call.
+*/
+int lz78_compress(uint8_t *dst, size_t *dst_len, const uint8_t *src, size_t src_len,
+    const LZ78Params *params) {
+    LZ78Stream s;
+    int response = lz78_encode_init(&s, params);
+    if (response != LZ78_OK) {
+        return response;
+    }
+    s.next_in = src;
+    s.avail_in = src_len;
+    s.next_out = dst;
+    s.avail_out = *dst_len;
+    response = lz78_encode(&s, LZ78_FINISH);
+    *dst_len = s.total_out;
+    lz78_encode_end(&s);
+    if (response == LZ78_OK) {
+        return LZ78_BUF_ERROR;
+    }
+    return response == LZ78_STREAM_END ? LZ78_OK : response;
+}
+
+/*
+    Decompresses src into dst in one call.
+*/
+int lz78_decompress(uint8_t *dst, size_t *dst_len, const uint8_t *src, size_t src_len,
+    const LZ78Params *params) {
+    LZ78Stream s;
+    int response = lz78_decode_init(&s, params);
+    if (response != LZ78_OK) {
+        return response;
+    }
+    s.next_in = src;
+    s.avail_in = src_len;
+    s.next_out = dst;
+    s.avail_out = *dst_len;
+    response = lz78_decode(&s, LZ78_FINISH);
+    *dst_len = s.total_out;
+    lz78_decode_end(&s);
+    if (response == LZ78_OK) {
+        return LZ78_BUF_ERROR;
+    }
+    return response == LZ78_STREAM_END ? LZ78_OK : response;
+}
+
+/*
+    Searches src in one call, which needs no output buffer.
+*/
+int lz78_search(const uint8_t *src, size_t src_len, const LZ78Params *params) {
+    if (params == NULL || params->pattern == NULL) {
+        return LZ78_PARAM_ERROR;
+    }
+    LZ78Stream s;
+    int response = lz78_decode_init(&s, params);
+    if (response != LZ78_OK) {
+        return response;
+    }
+    s.next_in = src;
+    s.avail_in = src_len;
+    response = lz78_decode(&s, LZ78_FINISH);
+    lz78_decode_end(&s);
+    return response == LZ78_STREAM_END ? LZ78_OK : response;
+}
+
+/*
+    Decompresses part of src into dst in one call, discarding what precedes start in dst itself.
+*/
+int lz78_decompress_range(uint8_t *dst, size_t *dst_len, const uint8_t *src, size_t src_len,
+    uint64_t start, const LZ78Params *params) {
+    LZ78Stream s;
+    int response = lz78_decode_init(&s, params);
+    if (response != LZ78_OK) {
+        return response;
+    }
+    response = lz78_decode_seek(&s, src, src_len, start);
+    while (response == LZ78_OK && s.total_out < start && *dst_len > 0) {
+        uint64_t skip = start - s.total_out;
+        s.next_out = dst;
+        s.avail_out = skip < *dst_len ? (size_t) skip : *dst_len;
+        response = lz78_decode(&s, LZ78_FINISH);
+    }
+    uint64_t first = s.total_out;
+    if (response == LZ78_OK) {
+        s.next_out = dst;
+        s.avail_out = *dst_len;
+        response = lz78_decode(&s, LZ78_FINISH);
+    }
+    *dst_len = response == LZ78_OK || response == LZ78_STREAM_END ? s.total_out - first : 0;
+    lz78_decode_end(&s);
+    return response == LZ78_STREAM_END ? LZ78_OK : response;
+}
@@ -0,0 +1,383 @@
+#ifndef __LZ78_H__
+#define __LZ78_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// liblz78: reentrant LZ78 compression over caller-supplied buffers.
+//
+// Every bit of codec state lives in the LZ78Stream passed to each call, so any number of streams
+// may be coded at once, from any number of threads (one thread per stream at a time).
+//
+
+#define MAGIC 0xBAADBAAC // Unique encoder/decoder magic number.
+
+#define FLAG_CHUNKED     0x0001 // Payload is a chunk container (see chunk.h), not one pair stream.
+#define FLAG_RESET_MASK  0x0006 // Reset policy (LZ78_RESET_*).
+#define FLAG_RESET_SHIFT 1
+#define FLAG_LZW         0x0008 // LZW mode: codes without symbols, over a dictionary seeded with every byte.
+#define FLAG_INDEX       0x0010 // The stream ends with an index footer.
+#define FLAG_CRC         0x0020 // A CRC32C of the input follows the final byte (and each chunk's).
+#define FLAG_LEVEL_MASK  0x00C0 // Entropy stage (LZ78_LEVEL_*).
+#define FLAG_LEVEL_SHIFT 6
+#define FLAG_BITS_MASK   0x1F00 // Code width, or 0 for LZ78_DEFAULT_BITS.
+#define FLAG_BITS_SHIFT  8
+#define FLAG_DICT        0x2000 // Encoded with a preset dictionary, whose ID follows the FileHeader.
+#define FLAG_ARCHIVE     0x4000 // Payload is an archive of many files (see archive.h), not one pair stream.
+#define FLAG_SYNC        0x8000 // The stream may have sync points (LZ78_SYNC).
+// Flags set from LZ78Params.
+#define FLAG_CODEC \
+    (FLAG_RESET_MASK | FLAG_LZW | FLAG_INDEX | FLAG_CRC | FLAG_LEVEL_MASK | FLAG_BITS_MASK | FLAG_DICT \
+        | FLAG_SYNC)
+
+// Code widths. Codes start out narrow and grow to the width, at which point the dictionary resets.
+#define LZ78_MIN_BITS     9
+#define LZ78_MAX_BITS     24
+#define LZ78_DEFAULT_BITS 16
+#define LZ78_MAX_PATTERN  32 // Longest search pattern (LZ78Params.pattern).
+
+// Dictionary reset policies.
+#define LZ78_RESET_FIXED    0 // Start over with an empty dictionary.
+#define LZ78_RESET_ADAPTIVE 1 // As fixed, and also start over whenever the compression ratio degrades.
+#define LZ78_RESET_NEVER    2 // Keep using the full dictionary, adding no more phrases.
+
+// Entropy stages (compression levels), applied to every code and symbol.
+#define LZ78_LEVEL_PLAIN   0 // Codes in get_bitlength(next_code) bits, symbols in 8 bits.
+#define LZ78_LEVEL_PHASED  1 // Codes in truncated binary, which spends no bits on codes not yet assigned.
+#define LZ78_LEVEL_HUFFMAN 2 // Code bit lengths and symbols through adaptive Huffman models (see huffman.h).
+
+//
+// With FLAG_CRC, the final byte is followed by the little-endian CRC32C of the uncompressed data,
+// which the decoder checks once it reads STOP_CODE.
+//
+// Index footer, written after the final byte (and CRC) of an indexed stream (FLAG_INDEX):
+//
+// +----------------------------------------+-------+-------+-------------+
+// | count x (bit offset, uncompressed offset) | total | count | INDEX_MAGIC |
+// +----------------------------------------+-------+-------+-------------+
+//
+// Each entry is a boundary where the dictionary starts over: decoding from that bit offset (counted
+// from the end of the FileHeader and dictionary ID, if any) with a fresh dictionary yields the input
+// from that uncompressed offset on. The first entry is the start of the pairs; the rest are the dictionary resets, in
+// order. Offsets and total (the input size) are little-endian uint64_t, count and INDEX_MAGIC
+// little-endian uint32_t. The explicit reset signal of LZ78_RESET_ADAPTIVE is valid in an indexed
+// stream under any policy, which is how boundaries are forced every index_interval input bytes.
+//
+// Sync points (FLAG_SYNC): in such a stream every STOP_CODE pair (STOP_CODE in LZW mode) but a
+// reset is followed by one bit. 0 ends the stream as usual. 1 is a sync point: the stream goes on
+// from the next byte, the rest of this one being zero bits, with the dictionary as it was. The
+// encoder first codes the phrase it was matching, as if the data ended there; in LZW mode the
+// entry that phrase would have started is not added, so the next code is read as the first after
+// a reset is. Every byte before a sync point thus decodes without any that follow.
+//
+#define INDEX_MAGIC        0xBAADBAAD
+#define INDEX_TRAILER_SIZE 16 // Bytes of total, count and INDEX_MAGIC.
+#define LZ78_MIN_INTERVAL  (1 << 16) // Smallest index_interval.
+
+//
+// Append trailer, written after the final byte (and CRC) of a stream encoded with append, which
+// decoders never read:
+//
+// +-------+---------+--------+-------+------+--------------+
+// | state | entries | models | check | size | APPEND_MAGIC |
+// +-------+---------+--------+-------+------+--------------+
+//
+// It is the encoder's state at a sync point it writes just before the final STOP_CODE, so a later
+// run can cut the stream there and go on, the dictionary and the rest as they were. state is the
+// offset of the end of that sync point (counted like the index's, but in bytes), the input size,
+// the epoch start, the adaptive reset policy's window start, window bits, history bits and history
+// length (uint64_t each), then the CRC, the policy's degraded windows and next_code (uint32_t).
+// entries are the phrases of the codes from the first a reset assigns up to next_code: the trie
+// node of its prefix | its last symbol << 24, or 0 for a code without a node. models, at
+// LZ78_LEVEL_HUFFMAN, are the literal then the code model: until, period and total, then each
+// symbol's count (uint32_t), code (uint16_t) and length (uint8_t). check is the CRC32C of the
+// trailer up to it, size the bytes of the whole trailer. Every field is little-endian.
+//
+#define APPEND_MAGIC        0xBAADBAB0
+#define APPEND_STATE_SIZE   68 // Bytes of the state fields.
+#define APPEND_TRAILER_SIZE 12 // Bytes of check, size and APPEND_MAGIC.
+
+//flags occupies what used to be trailing padding, so older files read as flags == 0.
+typedef struct FileHeader {
+    uint32_t magic;
+    uint16_t protection;
+    uint16_t flags;
+} FileHeader;
+
+#define LZ78_HEADER_SIZE 8 // Bytes a FileHeader takes in a stream (little-endian fields).
+#define DICT_ID_SIZE     4 // Bytes of the little-endian dictionary ID after the FileHeader (FLAG_DICT).
+
+//
+// Preset dictionary, serialized by lz78_dict_train() as little-endian uint32_t fields:
+//
+// +------------+----+------+-------+--------------------------+
+// | DICT_MAGIC | id | mode | count | count x (parent, symbol) |
+// +------------+----+------+-------+--------------------------+
+//
+// The phrases take the codes after START_CODE (after the seeded symbols in LZW mode, mode 1), in
+// order, and each is the phrase of code parent followed by symbol (packed as parent | symbol << 24).
+// Parents come before their children, so a dictionary loads in one pass without replaying the
+// training. id is the CRC32C of the fields after it, so a damaged dictionary fails to load.
+// Streams start out, and start over at every reset, with the dictionary's phrases.
+//
+#define DICT_MAGIC        0xBAADBAAE
+#define DICT_HEADER_SIZE  16 // Bytes before the phrases.
+#define LZ78_DICT_PHRASES 4096 // Default phrase count of a trained dictionary.
+
+typedef struct LZ78Dict LZ78Dict;
+
+// Return codes.
+#define LZ78_OK           0 // Progress was made; call again with more input or output space.
+#define LZ78_STREAM_END   1 // The stream is complete.
+#define LZ78_DATA_ERROR   -1 // The compressed data is malformed.
+#define LZ78_MEM_ERROR    -2 // An allocation failed.
+#define LZ78_BUF_ERROR    -3 // The output buffer is too small (one-shot calls only).
+#define LZ78_MAGIC_ERROR  -4 // The stream does not start with MAGIC.
+#define LZ78_PARAM_ERROR  -5 // Invalid parameters or stream.
+#define LZ78_CHECK_ERROR  -6 // The decompressed data does not match the stream's CRC32C.
+#define LZ78_DICT_ERROR   -7 // The stream needs a preset dictionary that was not given, or another one.
+
+// Flush modes.
+#define LZ78_RUN    0 // More input may follow.
+#define LZ78_FINISH 1 // No more input will be supplied.
+#define LZ78_SYNC   2 // Encoder: end with a sync point once next_in is consumed (needs LZ78Params.sync).
+
+typedef struct LZ78State LZ78State;
+
+//
+// Caller-facing stream, in the style of zlib's z_stream. Set next_in/avail_in and
+// next_out/avail_out before each call; the library advances them and the totals.
+//
+typedef struct LZ78Stream {
+    const uint8_t *next_in;
+    size_t avail_in;
+    uint64_t total_in;
+
+    uint8_t *next_out;
+    size_t avail_out;
+    uint64_t total_out;
+
+    FileHeader header; // Header written by the encoder, or read by the decoder.
+
+    LZ78State *state;
+} LZ78Stream;
+
+//
+// Codec counters. They are only kept when liblz78 is built with LZ78_STATS defined (make STATS=1),
+// so the hot loops pay nothing for them otherwise, and stay zero. A stream adds its own to
+// LZ78Params.stats as it ends, atomically, so streams on any number of threads may share one.
+//
+typedef struct LZ78Stats {
+    uint64_t symbols; // Uncompressed bytes coded.
+    uint64_t steps; // Encoder: symbols that extended the current phrase through the trie.
+    uint64_t inserts; // Encoder: phrases added to the trie.
+    uint64_t blocks[4]; // Encoder: trie child blocks allocated, for 4, 16, 48 and 256 children.
+    uint64_t resets; // Dictionary restarts.
+    uint64_t phrases[LZ78_MAX_BITS + 1]; // Pairs (codes in LZW mode) by the code width they took.
+    uint64_t window_links; // Decoder: symbols rebuilt from phrase links, their phrase having left the window.
+} LZ78Stats;
+
+//
+// Stream parameters. A NULL LZ78Params * selects the defaults (all fields zero). Raw decoders must
+// be given the bits, reset, lzw, index, checksum, level, sync and dict the stream was encoded with;
+// other decoders read them from the header, except dict, which must be given and match the header's ID.
+// With discard, an encoder learns the exact compressed size and a decoder checks the stream (codes,
+// STOP_CODE and any CRC) without either writing its output; a decoder without a CRC to check does
+// not even build it.
+//
+typedef struct LZ78Params {
+    uint16_t protection; // Mode bits recorded in the header by the encoder.
+    bool raw; // No FileHeader: the stream is only the pairs.
+    uint8_t bits; // Code width, 0 for LZ78_DEFAULT_BITS.
+    uint8_t reset; // Reset policy, LZ78_RESET_*.
+    bool lzw; // LZW mode (FLAG_LZW).
+    bool index; // Write an index footer (FLAG_INDEX).
+    bool checksum; // Write and check a CRC32C of the uncompressed data (FLAG_CRC).
+    uint8_t level; // Entropy stage, LZ78_LEVEL_*.
+    bool sync; // Allow sync points (FLAG_SYNC).
+    uint64_t index_interval; // Encoder: also force a boundary every index_interval bytes (implies index), or 0.
+    size_t memory; // Most bytes the stream may take (see lz78_memory_bound()), or 0 for no limit.
+    bool discard; // Only count the output in total_out: next_out and avail_out are not used.
+    bool append; // Encoder: end with an append trailer (implies sync; not with index).
+    const uint8_t *pattern; // Decoder: search the output for these bytes instead (see lz78_search()).
+    uint32_t pattern_len; // Bytes of pattern, 1 to LZ78_MAX_PATTERN.
+    // Called, with a pattern, for each match in order, with the uncompressed offset and line (the
+    // newlines before it) of its first byte.
+    void (*match)(void *opaque, uint64_t offset, uint64_t line);
+    const LZ78Dict *dict; // Preset dictionary (FLAG_DICT), or NULL. Must outlive the stream.
+    LZ78Stats *stats; // Counters the stream adds its own to as it ends, or NULL.
+    // Called, if set, on the coding thread as each dictionary epoch ends: at every restart and at the
+    // end of the stream, with the uncompressed offsets the epoch spanned. Used for tracing.
+    void (*epoch)(void *opaque, uint64_t start, uint64_t end);
+    void *opaque; // Passed to epoch and match.
+} LZ78Params;
+
+//
+// Prepares s for compression. Returns LZ78_OK or LZ78_MEM_ERROR.
+//
+int lz78_encode_init(LZ78Stream *s, const LZ78Params *params);
+
+//
+// Compresses as much of next_in as fits in next_out. Pass LZ78_FINISH once all input has been
+// supplied, and keep calling with more output space until LZ78_STREAM_END is returned.
+// Pass LZ78_SYNC to make everything supplied so far decodable from the output, for a reader at
+// the other end of a pipe or socket: once next_in is consumed a sync point ends the output, which
+// is complete when a call returns LZ78_OK with avail_out left over. A sync point with no input
+// since the last one adds nothing. Returns LZ78_PARAM_ERROR for LZ78_SYNC unless params had sync.
+//
+int lz78_encode(LZ78Stream *s, int flush);
+
+//
+// Frees the state of a compression stream.
+//
+int lz78_encode_end(LZ78Stream *s);
+
+//
+// Prepares s to continue the stream whose append trailer is the len bytes at trailer, encoded with
+// params (which must be raw, as the stream has its header already, and set append). *offset is set
+// to where the output goes on: the stream's bytes after the header (and dictionary ID) that are
+// kept, the rest to be replaced. total_in goes on from the stream's input size. Returns
+// LZ78_PARAM_ERROR for params the stream cannot have been encoded with, LZ78_DATA_ERROR for a
+// malformed trailer, or LZ78_MEM_ERROR.
+//
+int lz78_encode_resume(LZ78Stream *s, const LZ78Params *params, const uint8_t *trailer, size_t len,
+    uint64_t *offset);
+
+//
+// Prepares s for decompression. Returns LZ78_OK or LZ78_MEM_ERROR.
+//
+int lz78_decode_init(LZ78Stream *s, const LZ78Params *params);
+
+//
+// Decompresses as much of next_in as fits in next_out. Returns LZ78_STREAM_END after the STOP_CODE
+// (and the CRC, if any, which must match), LZ78_OK if more input or output space is needed, or an
+// error. Pass LZ78_FINISH once all input has been supplied: missing trailing bits then read as
+// zero, as the encoder's final byte is truncated (unless a CRC or an index follows it).
+//
+int lz78_decode(LZ78Stream *s, int flush);
+
+//
+// Frees the state of a decompression stream.
+//
+int lz78_decode_end(LZ78Stream *s);
+
+//
+// Prepares s, fresh from lz78_decode_init(), to decode the indexed stream src of src_len bytes
+// (the whole stream, footer included) from uncompressed offset start. Positions next_in at the
+// last boundary at or before start and sets total_out to that boundary's offset, so the first
+// start - total_out bytes decoded precede start. The CRC, which covers the whole stream, is not
+// checked after a seek. Returns LZ78_PARAM_ERROR if the stream has no
+// index or start lies past its end, or LZ78_DATA_ERROR if the index is malformed.
+//
+int lz78_decode_seek(LZ78Stream *s, const uint8_t *src, size_t src_len, uint64_t start);
+
+//
+// Most bytes an encoder (encoding) or decoder with params takes, whatever its input: its state and
+// trie, or its state, phrase table and output window. They are allocated up front, but only
+// touched as the dictionary fills. An index adds 16 bytes per boundary. With params->memory set,
+// the decoder's window shrinks to fit, down to the least that holds any phrase, and if the bound
+// is still over memory lz78_encode_init() and lz78_decode_init() (or, once it has read the header,
+// lz78_decode()) return LZ78_PARAM_ERROR.
+//
+size_t lz78_memory_bound(const LZ78Params *params, bool encoding);
+
+//
+// Most bytes the stream has touched so far: its state, and the part of its trie, or of its phrase
+// table and window, that it has filled at its fullest.
+//
+size_t lz78_memory_peak(const LZ78Stream *s);
+
+//
+// Whether liblz78 was built with LZ78_STATS, and so fills LZ78Params.stats.
+//
+bool lz78_stats_enabled(void);
+
+//
+// Header flags recording the bits, reset, lzw, index, checksum, level, sync and dict of params (the
+// FLAG_CODEC flags).
+//
+uint16_t lz78_header_flags(const LZ78Params *params);
+
+//
+// Fills params with the protection, bits, reset, lzw, index, checksum, level and sync recorded in
+// header. dict is left NULL: with FLAG_DICT, the caller supplies the dictionary whose ID follows the header.
+// Returns false if the header has flags this version does not know or records invalid parameters.
+//
+bool lz78_header_params(const FileHeader *header, LZ78Params *params);
+
+//
+// Largest compressed size (header included, unless raw) of len bytes of input with params, which
+// may be NULL for the defaults. The worst case per pair grows with the code width and the level.
+//
+size_t lz78_compress_bound(size_t len, const LZ78Params *params);
+
+//
+// One-shot compression of src into dst. *dst_len holds the capacity of dst on entry (at least
+// lz78_compress_bound(src_len, params) always suffices) and the compressed size on return.
+//
+int lz78_compress(uint8_t *dst, size_t *dst_len, const uint8_t *src, size_t src_len,
+    const LZ78Params *params);
+
+//
+// One-shot decompression of src into dst. *dst_len holds the capacity of dst on entry and the
+// decompressed size on return. Returns LZ78_BUF_ERROR if dst is too small.
+//
+int lz78_decompress(uint8_t *dst, size_t *dst_len, const uint8_t *src, size_t src_len,
+    const LZ78Params *params);
+
+//
+// One-shot decompression of the *dst_len bytes of the indexed stream src starting at uncompressed
+// offset start, decoding only from the nearest boundary. *dst_len is the decompressed size on
+// return, short if the stream ends first.
+//
+int lz78_decompress_range(uint8_t *dst, size_t *dst_len, const uint8_t *src, size_t src_len,
+    uint64_t start, const LZ78Params *params);
+
+//
+// One-shot search of the stream src for params->pattern, passing each match to params->match.
+// Any decoder given a pattern searches this way: it follows the pairs with a matcher state per
+// code instead of building the output, which it only counts in total_out, as with discard. The
+// codes are checked as in decompression, but a CRC is only read, there being no output to check.
+//
+int lz78_search(const uint8_t *src, size_t src_len, const LZ78Params *params);
+
+//
+// Largest serialized dictionary of phrases phrases.
+//
+size_t lz78_dict_bound(uint32_t phrases);
+
+//
+// Trains a dictionary of up to phrases phrases (LZ78_DICT_PHRASES if 0) on the samples_len bytes of
+// samples, for streams with the lzw mode and at least the code width of params, and serializes it
+// into dst. *dst_len holds the capacity of dst on entry (lz78_dict_bound(phrases) suffices) and the
+// dictionary's size on return. The phrases most used while parsing the samples are kept.
+//
+int lz78_dict_train(uint8_t *dst, size_t *dst_len, const uint8_t *samples, size_t samples_len,
+    uint32_t phrases, const LZ78Params *params);
+
+//
+// Loads the serialized dictionary src of src_len bytes into *dict, which may then be shared by
+// any number of streams at once. src is not referenced afterwards. Returns LZ78_OK,
+// LZ78_DATA_ERROR if src is not a valid dictionary, or LZ78_MEM_ERROR.
+//
+int lz78_dict_load(LZ78Dict **dict, const uint8_t *src, size_t src_len);
+
+//
+// Whether streams with the lzw mode and code width of params can use dict: it must have been
+// trained for the same mode, and a width at most params'.
+//
+bool lz78_dict_fits(const LZ78Dict *dict, const LZ78Params *params);
+
+//
+// ID recorded in the header of streams encoded with dict.
+//
+uint32_t lz78_dict_id(const LZ78Dict *dict);
+
+//
+// Frees a dictionary loaded by lz78_dict_load().
+//
+void lz78_dict_free(LZ78Dict *dict);
+
+#endif
@@ -0,0 +1,60 @@
+#include "match.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+Matcher *matcher_create(const uint8_t *pattern, uint32_t len, uint32_t max_code, uint32_t root,
+    void (*match)(void *opaque, uint64_t offset, uint64_t line), void *opaque) {
+    Matcher *m = (Matcher *) calloc(1, sizeof(Matcher));
+    if (m == NULL) {
+        return NULL;
+    }
+    m->codes = (MatchCode *) malloc(((size_t) max_code + 1) * sizeof(MatchCode));
+    m->hits = (uint32_t *) malloc((size_t) max_code * sizeof(uint32_t));
+    if (m->codes == NULL || m->hits == NULL) {
+        matcher_free(m);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+        m->masks[pattern[i]] |= (uint32_t) 1 << i;
+        m->pattern_lines += pattern[i] == '\n';
+    }
+    m->last = (uint32_t) 1 << (len - 1);
+    m->len = len;
+    m->codes[root] = (MatchCode) { .inside = UINT32_MAX };
+    m->match = match;
+    m->opaque = opaque;
+    return m;
+}
+
+void matcher_free(Matcher *m) {
+    if (m != NULL) {
+        free(m->codes);
+        free(m->hits);
+        free(m);
+    }
+}
+
+/*
+    The matches that began in earlier output end within the phrase's first len - 1 bytes, the
+    one of bit i at byte len - 2 - i, so they come first, highest bit first. The rest follow the
+    chain of hits, which finds them from the last back, and so are collected first.
+*/
+void matcher_report(Matcher *m, uint32_t code, uint64_t offset, uint32_t crossing) {
+    const MatchCode *c = &m->codes[code];
+    while (crossing != 0) {
+        int i = 31 - __builtin_clz(crossing);
+        crossing &= ~((uint32_t) 1 << i);
+        uint32_t end = m->len - 2 - (uint32_t) i;
+        uint64_t lines = m->lines + (uint64_t) __builtin_popcount(c->newlines & (((uint32_t) 2 << end) - 1));
+        m->match(m->opaque, offset + end + 1 - m->len, lines - m->pattern_lines);
+    }
+    uint32_t count = 0;
+    for (uint32_t hit = c->hit; hit != 0; hit = m->codes[m->codes[hit].link & 0xFFFFFF].hit) {
+        m->hits[count++] = hit;
+    }
+    while (count > 0) {
+        const MatchCode *h = &m->codes[m->hits[--count]];
+        m->match(m->opaque, offset + h->len - m->len, m->lines + h->lines - m->pattern_lines);
+    }
+}
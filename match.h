@@ -0,0 +1,96 @@
+#ifndef __MATCH_H__
+#define __MATCH_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Matcher for a pattern in the decoder's phrases, without building them.
+//
+// The matcher is Shift-And: bit i of a state is set when the text so far ends with the pattern's
+// first i + 1 bytes. Every code keeps what the matcher needs to go over its whole phrase at once,
+// built from its parent's in O(1) as the code is assigned:
+//   ends    the state after the phrase alone, from no match;
+//   inside  bit i set when the pattern's first i + 1 bytes end with the phrase, through which
+//           a state's bits carry if the phrase is shorter than the pattern;
+//   starts  bit i set when the pattern's bytes after its first i + 1 begin the phrase, so a
+//           state's bit i means a match ending in the phrase;
+//   hit     the longest prefix of the phrase (the phrase included) that ends with the pattern,
+//           or STOP_CODE, each match inside the phrase being one of the chain of hits of hit's
+//           parents.
+// Line numbers come from the newlines each phrase holds, and those among its first bytes.
+//
+typedef struct MatchCode {
+    uint32_t ends;
+    uint32_t inside;
+    uint32_t starts;
+    uint32_t newlines; // Bit i set when byte i of the phrase is a newline, for its first 32 bytes.
+    uint32_t lines; // Newlines in the phrase.
+    uint32_t link; // Parent code | first byte of the phrase (which LZW entries end with) << 24.
+    uint32_t hit;
+    uint32_t len;
+} MatchCode;
+
+typedef struct Matcher {
+    uint32_t masks[256]; // Bit i set in masks[sym] when the pattern's byte i is sym.
+    uint32_t last; // Bit of the pattern's last byte.
+    uint32_t len;
+    uint32_t pattern_lines; // Newlines in the pattern.
+    uint32_t state; // The matcher's state after the output so far.
+    uint64_t lines; // Newlines in the output so far.
+    MatchCode *codes; // By code, with one more for a phrase that gets no code.
+    uint32_t *hits; // Matches inside the current phrase, last first.
+    void (*match)(void *opaque, uint64_t offset, uint64_t line);
+    void *opaque;
+} Matcher;
+
+//
+// Allocates a matcher for the len bytes of pattern (1 to 32, a bit of a uint32_t each) over codes
+// up to max_code, the empty phrase at root. match is told the offset and line (counted from 0) of the
+// start of every match, in order. Returns NULL if an allocation fails.
+//
+Matcher *matcher_create(const uint8_t *pattern, uint32_t len, uint32_t max_code, uint32_t root,
+    void (*match)(void *opaque, uint64_t offset, uint64_t line), void *opaque);
+
+void matcher_free(Matcher *m);
+
+//
+// Reports the matches that end in the phrase of code, at offset, given that some do.
+//
+void matcher_report(Matcher *m, uint32_t code, uint64_t offset, uint32_t crossing);
+
+//
+// Assigns code the phrase of parent followed by sym.
+//
+static inline void matcher_add(Matcher *m, uint32_t code, uint32_t parent, uint8_t sym) {
+    const MatchCode *p = &m->codes[parent];
+    MatchCode *c = &m->codes[code];
+    uint32_t mask = m->masks[sym];
+    c->ends = ((p->ends << 1) | 1) & mask;
+    c->inside = ((p->inside << 1) | (p->len == 0)) & mask;
+    c->len = p->len + 1;
+    c->starts = p->starts;
+    if (c->len < m->len && (c->inside & m->last)) {
+        c->starts |= m->last >> c->len;
+    }
+    c->hit = (c->ends & m->last) ? code : p->hit;
+    c->lines = p->lines + (sym == '\n');
+    c->newlines = p->newlines | (uint32_t) (sym == '\n' && p->len < 32) << (p->len & 31);
+    c->link = parent | (uint32_t) (p->len == 0 ? sym : p->link >> 24) << 24;
+}
+
+//
+// Runs the matcher over the phrase of code, output at offset. Returns the phrase's length.
+//
+static inline uint32_t matcher_phrase(Matcher *m, uint32_t code, uint64_t offset) {
+    const MatchCode *c = &m->codes[code];
+    uint32_t crossing = m->state & c->starts;
+    if (crossing != 0 || c->hit != 0) {
+        matcher_report(m, code, offset, crossing);
+    }
+    m->state = c->ends | (c->len < m->len ? (m->state << c->len) & c->inside : 0);
+    m->lines += c->lines;
+    return c->len;
+}
+
+#endif
@@ -0,0 +1,148 @@
+#include "pipeline.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#else
+#include <sched.h>
+#endif
+
+#define CACHE_LINE 64
+#define SPINS      256 // Checks of a counter before sleeping on it.
+
+//Each counter only ever grows, one side storing it and the other waiting on it, so each lives on
+//its own cache line with the flag that tells the storing side to wake the other.
+struct Pipeline {
+    uint32_t depth;
+    int64_t *results;
+    _Alignas(CACHE_LINE) atomic_uint head; // Buffers published, stored by the producer.
+    atomic_bool head_waiter; // Consumer is, or is about to be, asleep on head.
+    _Alignas(CACHE_LINE) atomic_uint tail; // Buffers released, stored by the consumer.
+    atomic_bool tail_waiter;
+    atomic_bool stopped;
+};
+
+/*
+    Sleeps while *word still holds seen. Spurious returns are fine: callers loop.
+*/
+static void futex_wait(atomic_uint *word, uint32_t seen) {
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *) word, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+#else
+    (void) word;
+    (void) seen;
+    sched_yield();
+#endif
+}
+
+static void futex_wake(atomic_uint *word) {
+#ifdef __linux__
+    syscall(SYS_futex, (uint32_t *) word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+    (void) word;
+#endif
+}
+
+/*
+    Waits for *word to differ from seen, spinning first and then sleeping with *waiter raised.
+    The waiter flag is raised before the last check and the other side stores the counter before
+    looking at the flag, so one of them always sees the other (both are sequentially consistent).
+*/
+static void wait_change(atomic_uint *word, uint32_t seen, atomic_bool *waiter) {
+    for (int i = 0; i < SPINS; i++) {
+        if (atomic_load_explicit(word, memory_order_acquire) != seen) {
+            return;
+        }
+    }
+    atomic_store(waiter, true);
+    if (atomic_load(word) == seen) {
+        futex_wait(word, seen);
+    }
+    atomic_store(waiter, false);
+}
+
+/*
+    Stores a new counter value and wakes the other side if it went to sleep on it.
+*/
+static void advance(atomic_uint *word, uint32_t value, atomic_bool *waiter) {
+    atomic_store(word, value);
+    if (atomic_load(waiter)) {
+        futex_wake(word);
+    }
+}
+
+Pipeline *pipeline_create(uint32_t depth) {
+    Pipeline *p = (Pipeline *) aligned_alloc(CACHE_LINE, (sizeof(Pipeline) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+    if (p == NULL) {
+        return NULL;
+    }
+    p->results = (int64_t *) calloc(depth, sizeof(int64_t));
+    if (p->results == NULL) {
+        free(p);
+        return NULL;
+    }
+    p->depth = depth;
+    atomic_init(&p->head, 0);
+    atomic_init(&p->head_waiter, false);
+    atomic_init(&p->tail, 0);
+    atomic_init(&p->tail_waiter, false);
+    atomic_init(&p->stopped, false);
+    return p;
+}
+
+int32_t pipeline_claim(Pipeline *p) {
+    uint32_t head = atomic_load_explicit(&p->head, memory_order_relaxed);
+    for (;;) {
+        if (atomic_load(&p->stopped)) {
+            return -1;
+        }
+        uint32_t tail = atomic_load_explicit(&p->tail, memory_order_acquire);
+        if (head - tail < p->depth) {
+            return (int32_t) (head % p->depth);
+        }
+        wait_change(&p->tail, tail, &p->tail_waiter);
+    }
+}
+
+void pipeline_publish(Pipeline *p, int64_t result) {
+    uint32_t head = atomic_load_explicit(&p->head, memory_order_relaxed);
+    p->results[head % p->depth] = result;
+    advance(&p->head, head + 1, &p->head_waiter);
+}
+
+uint32_t pipeline_take(Pipeline *p, int64_t *result) {
+    uint32_t tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+    uint32_t head;
+    while ((head = atomic_load_explicit(&p->head, memory_order_acquire)) == tail) {
+        wait_change(&p->head, head, &p->head_waiter);
+    }
+    *result = p->results[tail % p->depth];
+    return tail % p->depth;
+}
+
+void pipeline_release(Pipeline *p) {
+    uint32_t tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+    advance(&p->tail, tail + 1, &p->tail_waiter);
+}
+
+/*
+    Moving tail as well makes a producer that is about to sleep on it return instead.
+*/
+void pipeline_stop(Pipeline *p) {
+    atomic_store(&p->stopped, true);
+    uint32_t tail = atomic_load_explicit(&p->tail, memory_order_relaxed);
+    advance(&p->tail, tail + 1, &p->tail_waiter);
+}
+
+void pipeline_delete(Pipeline *p) {
+    if (p == NULL) {
+        return;
+    }
+    free(p->results);
+    free(p);
+}
@@ -0,0 +1,49 @@
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include <stdint.h>
+
+//
+// Lock-free hand-off of a fixed ring of buffers from one producer thread to one consumer thread.
+// The buffers themselves belong to the caller; the pipeline only passes their indices, in order,
+// each with a result (bytes filled, or whatever the two sides agree on). Either side spins briefly
+// and then sleeps in the kernel only when the ring is empty or full.
+//
+
+typedef struct Pipeline Pipeline;
+
+//
+// Creates a pipeline over depth buffers, all of them free for the producer.
+// Returns NULL if it could not be allocated.
+//
+Pipeline *pipeline_create(uint32_t depth);
+
+//
+// Producer: waits for the next buffer to be free and returns its index, or -1 once the pipeline
+// is stopped. Claiming again before publishing returns the same buffer.
+//
+int32_t pipeline_claim(Pipeline *p);
+
+//
+// Producer: hands the claimed buffer to the consumer along with result.
+//
+void pipeline_publish(Pipeline *p, int64_t result);
+
+//
+// Consumer: waits for the next published buffer, stores its result and returns its index.
+//
+uint32_t pipeline_take(Pipeline *p, int64_t *result);
+
+//
+// Consumer: hands the buffer last taken back to the producer.
+//
+void pipeline_release(Pipeline *p);
+
+//
+// Consumer: makes pipeline_claim return -1 from now on, waking a producer waiting for a buffer.
+//
+void pipeline_stop(Pipeline *p);
+
+void pipeline_delete(Pipeline *p);
+
+#endif
@@ -0,0 +1,110 @@
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define CACHE_LINE 64
+
+//A worker's queue: the tasks worker + k * threads for front <= k < back, which only ever
+//shrinks, from the front by its owner and from the back by thieves.
+typedef struct Queue {
+    _Alignas(CACHE_LINE) pthread_mutex_t lock;
+    uint32_t front;
+    uint32_t back;
+} Queue;
+
+typedef struct Pool {
+    uint32_t threads;
+    PoolTask run;
+    void *context;
+    Queue *queues;
+} Pool;
+
+//What a thread needs to find its pool and its own queue.
+typedef struct Worker {
+    Pool *pool;
+    uint32_t id;
+} Worker;
+
+/*
+    Takes the next task from the front of the worker's own queue, or from the back of the
+    first other queue that has one. Returns false once every queue is empty.
+*/
+static bool next_task(Pool *pool, uint32_t id, uint32_t *task) {
+    for (uint32_t i = 0; i < pool->threads; i++) {
+        uint32_t victim = (id + i) % pool->threads;
+        Queue *queue = &pool->queues[victim];
+        pthread_mutex_lock(&queue->lock);
+        bool found = queue->front < queue->back;
+        if (found) {
+            uint32_t k = i == 0 ? queue->front++ : --queue->back;
+            *task = victim + k * pool->threads;
+        }
+        pthread_mutex_unlock(&queue->lock);
+        if (found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    Thread body: runs tasks until none are left anywhere.
+*/
+static void *pool_worker(void *arg) {
+    Worker *worker = (Worker *) arg;
+    Pool *pool = worker->pool;
+    uint32_t task;
+    while (next_task(pool, worker->id, &task)) {
+        pool->run(pool->context, worker->id, task);
+    }
+    return NULL;
+}
+
+/*
+    Runs everything on the calling thread if there is one thread or the queues cannot be allocated.
+*/
+void pool_run(uint32_t threads, uint32_t count, PoolTask run, void *context) {
+    if (threads > count) {
+        threads = count;
+    }
+    Queue *queues = threads > 1 ? (Queue *) aligned_alloc(CACHE_LINE, threads * sizeof(Queue)) : NULL;
+    Worker *workers = threads > 1 ? (Worker *) malloc(threads * sizeof(Worker)) : NULL;
+    pthread_t *handles = threads > 1 ? (pthread_t *) malloc(threads * sizeof(pthread_t)) : NULL;
+    if (queues == NULL || workers == NULL || handles == NULL) {
+        free(queues);
+        free(workers);
+        free(handles);
+        for (uint32_t task = 0; task < count; task++) {
+            run(context, 0, task);
+        }
+        return;
+    }
+
+    Pool pool = { .threads = threads, .run = run, .context = context, .queues = queues };
+    for (uint32_t i = 0; i < threads; i++) {
+        pthread_mutex_init(&queues[i].lock, NULL);
+        queues[i].front = 0;
+        queues[i].back = (count - i + threads - 1) / threads;
+        workers[i] = (Worker) { .pool = &pool, .id = i };
+    }
+    //A thread that fails to start leaves its queue to be stolen by the others.
+    bool *started = (bool *) calloc(threads, sizeof(bool));
+    for (uint32_t i = 1; i < threads && started != NULL; i++) {
+        started[i] = pthread_create(&handles[i], NULL, pool_worker, &workers[i]) == 0;
+    }
+    pool_worker(&workers[0]);
+    for (uint32_t i = 1; i < threads && started != NULL; i++) {
+        if (started[i]) {
+            pthread_join(handles[i], NULL);
+        }
+    }
+    for (uint32_t i = 0; i < threads; i++) {
+        pthread_mutex_destroy(&queues[i].lock);
+    }
+    free(started);
+    free(handles);
+    free(workers);
+    free(queues);
+}
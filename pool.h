@@ -0,0 +1,26 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <stdint.h>
+
+//
+// Work-stealing thread pool for tasks of uneven size, such as the parts of an archive's files.
+// Tasks 0 to count - 1 are dealt out in turn to the threads' own queues, task i to thread
+// i % threads, so callers order them largest first. A thread runs its own queue from the front;
+// once it is empty it steals from the back of the others', where the smallest tasks wait, so the
+// threads finish at about the same time without contending for one shared queue.
+//
+
+//
+// Runs task on worker worker, numbered from 0 to threads - 1. A worker runs one task at a time,
+// so per-worker buffers need no locking.
+//
+typedef void (*PoolTask)(void *context, uint32_t worker, uint32_t task);
+
+//
+// Runs count tasks through run on up to threads threads, the calling thread (worker 0) included,
+// and returns once all of them are done.
+//
+void pool_run(uint32_t threads, uint32_t count, PoolTask run, void *context);
+
+#endif
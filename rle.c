@@ -0,0 +1,99 @@
+#include "rle.h"
+
+#include <string.h>
+
+/*
+    Writes the token v and the n bytes at bytes at out + *pos, advancing *pos.
+    Returns false, writing nothing, if they would take out past cap bytes.
+*/
+static bool put_token(uint8_t *out, size_t *pos, size_t cap, uint64_t v, const uint8_t *bytes, size_t n) {
+    size_t size = 1;
+    for (uint64_t rest = v; rest >= 0x80; rest >>= 7) {
+        size++;
+    }
+    if (cap - *pos < size + n) {
+        return false;
+    }
+    while (v >= 0x80) {
+        out[(*pos)++] = (uint8_t) (v | 0x80);
+        v >>= 7;
+    }
+    out[(*pos)++] = (uint8_t) v;
+    memcpy(out + *pos, bytes, n);
+    *pos += n;
+    return true;
+}
+
+/*
+    Reads a token from in + *pos, of len bytes, into *v, advancing *pos.
+    Returns false if it is cut short or longer than 64 bits.
+*/
+static bool get_token(const uint8_t *in, size_t len, size_t *pos, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64 && *pos < len; shift += 7) {
+        uint8_t byte = in[(*pos)++];
+        *v |= (uint64_t) (byte & 0x7F) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+    Codes each run of at least RLE_MIN_RUN equal bytes as a run token, and the bytes between runs
+    as literal tokens.
+*/
+size_t rle_encode(const uint8_t *in, size_t len, uint8_t *out, size_t cap) {
+    size_t pos = 0;
+    size_t literals = 0; // Start of the literals not yet written.
+    size_t i = 0;
+    while (i < len) {
+        size_t run = 1;
+        while (i + run < len && in[i + run] == in[i]) {
+            run++;
+        }
+        if (run >= RLE_MIN_RUN) {
+            if ((i > literals && !put_token(out, &pos, cap, (uint64_t) (i - literals - 1) << 1, in + literals,
+                                     i - literals))
+                || !put_token(out, &pos, cap, (uint64_t) (run - RLE_MIN_RUN) << 1 | 1, in + i, 1)) {
+                return 0;
+            }
+            literals = i + run;
+        }
+        i += run;
+    }
+    if (len > literals
+        && !put_token(out, &pos, cap, (uint64_t) (len - literals - 1) << 1, in + literals, len - literals)) {
+        return 0;
+    }
+    return pos;
+}
+
+/*
+    Expands each token with memcpy() or memset(), checking that none runs past either buffer.
+*/
+bool rle_decode(const uint8_t *in, size_t len, uint8_t *out, size_t out_len) {
+    size_t pos = 0;
+    size_t done = 0;
+    while (pos < len) {
+        uint64_t v;
+        if (!get_token(in, len, &pos, &v)) {
+            return false;
+        }
+        bool run = v & 1;
+        uint64_t count = (v >> 1) + (run ? RLE_MIN_RUN : 1);
+        size_t bytes = run ? 1 : (size_t) count;
+        if (count > out_len - done || bytes > len - pos) {
+            return false;
+        }
+        if (out != NULL && run) {
+            memset(out + done, in[pos], count);
+        } else if (out != NULL) {
+            memcpy(out + done, in + pos, count);
+        }
+        pos += bytes;
+        done += count;
+    }
+    return done == out_len;
+}
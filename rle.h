@@ -0,0 +1,30 @@
+#ifndef __RLE_H__
+#define __RLE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RLE_MIN_RUN 4 // Shortest run of one byte coded as a run rather than as literals.
+
+//
+// Run-length coding, for blocks (see chunk.h) that are mostly runs of a single byte, which LZ78
+// only learns one byte longer per occurrence.
+//
+// The data is a sequence of tokens, each an unsigned LEB128 varint v followed by its bytes. An even
+// v is followed by v / 2 + 1 literal bytes; an odd v by one byte, repeated v / 2 + RLE_MIN_RUN times.
+//
+
+//
+// Codes the len bytes at in into out, writing at most cap bytes. Returns the coded size, or 0 if it
+// would take more than cap bytes (or len is 0).
+//
+size_t rle_encode(const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+
+//
+// Decodes the len bytes at in into exactly out_len bytes at out, or only checks them if out is NULL.
+// Returns false if they are malformed or do not decode to out_len bytes.
+//
+bool rle_decode(const uint8_t *in, size_t len, uint8_t *out, size_t out_len);
+
+#endif
@@ -0,0 +1,178 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "io.h"
+#include "lz78.h"
+#include "helpers.h"
+#include "trace.h"
+
+//Where the matches go, and what has been reported of them.
+typedef struct Results {
+    FILE *out;
+    bool count;
+    bool lines;
+    uint64_t matches; // Matches, or with lines lines with matches.
+    uint64_t line; // Line of the last match.
+} Results;
+
+bool search(Reader *reader, const LZ78Params *params);
+void print_help(void);
+
+/*
+    Main function that gets arguments and searches the input for the pattern after the options.
+    Exits with 0 if it is found, 1 if not and 2 on errors, as grep does.
+*/
+int main(int argc, char **argv) {
+    uint64_t started = trace_now();
+    Options options = { .input_file = 0, .output_file = 1 };
+
+    int response = argparser(argc, argv, &options);
+
+    if (response == 4) {
+        print_help();
+        return 0;
+    }
+
+    if (response != 0) {
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        if (options.help) {
+            print_help();
+        }
+        return 2;
+    }
+
+    size_t pattern_len = optind == argc - 1 ? strlen(argv[optind]) : 0;
+    if (pattern_len == 0 || pattern_len > LZ78_MAX_PATTERN) {
+        fprintf(stderr, "Give one pattern of 1 to %d bytes\n", LZ78_MAX_PATTERN);
+        return 2;
+    }
+    FileHeader fileheader;
+    if (!read_decode_header(options.input_file, -1, &fileheader)) {
+        fprintf(stderr, "Bad Magic Number\n");
+        return 2;
+    }
+    LZ78Params params;
+    if (!lz78_header_params(&fileheader, &params)) {
+        fprintf(stderr, "Corrupt file\n");
+        return 2;
+    }
+    if (fileheader.flags & (FLAG_CHUNKED | FLAG_ARCHIVE)) {
+        fprintf(stderr, "Only single streams can be searched\n");
+        return 2;
+    }
+    LZ78Dict *dict = NULL;
+    if (fileheader.flags & FLAG_DICT) {
+        dict = read_dict_id(options.input_file, options.dict_file);
+        params.dict = dict;
+    }
+    LZ78Stats stats = { 0 };
+    if (options.stats) {
+        params.stats = &stats;
+    }
+
+    Results results = { .out = fdopen(options.output_file, "w"), .count = options.count, .lines = options.lines };
+    Reader reader;
+    if (results.out == NULL || !reader_open(&reader, options.input_file, &options.io)) {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+    params.pattern = (const uint8_t *) argv[optind];
+    params.pattern_len = (uint32_t) pattern_len;
+    params.opaque = &results;
+    bool valid = search(&reader, &params);
+    reader_close(&reader);
+    lz78_dict_free(dict);
+    if (valid && results.count) {
+        fprintf(results.out, "%" PRIu64 "\n", results.matches);
+    }
+    fclose(results.out);
+    if (!valid) {
+        fprintf(stderr, "Corrupt file\n");
+        return 2;
+    }
+
+    if (options.verbose) {
+        print_verbose(total_syms, total_bits / BYTE);
+    }
+    if (options.stats) {
+        print_stats("search", total_syms, total_bits / BYTE, trace_now() - started, &stats, 0,
+            io_memory(&options.io));
+    }
+    check_null_and_close(options.input_file);
+    return results.matches > 0 ? 0 : 1;
+}
+
+/*
+    Reports a match at offset, on line line (counted from 0): its offset, or the number of its line
+    unless the line has been reported, or with count nothing.
+*/
+static void report(void *opaque, uint64_t offset, uint64_t line) {
+    Results *results = (Results *) opaque;
+    if (results->lines && results->matches > 0 && line == results->line) {
+        return;
+    }
+    results->matches++;
+    results->line = line;
+    if (!results->count) {
+        fprintf(results->out, "%" PRIu64 "\n", results->lines ? line + 1 : offset);
+    }
+}
+
+/*
+    Runs the reader's buffers through a raw liblz78 decoder that searches for params->pattern as it
+    follows the pairs, building none of the output, and reports the matches.
+    Returns false if the pairs are malformed.
+*/
+bool search(Reader *reader, const LZ78Params *params) {
+    LZ78Params raw = *params;
+    raw.raw = true;
+    raw.match = report;
+    LZ78Stream stream;
+    if (lz78_decode_init(&stream, &raw) != LZ78_OK) {
+        fprintf(stderr, "Out of memory\n");
+        exit(2);
+    }
+
+    int flush = LZ78_RUN;
+    int response;
+    do {
+        if (stream.avail_in == 0 && flush == LZ78_RUN) {
+            stream.avail_in = reader_next(reader, &stream.next_in);
+            total_syms += stream.avail_in;
+            flush = stream.avail_in == 0 ? LZ78_FINISH : LZ78_RUN;
+        }
+        response = lz78_decode(&stream, flush);
+    } while (response == LZ78_OK);
+    total_bits += BYTE * stream.total_out;
+    lz78_decode_end(&stream);
+    return response == LZ78_STREAM_END;
+}
+
+void print_help(void) {
+    printf("SYNOPSIS\n"
+           "   Searches files compressed by the LZ78 encoder for a pattern, without decompressing them.\n\n"
+
+           "USAGE\n"
+           "   ./search [-vh] [--count] [--lines] [-D dict] [-B size] [--io=backend] [--direct]\n"
+           "            [--stats=json] [-i input] [-o output] pattern\n\n"
+
+           "OPTIONS\n"
+           "   -v          Display the compressed and uncompressed sizes searched\n"
+           "   -i input    Specify input to search (stdin by default)\n"
+           "   -o output   Specify output of the matches (stdout by default)\n"
+           "   -D dict     Preset dictionary the file was compressed with\n"
+           "   --count     Print the number of matches (with --lines, of lines with matches) only\n"
+           "   --lines     Print the number of each line with a match, counted from 1, once\n"
+           "               (the offset of each match by default)\n"
+           "   -B size     I/O buffer size, K/M/G suffixes allowed (64K by default)\n"
+           "   --io=name   I/O backend: auto, sync, mmap, uring or thread (auto by default)\n"
+           "   --direct    Bypass the page cache with O_DIRECT where supported\n"
+           "   --stats=json  Print sizes, I/O calls, timings and codec counters (make STATS=1) as JSON\n"
+           "   -h          Display program usage\n\n"
+
+           "EXIT STATUS\n"
+           "   0 if the pattern is found, 1 if not, 2 on errors\n");
+}
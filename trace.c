@@ -0,0 +1,119 @@
+#include "trace.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+//A recorded span. Epochs carry their uncompressed offsets in value and end_offset.
+typedef struct Span {
+    const char *name;
+    uint64_t start;
+    uint64_t end;
+    uint32_t tid;
+    const char *key;
+    uint64_t value;
+    uint64_t end_offset;
+} Span;
+
+static FILE *trace_file = NULL;
+static uint64_t trace_origin; // trace_now() when the trace was opened.
+static Span *spans = NULL;
+static size_t span_count = 0;
+static size_t span_capacity = 0;
+static pthread_mutex_t span_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_uint next_tid = 1;
+static _Thread_local uint32_t tid = 0; // Small per-thread ID, assigned on first use.
+static _Thread_local uint64_t epoch_mark = 0; // When the current epoch of this thread began.
+
+uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + (uint64_t) ts.tv_nsec;
+}
+
+bool trace_open(const char *path) {
+    trace_file = fopen(path, "w");
+    trace_origin = trace_now();
+    return trace_file != NULL;
+}
+
+/*
+    Appends a span under the lock, growing the array as needed. A span that does not fit is dropped.
+*/
+static void record(Span span) {
+    if (tid == 0) {
+        tid = atomic_fetch_add(&next_tid, 1);
+    }
+    span.tid = tid;
+    pthread_mutex_lock(&span_lock);
+    if (span_count == span_capacity) {
+        size_t capacity = span_capacity == 0 ? 4096 : 2 * span_capacity;
+        Span *grown = (Span *) realloc(spans, capacity * sizeof(Span));
+        if (grown != NULL) {
+            spans = grown;
+            span_capacity = capacity;
+        }
+    }
+    if (span_count < span_capacity) {
+        spans[span_count++] = span;
+    }
+    pthread_mutex_unlock(&span_lock);
+}
+
+void trace_span(const char *name, uint64_t start, uint64_t end, const char *key, uint64_t value) {
+    if (trace_file == NULL) {
+        return;
+    }
+    record((Span) { .name = name, .start = start, .end = end, .key = key, .value = value });
+}
+
+void trace_mark(void) {
+    epoch_mark = trace_now();
+}
+
+void trace_epoch(void *opaque, uint64_t start, uint64_t end) {
+    (void) opaque;
+    uint64_t now = trace_now();
+    if (trace_file != NULL) {
+        record((Span) { .name = "epoch", .start = epoch_mark, .end = now, .value = start, .end_offset = end });
+    }
+    epoch_mark = now;
+}
+
+/*
+    Timestamps are microseconds, with nanosecond decimals, from when the trace was opened.
+*/
+static void print_time(uint64_t ns) {
+    fprintf(trace_file, "%llu.%03llu", (unsigned long long) (ns / 1000), (unsigned long long) (ns % 1000));
+}
+
+void trace_close(void) {
+    if (trace_file == NULL) {
+        return;
+    }
+    fprintf(trace_file, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < span_count; i++) {
+        const Span *span = &spans[i];
+        uint64_t start = span->start > trace_origin ? span->start - trace_origin : 0;
+        uint64_t end = span->end > span->start ? span->end - span->start : 0;
+        fprintf(trace_file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":", span->name, span->tid);
+        print_time(start);
+        fprintf(trace_file, ",\"dur\":");
+        print_time(end);
+        if (span->key != NULL) {
+            fprintf(trace_file, ",\"args\":{\"%s\":%llu}", span->key, (unsigned long long) span->value);
+        } else if (span->end_offset != 0) {
+            fprintf(trace_file, ",\"args\":{\"start\":%llu,\"end\":%llu}", (unsigned long long) span->value,
+                (unsigned long long) span->end_offset);
+        }
+        fprintf(trace_file, "}%s\n", i + 1 < span_count ? "," : "");
+    }
+    fprintf(trace_file, "]}\n");
+    fclose(trace_file);
+    trace_file = NULL;
+    free(spans);
+    spans = NULL;
+    span_count = span_capacity = 0;
+}
@@ -0,0 +1,47 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Timings for --stats and --trace. A trace is a JSON file in the Chrome trace event format (open it
+// in chrome://tracing or Perfetto): one complete event ("ph": "X") per span, on the thread that ran
+// it, with timestamps in microseconds from the start of the run. Spans are recorded per I/O buffer,
+// per codec call or chunk, and per dictionary epoch, so there are only a few per megabyte.
+//
+
+//
+// Monotonic clock in nanoseconds.
+//
+uint64_t trace_now(void);
+
+//
+// Starts recording spans, to be written to path by trace_close(). Returns false if path cannot
+// be created.
+//
+bool trace_open(const char *path);
+
+//
+// Records a span named name from start to end (trace_now() values), with an optional argument
+// key: value (key NULL for none). Does nothing unless a trace is open. Safe from any thread.
+//
+void trace_span(const char *name, uint64_t start, uint64_t end, const char *key, uint64_t value);
+
+//
+// Marks the start of a stream's first dictionary epoch on the calling thread.
+//
+void trace_mark(void);
+
+//
+// LZ78Params.epoch hook: records the epoch that just ended on the calling thread, from the last
+// mark or epoch, with its uncompressed offsets.
+//
+void trace_epoch(void *opaque, uint64_t start, uint64_t end);
+
+//
+// Writes out the recorded spans and stops recording.
+//
+void trace_close(void);
+
+#endif
@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "io.h"
+#include "lz78.h"
+#include "helpers.h"
+
+uint8_t *read_samples(Reader *reader, size_t *len);
+void print_help(void);
+
+/*
+    Main function that gets arguments, trains a dictionary on the input and writes it out.
+*/
+int main(int argc, char **argv) {
+    Options options = { .input_file = 0, .output_file = 1 };
+
+    int response = argparser(argc, argv, &options);
+
+    if (response == 4) {
+        print_help();
+        return 0;
+    }
+
+    if (response != 0) {
+        check_null_and_close(options.input_file);
+        check_null_and_close(options.output_file);
+        if (options.help) {
+            print_help();
+        }
+        return -1;
+    }
+
+    Reader reader;
+    if (!reader_open(&reader, options.input_file, &options.io)) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    size_t samples_len;
+    uint8_t *samples = read_samples(&reader, &samples_len);
+    reader_close(&reader);
+
+    size_t dict_len = lz78_dict_bound(options.phrases);
+    uint8_t *dict = (uint8_t *) malloc(dict_len);
+    if (dict == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    response = lz78_dict_train(dict, &dict_len, samples, samples_len, options.phrases, &options.params);
+    if (response == LZ78_PARAM_ERROR) {
+        fprintf(stderr, "Invalid parameters\n");
+        return 1;
+    }
+    if (response != LZ78_OK) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+    check_print_file_error(write_bytes(options.output_file, dict, (int) dict_len));
+
+    if (options.verbose) {
+        uint32_t id = 0;
+        for (int i = 0; i < DICT_ID_SIZE; i++) {
+            id |= (uint32_t) dict[4 + i] << (BYTE * i);
+        }
+        fprintf(stderr, "Sample size: %zu bytes\n", samples_len);
+        fprintf(stderr, "Dictionary phrases: %zu\n", (dict_len - DICT_HEADER_SIZE) / 4);
+        fprintf(stderr, "Dictionary ID: %08x\n", id);
+    }
+
+    free(dict);
+    free(samples);
+    check_null_and_close(options.input_file);
+    check_null_and_close(options.output_file);
+
+    return 0;
+}
+
+/*
+    Reads the whole input into one buffer, which the trainer parses in a single pass.
+*/
+uint8_t *read_samples(Reader *reader, size_t *len) {
+    size_t capacity = IO_BUFFER_SIZE;
+    uint8_t *samples = (uint8_t *) malloc(capacity);
+    *len = 0;
+    while (samples != NULL) {
+        if (*len == capacity) {
+            capacity *= 2;
+            uint8_t *grown = (uint8_t *) realloc(samples, capacity);
+            if (grown == NULL) {
+                free(samples);
+                samples = NULL;
+                break;
+            }
+            samples = grown;
+        }
+        size_t response = reader_read(reader, samples + *len, capacity - *len);
+        *len += response;
+        if (*len < capacity) {
+            return samples;
+        }
+    }
+    fprintf(stderr, "Out of memory\n");
+    exit(1);
+}
+
+void print_help(void) {
+    printf("SYNOPSIS\n"
+           "   Trains a preset dictionary for small inputs on a sample of them.\n"
+           "   The dictionary is given to encode and decode with -D.\n\n"
+
+           "USAGE\n"
+           "   ./train [-vh] [-b bits] [--lzw] [-n phrases] [-i input] [-o output]\n\n"
+
+           "OPTIONS\n"
+           "   -v          Display training statistics\n"
+           "   -i input    Specify samples to train on (stdin by default)\n"
+           "   -o output   Specify output of the dictionary (stdout by default)\n"
+           "   -b bits     Smallest code width the dictionary is used with, 9 to 24 (16 by default)\n"
+           "   --lzw       Train for encode --lzw\n"
+           "   -n phrases  Most phrases to keep (4096 by default)\n"
+           "   -h          Display program help and usage\n");
+}
@@ -1,66 +1,343 @@
 #include "trie.h"
 #include "code.h"
 
+#include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//Child blocks are runs of 32-bit slots in the slot pool.
+//Node4 and Node16 start with their keys (4 per slot), in insertion order, followed by
+//the child indices. Node48 starts with a 256 byte symbol -> slot + 1 map (zero meaning
+//absent) followed by 48 child indices. Node256 is 256 child indices indexed by symbol.
+#define KEY_SLOTS(keys) ((keys) / 4)
+
+static const uint16_t kind_capacity[] = { 4, 16, 48, ALPHABET };
+static const uint16_t key_slots[] = { KEY_SLOTS(4), KEY_SLOTS(16), KEY_SLOTS(ALPHABET), 0 };
+static const uint16_t block_slots[] = { KEY_SLOTS(4) + 4, KEY_SLOTS(16) + 16, KEY_SLOTS(ALPHABET) + 48,
+    ALPHABET };
+
+//Every node's child blocks, counting the ones outgrown on the way, take at most
+//this many slots per child, which bounds the slot pool by the node pool.
+#define SLOTS_PER_NODE 9
 
 /*
     Creates a trie node with code: index.
-    This allocates the memory required for the children pointer array.
+    The node is taken from the node pool; leaves do not get a child block until
+    their first child is inserted.
 */
-TrieNode *trie_node_create(uint16_t index) {
-    TrieNode *node = (TrieNode *) calloc(1, sizeof(TrieNode));
-
-    if (node == NULL) {
+TrieNode *trie_node_create(Trie *t, uint32_t index) {
+    if (t->node_count == t->node_capacity) {
         return NULL;
     }
-
+    TrieNode *node = &t->nodes[t->node_count++];
+    node->children = 0;
     node->code = index;
+    node->count = 0;
+    node->kind = NODE4;
     return node;
 }
 
 /*
-    Frees node n and sets pointer to NULL
+    Bytes of a trie for a full dictionary of bits wide codes: the trie and its node and slot pools.
+*/
+size_t trie_size(uint8_t bits) {
+    size_t node_capacity = (size_t) max_code(bits) + 1;
+    return sizeof(Trie) + node_capacity * sizeof(TrieNode)
+           + (SLOTS_PER_NODE * node_capacity + 1) * sizeof(uint32_t);
+}
+
+/*
+    Bytes of the trie that have been in use, at the most nodes and slots it has held at once.
 */
-void trie_node_delete(TrieNode *n) {
-    free(n);
+size_t trie_peak(const Trie *t) {
+    uint32_t nodes = t->node_count > t->node_peak ? t->node_count : t->node_peak;
+    uint32_t slots = t->slot_count > t->slot_peak ? t->slot_count : t->slot_peak;
+    return sizeof(Trie) + (size_t) nodes * sizeof(TrieNode) + (size_t) slots * sizeof(uint32_t);
+}
+
+/*
+    Records how full the pools are before they are rewound.
+*/
+static void trie_mark_peak(Trie *t) {
+    if (t->node_count > t->node_peak) {
+        t->node_peak = t->node_count;
+    }
+    if (t->slot_count > t->slot_peak) {
+        t->slot_peak = t->slot_count;
+    }
 }
 
 /*
     Creates a new trie with EMPTY_CODE root.
+    Node and slot pools are sized for a full dictionary of bits wide codes and allocated with the
+    trie in one block. Pages of the pools are only touched as the dictionary fills.
+*/
+Trie *trie_create(uint8_t bits) {
+    uint32_t node_capacity = max_code(bits) + 1;
+    uint32_t slot_capacity = SLOTS_PER_NODE * node_capacity + 1;
+    Trie *t = (Trie *) malloc(trie_size(bits));
+
+    if (t == NULL) {
+        return NULL;
+    }
+
+    t->nodes = (TrieNode *) (t + 1);
+    t->slots = (uint32_t *) (t->nodes + node_capacity);
+    t->node_capacity = node_capacity;
+    t->slot_capacity = slot_capacity;
+    t->node_count = 0;
+    t->slot_count = 0;
+    t->node_peak = 0;
+    t->slot_peak = 0;
+    STAT(memset(t->blocks, 0, sizeof(t->blocks)));
+    trie_reset(t);
+    return t;
+}
+
+/*
+    Empties the trie back to a lone root by rewinding both pools.
+    Index 0 of each pool is reserved to mean "none".
+*/
+void trie_reset(Trie *t) {
+    trie_mark_peak(t);
+    t->node_count = 1;
+    t->slot_count = 1;
+    memset(t->free_blocks, 0, sizeof(t->free_blocks));
+    t->root = trie_node_create(t, EMPTY_CODE);
+}
+
+/*
+    LZW mode: gives the root a child for every symbol, so that each symbol is a phrase of its own.
+*/
+void trie_seed(Trie *t) {
+    for (uint32_t sym = 0; sym < ALPHABET; sym++) {
+        trie_insert(t, t->root, (uint8_t) sym, START_CODE + sym);
+    }
+}
+
+/*
+    Makes dst a copy of src, which must fit in dst's pools. Nodes and blocks are addressed by
+    indices, so copying the used part of each pool is enough.
+*/
+void trie_copy(Trie *dst, const Trie *src) {
+    trie_mark_peak(dst);
+    memcpy(dst->nodes, src->nodes, src->node_count * sizeof(TrieNode));
+    memcpy(dst->slots, src->slots, src->slot_count * sizeof(uint32_t));
+    memcpy(dst->free_blocks, src->free_blocks, sizeof(src->free_blocks));
+    dst->node_count = src->node_count;
+    dst->slot_count = src->slot_count;
+    dst->root = dst->nodes + (src->root - src->nodes);
+}
+
+/*
+    Frees the trie and every node in it.
 */
-TrieNode *trie_create(void) {
-    return trie_node_create(EMPTY_CODE);
+void trie_delete(Trie *t) {
+    free(t);
 }
 
 /*
-    Deletes trie from root
+    Takes a block of the given kind from its free list or the end of the slot pool.
+    Returns its offset, or 0 if the pool is exhausted.
 */
-void trie_reset(TrieNode *root) {
-    for (int i = 0; i < ALPHABET; i++) {
-        if (root->children[i] != NULL) {
-            trie_delete(root->children[i]);
-            root->children[i] = NULL;
+static uint32_t block_alloc(Trie *t, uint8_t kind) {
+    uint32_t block = t->free_blocks[kind];
+    if (block != 0) {
+        t->free_blocks[kind] = t->slots[block];
+    } else {
+        if (t->slot_count + block_slots[kind] > t->slot_capacity) {
+            return 0;
         }
+        block = t->slot_count;
+        t->slot_count += block_slots[kind];
     }
+    memset(&t->slots[block], 0, block_slots[kind] * sizeof(uint32_t));
+    STAT(t->blocks[kind]++);
+    return block;
 }
 
 /*
-    Deletes each child in the subtree by using recursive call.
-    Then will delete node n. 
+    Returns an outgrown block to the free list of its kind.
 */
-void trie_delete(TrieNode *n) {
-    for (int i = 0; i < ALPHABET; i++) {
-        if (n->children[i] != NULL) {
-            trie_delete(n->children[i]);
-            n->children[i] = NULL;
+static void block_free(Trie *t, uint32_t block, uint8_t kind) {
+    t->slots[block] = t->free_blocks[kind];
+    t->free_blocks[kind] = block;
+}
+
+/*
+    Finds sym among the first count keys. Returns its slot or -1.
+*/
+static inline int find_key(const uint8_t *keys, int count, int width, uint8_t sym) {
+#if defined(__SSE2__)
+    __m128i needle = _mm_set1_epi8((char) sym);
+    __m128i haystack;
+    if (width == 4) {
+        uint32_t packed;
+        memcpy(&packed, keys, sizeof(uint32_t));
+        haystack = _mm_cvtsi32_si128((int) packed);
+    } else {
+        haystack = _mm_loadu_si128((const __m128i *) keys);
+    }
+    int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(haystack, needle)) & ((1 << count) - 1);
+    return mask ? __builtin_ctz((unsigned) mask) : -1;
+#else
+    (void) width;
+    for (int i = 0; i < count; i++) {
+        if (keys[i] == sym) {
+            return i;
         }
     }
-    trie_node_delete(n);
+    return -1;
+#endif
 }
 
 /*
     Steps down the tree to symbol
 */
-TrieNode *trie_step(TrieNode *n, uint8_t sym) {
-    return n->children[sym];
+TrieNode *trie_step(Trie *t, TrieNode *n, uint8_t sym) {
+    if (n->children == 0) {
+        return NULL;
+    }
+    uint32_t *block = &t->slots[n->children];
+    uint32_t *children = block + key_slots[n->kind];
+    uint32_t child;
+    int slot;
+    switch (n->kind) {
+    case NODE4:
+    case NODE16:
+        slot = find_key((const uint8_t *) block, n->count, kind_capacity[n->kind], sym);
+        child = slot < 0 ? 0 : children[slot];
+        break;
+    case NODE48:
+        slot = ((const uint8_t *) block)[sym];
+        child = slot == 0 ? 0 : children[slot - 1];
+        break;
+    default: child = children[sym]; break;
+    }
+    return child == 0 ? NULL : &t->nodes[child];
+}
+
+/*
+    Moves the children of a full node into a block of the next kind up.
+    Returns false if the slot pool is exhausted.
+*/
+static bool grow(Trie *t, TrieNode *n) {
+    uint8_t kind = n->kind;
+    uint32_t block = block_alloc(t, kind + 1);
+    if (block == 0) {
+        return false;
+    }
+    uint32_t *old = &t->slots[n->children];
+    uint32_t *new = &t->slots[block];
+    const uint8_t *old_keys = (const uint8_t *) old;
+    uint32_t *old_children = old + key_slots[kind];
+    uint32_t *new_children = new + key_slots[kind + 1];
+
+    switch (kind) {
+    case NODE4:
+        memcpy(new, old_keys, kind_capacity[kind]);
+        memcpy(new_children, old_children, kind_capacity[kind] * sizeof(uint32_t));
+        break;
+    case NODE16:
+        for (int i = 0; i < kind_capacity[kind]; i++) {
+            ((uint8_t *) new)[old_keys[i]] = (uint8_t) (i + 1);
+        }
+        memcpy(new_children, old_children, kind_capacity[kind] * sizeof(uint32_t));
+        break;
+    default:
+        for (int sym = 0; sym < ALPHABET; sym++) {
+            if (old_keys[sym] != 0) {
+                new_children[sym] = old_children[old_keys[sym] - 1];
+            }
+        }
+        break;
+    }
+    block_free(t, n->children, kind);
+    n->children = block;
+    n->kind = kind + 1;
+    return true;
+}
+
+/*
+    Creates a child of n for symbol sym with the given code, growing n's child block
+    to the next node kind if it is full. Returns the new child, or NULL if a pool is exhausted.
+*/
+TrieNode *trie_insert(Trie *t, TrieNode *n, uint8_t sym, uint32_t code) {
+    if (n->children == 0) {
+        n->children = block_alloc(t, NODE4);
+        if (n->children == 0) {
+            return NULL;
+        }
+        n->kind = NODE4;
+    } else if (n->kind != NODE256 && n->count == kind_capacity[n->kind]) {
+        if (!grow(t, n)) {
+            return NULL;
+        }
+    }
+
+    TrieNode *child = trie_node_create(t, code);
+    if (child == NULL) {
+        return NULL;
+    }
+    uint32_t index = (uint32_t) (child - t->nodes);
+
+    uint32_t *block = &t->slots[n->children];
+    uint32_t *children = block + key_slots[n->kind];
+    switch (n->kind) {
+    case NODE4:
+    case NODE16:
+        ((uint8_t *) block)[n->count] = sym;
+        children[n->count] = index;
+        break;
+    case NODE48:
+        children[n->count] = index;
+        ((uint8_t *) block)[sym] = (uint8_t) (n->count + 1);
+        break;
+    default: children[sym] = index; break;
+    }
+    n->count++;
+    return child;
+}
+
+/*
+    Records the parent of every node but the root in parents, indexed by node: the parent's node
+    index | the child's symbol << 24. Replaying trie_insert() with these in node order from the
+    same starting trie rebuilds the pools exactly.
+*/
+void trie_parents(const Trie *t, uint32_t *parents) {
+    for (uint32_t index = 1; index < t->node_count; index++) {
+        const TrieNode *n = &t->nodes[index];
+        if (n->children == 0) {
+            continue;
+        }
+        const uint32_t *block = &t->slots[n->children];
+        const uint8_t *keys = (const uint8_t *) block;
+        const uint32_t *children = block + key_slots[n->kind];
+        switch (n->kind) {
+        case NODE4:
+        case NODE16:
+            for (uint32_t i = 0; i < n->count; i++) {
+                parents[children[i]] = index | (uint32_t) keys[i] << 24;
+            }
+            break;
+        case NODE48:
+            for (uint32_t sym = 0; sym < ALPHABET; sym++) {
+                if (keys[sym] != 0) {
+                    parents[children[keys[sym] - 1]] = index | sym << 24;
+                }
+            }
+            break;
+        default:
+            for (uint32_t sym = 0; sym < ALPHABET; sym++) {
+                if (children[sym] != 0) {
+                    parents[children[sym]] = index | sym << 24;
+                }
+            }
+            break;
+        }
+    }
 }
@@ -1,27 +1,65 @@
 #ifndef __TRIE_H__
 #define __TRIE_H__
 
+#include <stddef.h>
 #include <stdint.h>
 
 #define ALPHABET 256
 
+//Node kinds, by the number of children their child block can hold.
+typedef enum NodeKind { NODE4, NODE16, NODE48, NODE256 } NodeKind;
+
 typedef struct TrieNode TrieNode;
 
+//A node only carries a child block once it has children, and the block
+//grows through the node kinds as children are inserted.
+//children is an offset into the trie's slot pool (0 while the node is a leaf).
 struct TrieNode {
-    TrieNode *children[ALPHABET];
-    uint16_t code;
+    uint32_t children;
+    uint32_t code;
+    uint16_t count;
+    uint8_t kind;
 };
 
-TrieNode *trie_node_create(uint16_t index);
+//All nodes and child blocks of a trie live in one preallocated allocation.
+//Nodes are addressed by 32-bit indices into nodes (0 meaning none), so a
+//reset only rewinds the pools.
+typedef struct Trie {
+    TrieNode *root;
+    TrieNode *nodes;
+    uint32_t *slots;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    uint32_t slot_count;
+    uint32_t slot_capacity;
+    uint32_t free_blocks[NODE256 + 1];
+    uint32_t node_peak; // Most nodes and slots in use before the pools were last rewound.
+    uint32_t slot_peak;
+#ifdef LZ78_STATS
+    uint64_t blocks[NODE256 + 1]; // Child blocks allocated over the trie's life, by kind.
+#endif
+} Trie;
+
+TrieNode *trie_node_create(Trie *t, uint32_t index);
+
+size_t trie_size(uint8_t bits);
+
+size_t trie_peak(const Trie *t);
+
+Trie *trie_create(uint8_t bits);
+
+void trie_reset(Trie *t);
+
+void trie_seed(Trie *t);
 
-void trie_node_delete(TrieNode *n);
+void trie_copy(Trie *dst, const Trie *src);
 
-TrieNode *trie_create(void);
+void trie_delete(Trie *t);
 
-void trie_reset(TrieNode *root);
+TrieNode *trie_step(Trie *t, TrieNode *n, uint8_t sym);
 
-void trie_delete(TrieNode *n);
+TrieNode *trie_insert(Trie *t, TrieNode *n, uint8_t sym, uint32_t code);
 
-TrieNode *trie_step(TrieNode *n, uint8_t sym);
+void trie_parents(const Trie *t, uint32_t *parents);
 
 #endif
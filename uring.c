@@ -0,0 +1,161 @@
+#include "uring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+//Ring file descriptor plus the shared submission and completion queues.
+struct Ring {
+    int fd;
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    struct io_uring_sqe *sqes;
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+};
+
+/*
+    Creates the ring and maps its queues.
+*/
+Ring *ring_create(uint32_t entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int) syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    Ring *r = (Ring *) calloc(1, sizeof(Ring));
+    if (r == NULL) {
+        close(fd);
+        return NULL;
+    }
+    r->fd = fd;
+    r->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    r->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+        IORING_OFF_SQ_RING);
+    r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+        IORING_OFF_CQ_RING);
+    r->sqes = (struct io_uring_sqe *) mmap(
+        NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED || r->sqes == MAP_FAILED) {
+        ring_delete(r);
+        return NULL;
+    }
+
+    uint8_t *sq = (uint8_t *) r->sq_ring;
+    uint8_t *cq = (uint8_t *) r->cq_ring;
+    r->sq_head = (uint32_t *) (sq + params.sq_off.head);
+    r->sq_tail = (uint32_t *) (sq + params.sq_off.tail);
+    r->sq_mask = (uint32_t *) (sq + params.sq_off.ring_mask);
+    r->sq_array = (uint32_t *) (sq + params.sq_off.array);
+    r->cq_head = (uint32_t *) (cq + params.cq_off.head);
+    r->cq_tail = (uint32_t *) (cq + params.cq_off.tail);
+    r->cq_mask = (uint32_t *) (cq + params.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return r;
+}
+
+/*
+    Fills the next submission entry and hands it to the kernel.
+*/
+bool ring_submit(Ring *r, bool write, int fd, void *buf, uint32_t len, uint64_t offset, uint64_t tag) {
+    uint32_t tail = *r->sq_tail;
+    uint32_t index = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = tag;
+    r->sq_array[index] = index;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0) == 1;
+}
+
+/*
+    Takes the next completion, blocking in the kernel if there is none yet.
+*/
+bool ring_wait(Ring *r, uint64_t *tag, int32_t *result) {
+    while (true) {
+        uint32_t head = *r->cq_head;
+        if (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            *tag = cqe->user_data;
+            *result = cqe->res;
+            __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+        if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+            return false;
+        }
+    }
+}
+
+/*
+    Unmaps the queues and closes the ring.
+*/
+void ring_delete(Ring *r) {
+    if (r == NULL) {
+        return;
+    }
+    if (r->sq_ring != NULL && r->sq_ring != MAP_FAILED) {
+        munmap(r->sq_ring, r->sq_ring_size);
+    }
+    if (r->cq_ring != NULL && r->cq_ring != MAP_FAILED) {
+        munmap(r->cq_ring, r->cq_ring_size);
+    }
+    if (r->sqes != NULL && (void *) r->sqes != MAP_FAILED) {
+        munmap(r->sqes, r->sqes_size);
+    }
+    close(r->fd);
+    free(r);
+}
+
+#else
+
+Ring *ring_create(uint32_t entries) {
+    (void) entries;
+    return NULL;
+}
+
+bool ring_submit(Ring *r, bool write, int fd, void *buf, uint32_t len, uint64_t offset, uint64_t tag) {
+    (void) r, (void) write, (void) fd, (void) buf, (void) len, (void) offset, (void) tag;
+    return false;
+}
+
+bool ring_wait(Ring *r, uint64_t *tag, int32_t *result) {
+    (void) r, (void) tag, (void) result;
+    return false;
+}
+
+void ring_delete(Ring *r) {
+    (void) r;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Minimal io_uring submission/completion ring, driven through the raw system calls so no
+// liburing is needed. Only plain reads and writes at explicit offsets are supported.
+//
+
+typedef struct Ring Ring;
+
+//
+// Creates a ring with room for entries requests in flight. Returns NULL if io_uring is not
+// available (old kernel, seccomp, no build support).
+//
+Ring *ring_create(uint32_t entries);
+
+//
+// Queues and submits a read (write == false) or write of len bytes between buf and fd at
+// offset. tag is handed back with the completion. Returns false if submission failed.
+//
+bool ring_submit(Ring *r, bool write, int fd, void *buf, uint32_t len, uint64_t offset, uint64_t tag);
+
+//
+// Waits for one completion and stores its tag and result (bytes transferred or -errno).
+// Returns false if waiting failed.
+//
+bool ring_wait(Ring *r, uint64_t *tag, int32_t *result);
+
+void ring_delete(Ring *r);
+
+#endif
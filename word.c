@@ -73,39 +73,3 @@ void word_delete(Word *w) {
     }
     free(w);
 }
-
-/*
-    Creates new WordTable with size MAX_CODE
-*/
-WordTable *wt_create(void) {
-    WordTable *wt = (WordTable *) calloc(MAX_CODE, sizeof(Word *));
-    uint8_t *syms = (uint8_t *) calloc(1, sizeof(uint8_t));
-    Word *word = word_create(syms, 0);
-    wt[EMPTY_CODE] = word;
-    free(syms);
-    return wt;
-}
-
-/*
-    Resets wordtable by iteratively traversing word list and deleting all words in table (until null word)
-*/
-void wt_reset(WordTable *wt) {
-    for (int i = 1; i < MAX_CODE; i++) {
-        if (i == EMPTY_CODE || wt[i] == NULL) {
-            continue;
-        }
-        word_delete(wt[i]);
-        wt[i] = NULL;
-    }
-    return;
-}
-
-/*
-    Frees all words in WordTable, then frees wordtable->
-*/
-void wt_delete(WordTable *wt) {
-    wt_reset(wt);
-    word_delete(wt[EMPTY_CODE]);
-    free(wt);
-    return;
-}